@@ -0,0 +1,104 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+package com.amd.okra;
+
+// where the time went creating kernels, mirrors okra_kernel_build_info_t.
+// From OkraKernel.getBuildStats() for one kernel or OkraContext.getBuildStats()
+// summed over every kernel the context created.  Times are in nanoseconds and
+// phases a kernel did not go through are zero.
+public class OkraBuildStats {
+
+    public final long convertNanos;         // ConvertHsail and inlining
+    public final long scanNanos;            // kernarg access scan
+    public final long cacheNanos;           // brig cache lookup and store
+    public final long writeNanos;           // creating and writing the temp hsail file
+    public final long assembleNanos;        // the hsailasm process
+    public final long readNanos;            // mapping the brig hsailasm wrote
+    public final long createProgramNanos;
+    public final long lockWaitNanos;        // waiting for another thread's compileKernel
+    public final long compileKernelNanos;
+    public final long totalNanos;
+    public final boolean cached;            // the brig came from the cache, per kernel only
+
+    // counts, only set for context totals
+    public final long kernels;              // kernels finalized
+    public final long assembled;            // hsail assemblies, cache hits included
+    public final long cacheHits;
+    public final long failures;
+
+    // vals is laid out as filled in by the native side: the times and cached, then the counts
+    OkraBuildStats(long[] vals) {
+        convertNanos = vals[0];
+        scanNanos = vals[1];
+        cacheNanos = vals[2];
+        writeNanos = vals[3];
+        assembleNanos = vals[4];
+        readNanos = vals[5];
+        createProgramNanos = vals[6];
+        lockWaitNanos = vals[7];
+        compileKernelNanos = vals[8];
+        totalNanos = vals[9];
+        cached = vals[10] != 0;
+        kernels = vals[11];
+        assembled = vals[12];
+        cacheHits = vals[13];
+        failures = vals[14];
+    }
+
+    @Override
+    public String toString() {
+        StringBuilder sb = new StringBuilder();
+        if (kernels != 0 || assembled != 0) {
+            sb.append(kernels).append(" kernels, ").append(assembled).append(" assembled, ")
+              .append(cacheHits).append(" cache hits, ").append(failures).append(" failures; ");
+        }
+        sb.append("total ").append(totalNanos).append(" ns: convert ").append(convertNanos)
+          .append(", scan ").append(scanNanos).append(", cache ").append(cacheNanos)
+          .append(", write ").append(writeNanos).append(", hsailasm ").append(assembleNanos)
+          .append(", read ").append(readNanos).append(", createProgram ").append(createProgramNanos)
+          .append(", lock wait ").append(lockWaitNanos).append(", compileKernel ").append(compileKernelNanos);
+        if (cached) {
+            sb.append(" (cached)");
+        }
+        return sb.toString();
+    }
+}
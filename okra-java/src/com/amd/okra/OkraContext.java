@@ -47,12 +47,14 @@ import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
 import java.nio.file.Path;
 import java.nio.file.Files;
 import java.util.logging.*;
 import java.util.jar.*;
 import java.util.ArrayList;
 import java.util.List;
+import java.util.concurrent.CompletableFuture;
 
 public class OkraContext {
 
@@ -153,7 +155,7 @@ public class OkraContext {
     }
 
     private long contextHandle;
-    private int[] dummyArray;   // used for pinning if no other arrays passed
+    private int[] dummyArray;   // used for pinning if object args are passed but no arrays are pinned
 
     public OkraContext() {
         dummyArray = new int[1];
@@ -171,11 +173,85 @@ public class OkraContext {
     // create a c++ kernel object from the specified source and entrypoint
     native long createKernelJNI(String source, String entryName);
 
+    // as above from length bytes of hsail text starting at offset
+    native long createKernelFromBytesJNI(byte[] source, int offset, int length, String entryName);
+
+    // as above from a direct buffer, which is read in place
+    native long createKernelFromBufferJNI(ByteBuffer source, int position, int length, String entryName);
+
+    native long createKernelWithOptionsJNI(String source, String entryName, boolean debugInfo, boolean inlineFunctions);
+
+    // queue creation of a c++ kernel object, the future is completed from a native compile thread
+    private native boolean createKernelAsyncJNI(String source, String entryName, CompletableFuture<OkraKernel> future);
+
+    // create a kernel on a bounded pool of background threads (OKRA_ASYNC_COMPILE_THREADS, default 2).
+    // the future completes with a kernel whose isValid() is false if creation failed.
+    // dependent stages added without an executor run on the compile thread, so keep them short.
+    public CompletableFuture<OkraKernel> createKernelAsync(String source, String entryName) {
+        CompletableFuture<OkraKernel> future = new CompletableFuture<>();
+        if (!createKernelAsyncJNI(source, entryName, future)) {
+            future.complete(new OkraKernel(this, 0));
+        }
+        return future;
+    }
+
+    // called from the native side once an async kernel has been created
+    private static void completeKernelFuture(OkraContext context, CompletableFuture<OkraKernel> future, long kernelHandle) {
+        future.complete(new OkraKernel(context, kernelHandle));
+    }
+
+    // create a c++ module object from hsail text or a brig binary
+    native long createModuleJNI(String source);
+
+    native long createModuleFromBinaryJNI(byte[] brig);
+
+    // create many c++ kernel objects at once, one handle (or 0) per source
+    private native long[] createKernelsJNI(String[] sources, String[] entryNames, long[] stageNanos);
+
+    // indices into the stageNanos array filled in by createKernels; each stage
+    // is the wall time from the first kernel entering it to the last leaving it
+    public static final int STAGE_FIX = 0;         // ConvertHsail, inlining and the kernarg scan
+    public static final int STAGE_ASSEMBLE = 1;    // brig cache, fix, temp files, hsailasm and reading the brig
+    public static final int STAGE_FINALIZE = 2;    // createProgram and compileKernel
+    public static final int STAGE_WALL = 3;        // elapsed time for the whole batch
+
+    // create a kernel for each (source, entryName) pair, assembling them in parallel.
+    // check isValid() on each result.  stageNanos may be null.
+    public OkraKernel[] createKernels(String[] sources, String[] entryNames, long[] stageNanos) {
+        if (sources.length != entryNames.length) {
+            throw new IllegalArgumentException("got " + sources.length + " sources but " + entryNames.length + " entry names");
+        }
+        long[] handles = createKernelsJNI(sources, entryNames, stageNanos);
+        OkraKernel[] kernels = new OkraKernel[handles.length];
+        for (int i = 0; i < handles.length; i++) {
+            kernels[i] = new OkraKernel(this, handles[i]);
+        }
+        return kernels;
+    }
+
+    public OkraKernel[] createKernels(String[] sources, String[] entryNames) {
+        return createKernels(sources, entryNames, null);
+    }
+
+    private native long[] getBuildStatsJNI();
+
+    // build times and counts summed over every kernel this context has created
+    public OkraBuildStats getBuildStats() {
+        return new OkraBuildStats(getBuildStatsJNI());
+    }
+
     // dispose of an environment including all programs
     public native int dispose();
 
     public native void setVerbose(boolean b);
 
+    // override the compressed oops encoding (narrow oop decodes to base + (narrow << shift))
+    // which is otherwise discovered when the context is created
+    public native void setNarrowOopEncoding(boolean compressed, long base, int shift);
+
+    // whether object arrays hold 4 byte narrow oops, see OkraKernel.pushNarrowOopArgs
+    public native boolean isCompressedOops();
+
     static native long createRefHandle(Object obj);
 
 	public static native int setCoherence(boolean isCoherent);
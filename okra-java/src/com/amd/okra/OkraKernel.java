@@ -41,6 +41,8 @@
 //===----------------------------------------------------------------------===//
 package com.amd.okra;
 
+import java.nio.ByteBuffer;
+
 public class OkraKernel {
 
     static {
@@ -57,6 +59,46 @@ public class OkraKernel {
         //okraContext.registerHeapMemory(new Object());
     }
 
+    // hsail that is already bytes, e.g. read from a file or resource, avoids building a String
+    public OkraKernel(OkraContext okraContextInput, byte[] source, String entryName) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        kernelHandle = okraContextInput.createKernelFromBytesJNI(source, 0, source.length, entryName);
+        argsVecHandle = 0;
+    }
+
+    // the bytes between position and limit; a direct buffer is not copied at all
+    public OkraKernel(OkraContext okraContextInput, ByteBuffer source, String entryName) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        if (source.isDirect()) {
+            kernelHandle = okraContextInput.createKernelFromBufferJNI(source, source.position(), source.remaining(), entryName);
+        } else if (source.hasArray()) {
+            kernelHandle = okraContextInput.createKernelFromBytesJNI(source.array(), source.arrayOffset() + source.position(),
+                                                                     source.remaining(), entryName);
+        } else {
+            byte[] bytes = new byte[source.remaining()];
+            source.duplicate().get(bytes);
+            kernelHandle = okraContextInput.createKernelFromBytesJNI(bytes, 0, bytes.length, entryName);
+        }
+        argsVecHandle = 0;
+    }
+
+    public OkraKernel(OkraContext okraContextInput, String source, String entryName, OkraCompileOptions options) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        kernelHandle = okraContextInput.createKernelWithOptionsJNI(source, entryName, options.debugInfo, options.inlineFunctions);
+        argsVecHandle = 0;
+    }
+
+    // wrap a kernel handle already created on the native side
+    OkraKernel(OkraContext okraContextInput, long kernelHandleInput) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        kernelHandle = kernelHandleInput;
+        argsVecHandle = 0;
+    }
+
     private long kernelHandle;
     private long contextHandle;  // used by the JNI side
     private long argsVecHandle;  // only used by JNI side
@@ -66,6 +108,23 @@ public class OkraKernel {
         return (kernelHandle != 0);
     }
 
+    // access qualifiers for array args, these match OkraContext::Kernel::ArgAccess.
+    // ACCESS_DEFAULT lets the native side infer read-only from the kernel source.
+    // A read-only array is not copied back after the kernel on jvms that copy,
+    // a write-only array is not copied in before the kernel.
+    public static final int ACCESS_DEFAULT = 0;
+    public static final int ACCESS_READ_ONLY = 1;
+    public static final int ACCESS_WRITE_ONLY = 2;
+    public static final int ACCESS_READ_WRITE = 3;
+
+    // the (offset, length) variants of the pushXXXArrayArg methods pass only
+    // a slice of the array, the kernel sees element offset as its element 0
+    private static void checkSlice(int arrayLength, int offset, int length) {
+        if (offset < 0 || length < 0 || offset > arrayLength - length) {
+            throw new ArrayIndexOutOfBoundsException("slice [" + offset + ", " + (offset + length) + ") of array of length " + arrayLength);
+        }
+    }
+
     // various methods for setting different types of args into the arg stack
     public native int pushFloatArg(float f);
 
@@ -79,21 +138,123 @@ public class OkraKernel {
 
     public native int pushDoubleArg(double d);
 
-    public native int pushIntArrayArg(int[] a);
+    public int pushIntArrayArg(int[] a) {
+        return pushIntArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
+
+    public int pushIntArrayArg(int[] a, int access) {
+        return pushIntArrayArgJNI(a, 0, a.length, access);
+    }
+
+    public int pushIntArrayArg(int[] a, int offset, int length) {
+        return pushIntArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushIntArrayArg(int[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushIntArrayArgJNI(a, offset, length, access);
+    }
+
+    public int pushFloatArrayArg(float[] a) {
+        return pushFloatArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
 
-    public native int pushFloatArrayArg(float[] a);
+    public int pushFloatArrayArg(float[] a, int access) {
+        return pushFloatArrayArgJNI(a, 0, a.length, access);
+    }
 
-    public native int pushDoubleArrayArg(double[] a);
+    public int pushFloatArrayArg(float[] a, int offset, int length) {
+        return pushFloatArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
 
-    public native int pushBooleanArrayArg(boolean[] a);
+    public int pushFloatArrayArg(float[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushFloatArrayArgJNI(a, offset, length, access);
+    }
 
-    public native int pushByteArrayArg(byte[] a);
+    public int pushDoubleArrayArg(double[] a) {
+        return pushDoubleArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
 
-    public native int pushLongArrayArg(long[] a);
+    public int pushDoubleArrayArg(double[] a, int access) {
+        return pushDoubleArrayArgJNI(a, 0, a.length, access);
+    }
+
+    public int pushDoubleArrayArg(double[] a, int offset, int length) {
+        return pushDoubleArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushDoubleArrayArg(double[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushDoubleArrayArgJNI(a, offset, length, access);
+    }
+
+    public int pushBooleanArrayArg(boolean[] a) {
+        return pushBooleanArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
+
+    public int pushBooleanArrayArg(boolean[] a, int access) {
+        return pushBooleanArrayArgJNI(a, 0, a.length, access);
+    }
+
+    public int pushBooleanArrayArg(boolean[] a, int offset, int length) {
+        return pushBooleanArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushBooleanArrayArg(boolean[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushBooleanArrayArgJNI(a, offset, length, access);
+    }
+
+    public int pushByteArrayArg(byte[] a) {
+        return pushByteArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
+
+    public int pushByteArrayArg(byte[] a, int access) {
+        return pushByteArrayArgJNI(a, 0, a.length, access);
+    }
+
+    public int pushByteArrayArg(byte[] a, int offset, int length) {
+        return pushByteArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushByteArrayArg(byte[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushByteArrayArgJNI(a, offset, length, access);
+    }
+
+    public int pushLongArrayArg(long[] a) {
+        return pushLongArrayArgJNI(a, 0, a.length, ACCESS_DEFAULT);
+    }
+
+    public int pushLongArrayArg(long[] a, int access) {
+        return pushLongArrayArgJNI(a, 0, a.length, access);
+    }
+
+    public int pushLongArrayArg(long[] a, int offset, int length) {
+        return pushLongArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushLongArrayArg(long[] a, int offset, int length, int access) {
+        checkSlice(a.length, offset, length);
+        return pushLongArrayArgJNI(a, offset, length, access);
+    }
 
     public native int clearArgs();
 
-    private native int pushObjectArrayArgJNI(Object[] a);    // for possibly supporting oop array
+    private native int pushIntArrayArgJNI(int[] a, int offset, int length, int access);
+
+    private native int pushFloatArrayArgJNI(float[] a, int offset, int length, int access);
+
+    private native int pushDoubleArrayArgJNI(double[] a, int offset, int length, int access);
+
+    private native int pushBooleanArrayArgJNI(boolean[] a, int offset, int length, int access);
+
+    private native int pushByteArrayArgJNI(byte[] a, int offset, int length, int access);
+
+    private native int pushLongArrayArgJNI(long[] a, int offset, int length, int access);
+
+    private native int pushObjectArrayArgJNI(Object[] a, int offset, int length, int access);    // for possibly supporting oop array
 
     private native int pushObjectArgJNI(Object obj);
 
@@ -105,12 +266,29 @@ public class OkraKernel {
     }
 
     public int pushObjectArrayArg(Object[] a) {    // for possibly supporting oop array
+        return pushObjectArrayArg(a, ACCESS_DEFAULT);
+    }
+
+    public int pushObjectArrayArg(Object[] a, int access) {
+        return pushObjectArrayArg(a, 0, a.length, access);
+    }
+
+    public int pushObjectArrayArg(Object[] a, int offset, int length) {
+        return pushObjectArrayArg(a, offset, length, ACCESS_DEFAULT);
+    }
+
+    public int pushObjectArrayArg(Object[] a, int offset, int length, int access) {
         // since we registered the heap when okraContext was created,
         // we believe no further memory registration is needed here
-
-        return pushObjectArrayArgJNI(a);
+        checkSlice(a.length, offset, length);
+        return pushObjectArrayArgJNI(a, offset, length, access);
     }
 
+    // object arrays are passed as the jvm stores them, with compressed oops each
+    // element is a 4 byte narrow oop that decodes to base + (narrow << shift).
+    // this pushes base as a u64 kernarg followed by shift as a u32 kernarg.
+    public native int pushNarrowOopArgs();
+
     // for the setLaunchAttributes calls, we are just assuming 1D support for now.
     // version that explicitly specifies numWorkItems and groupSize
     public native int setLaunchAttributes(int numWorkItems, int groupSize);
@@ -128,6 +306,22 @@ public class OkraKernel {
         return dispatchKernelWaitCompleteJNI();
     }
 
+    // how long the last dispatch held the gc critical region (pinned arrays), in nanoseconds.
+    // arrays smaller than OKRA_COPY_THRESHOLD bytes (default 16K) are copied instead of pinned
+    // and do not count here.
+    public native long getCriticalRegionNanos();
+
+    // treat the scalar arg at idx as a constant: each value pushed for it gets a
+    // variant of the kernel compiled with the value substituted.  0 on success.
+    public native int specializeArg(int idx);
+
+    private native long[] getBuildStatsJNI();
+
+    // per-phase times of this kernel's creation
+    public OkraBuildStats getBuildStats() {
+        return new OkraBuildStats(getBuildStatsJNI());
+    }
+
     // if it is primitive, calls the appropriate push routine and
     // returns true else returns false
     private boolean pushPrimitiveArg(Class<?> argclass, Object arg) {
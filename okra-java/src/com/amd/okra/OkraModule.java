@@ -0,0 +1,90 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+package com.amd.okra;
+
+import java.util.Map;
+import java.util.HashMap;
+
+// a set of kernels assembled and loaded together, each one finalized
+// the first time getKernel asks for it
+public class OkraModule {
+
+    static {
+        OkraContext.loadOkraNativeLibrary();
+    } // end static
+
+    public OkraModule(OkraContext okraContextInput, String source) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        moduleHandle = okraContextInput.createModuleJNI(source);
+    }
+
+    public OkraModule(OkraContext okraContextInput, byte[] brig) {
+        okraContext = okraContextInput;
+        contextHandle = okraContextInput.getContextHandle();
+        moduleHandle = okraContextInput.createModuleFromBinaryJNI(brig);
+    }
+
+    private long moduleHandle;
+    private long contextHandle;  // used by the JNI side
+    private OkraContext okraContext;
+    private Map<String, OkraKernel> kernels = new HashMap<>();
+
+    public boolean isValid() {
+        return (moduleHandle != 0);
+    }
+
+    // the same OkraKernel (and so the same arg stack) is returned for every
+    // lookup of an entry name.  check isValid() on the result.
+    public synchronized OkraKernel getKernel(String entryName) {
+        OkraKernel kernel = kernels.get(entryName);
+        if (kernel == null) {
+            kernel = new OkraKernel(okraContext, getKernelJNI(entryName));
+            if (kernel.isValid()) {
+                kernels.put(entryName, kernel);
+            }
+        }
+        return kernel;
+    }
+
+    private native long getKernelJNI(String entryName);
+}
@@ -3,6 +3,7 @@
 ./buildone.sh ooparray
 ./buildone.sh reftest
 ./buildone.sh groupsize
+./buildone.sh subarray
 
 
 
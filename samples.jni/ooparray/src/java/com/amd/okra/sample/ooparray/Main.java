@@ -87,6 +87,8 @@ class Main {
 
 		OkraContext context = new OkraContext();
 		if (!context.isValid()) {System.out.println("...unable to create context"); System.exit(-1);}
+		// the kernel walks the array as 4 byte narrow oops
+		if (!context.isCompressedOops()) {System.out.println("...needs -XX:+UseCompressedOops"); System.exit(-1);}
 		OkraKernel kernel = new OkraKernel(context, source, "&run");
 		if (!kernel.isValid()) {System.out.println("...unable to create kernel"); System.exit(-1);}
 
@@ -101,6 +103,7 @@ class Main {
 		kernel.clearArgs();
 		kernel.pushFloatArrayArg(outArray);
 		kernel.pushObjectArrayArg(inArray);
+		kernel.pushNarrowOopArgs();
 
 		kernel.setLaunchAttributes(NUMELEMENTS); // 1 dimension
 
@@ -3,5 +3,6 @@ pushd SquaresDbl;  ../runsample.sh SquaresDbl; popd
 pushd ooparray;    ../runsample.sh ooparray; popd
 pushd reftest;     ../runsample.sh reftest; popd
 pushd groupsize;   ../runsample.sh groupsize; popd
+pushd subarray;    ../runsample.sh subarray; popd
 
 
@@ -0,0 +1,106 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+package com.amd.okra.sample.subarray;
+
+import com.amd.okra.OkraContext;
+import com.amd.okra.OkraKernel;
+import java.nio.file.Files;
+import java.nio.file.FileSystems;
+import java.io.IOException;
+
+// runs the squares kernel on a slice of each array: the kernel sees element
+// offset as its element 0, and nothing outside the output slice may change
+class Main {
+	static final float UNTOUCHED = -1;
+
+	// a small array is copied in and out, a big one is pinned
+	static boolean runSlices(OkraKernel kernel, int numElements, int inOffset, int outOffset, int length, int outAccess) {
+		float[] inArray = new float[numElements];
+		float[] outArray = new float[numElements];
+		for (int i=0; i<numElements; i++) {
+			inArray[i] = (float)i;
+			outArray[i] = UNTOUCHED;
+		}
+
+		kernel.clearArgs();
+		kernel.pushFloatArrayArg(outArray, outOffset, length, outAccess);
+		kernel.pushFloatArrayArg(inArray, inOffset, length, OkraKernel.ACCESS_READ_ONLY);
+		kernel.setLaunchAttributes(length); // 1 dimension
+		kernel.dispatchKernelWaitComplete();
+
+		boolean passed = true;
+		for (int i=0; i<numElements; i++) {
+			int k = i - outOffset;
+			float expected = (k >= 0 && k < length ? (float)(inOffset + k) * (inOffset + k) : UNTOUCHED);
+			if (outArray[i] != expected) {
+				System.out.println("array of " + numElements + ": " + i + "->" + outArray[i] + ", expected " + expected);
+				passed = false;
+			}
+		}
+		return passed;
+	}
+
+	public static void main(String[] _args) {
+		String sourceFileName = "subarray.hsail";
+		String squaresSource = null;
+		try {
+			squaresSource = new String(Files.readAllBytes(FileSystems.getDefault().getPath( sourceFileName)));
+		}
+		catch(IOException e) {
+			e.printStackTrace();
+			System.exit(-1);
+		}
+
+		OkraContext context = new OkraContext();
+		if (!context.isValid()) {System.out.println("...unable to create context"); System.exit(-1);}
+		OkraKernel kernel = new OkraKernel(context, squaresSource, "&run");
+		if (!kernel.isValid()) {System.out.println("...unable to create kernel"); System.exit(-1);}
+
+		boolean passed = true;
+		passed &= runSlices(kernel, 40, 5, 10, 20, OkraKernel.ACCESS_DEFAULT);
+		passed &= runSlices(kernel, 40, 5, 10, 20, OkraKernel.ACCESS_WRITE_ONLY);
+		passed &= runSlices(kernel, 16384, 100, 4000, 8000, OkraKernel.ACCESS_DEFAULT);
+		passed &= runSlices(kernel, 16384, 100, 4000, 8000, OkraKernel.ACCESS_WRITE_ONLY);
+		System.out.println((passed ? "PASSED": "FAILED") + "\n");
+	}
+}
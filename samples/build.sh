@@ -6,4 +6,10 @@ mkdir -p dist
 ./buildone.sh CSquaresDblThisFunc
 ./buildone.sh Cooparray
 ./buildone.sh CAtomicExch
+./buildone.sh CModule
+./buildone.sh CAsyncKernel
+./buildone.sh CBundle
+./buildone.sh CSpecialize
+# benchmark, not part of run.sh: ./runone.sh BenchInlineFunc
+./buildone.sh BenchInlineFunc
 
@@ -4,3 +4,7 @@
 ./runone.sh CSquaresDblThisFunc
 ./runone.sh Cooparray
 ./runone.sh CAtomicExch
+./runone.sh CModule
+./runone.sh CAsyncKernel
+./runone.sh CBundle
+./runone.sh CSpecialize
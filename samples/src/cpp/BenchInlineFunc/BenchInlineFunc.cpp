@@ -0,0 +1,151 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "okra.h"
+#include <iostream>
+#include <string>
+#include <time.h>
+#include <stdlib.h>
+#include "utils.h"
+
+using namespace std;
+
+/*************************
+ * Times the CSquaresDblThisFunc kernel, whose work is done in an hsail
+ * function, assembled as written and with inline_functions set so the
+ * call is inlined before assembly.
+ *
+ *   BenchInlineFunc [numElements] [iterations]
+ *
+ ******************/
+
+static double nowMillis() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+class BenchInlineFunc {
+private:
+	double *inArray;
+	double *outArray;
+	double adjustment;
+	int numElements;
+
+public:
+	BenchInlineFunc(int _numElements) {
+		numElements = _numElements;
+		inArray = new double[numElements];
+		outArray = new double[numElements];
+		adjustment = 0.123;
+		for (int i=0; i<numElements; i++) {
+			inArray[i] = (double)i;
+		}
+	}
+
+	// returns the average milliseconds per dispatch, or -1 if anything failed
+	double timeKernel(okra_context_t *context, const char *source, bool inlineFunctions, int iterations) {
+		okra_compile_options_t options;
+		okra_get_default_compile_options(context, &options);
+		options.inline_functions = inlineFunctions;
+
+		okra_kernel_t* kernel = NULL;
+		okra_status_t status = okra_create_kernel_with_options(context, source, "&run", &options, &kernel);
+		if (status != OKRA_SUCCESS) {cout << "Error while creating kernel:" << (int)status << endl; return -1;}
+
+		okra_range_t range;
+		range.dimension=1;
+		range.global_size[0] = numElements;
+		range.global_size[1] = range.global_size[2] = 1;
+		range.group_size[0] = (numElements < 256 ? numElements : 256);
+		range.group_size[1] = range.group_size[2] = 1;
+
+		okra_clear_args(kernel);
+		okra_push_pointer(kernel, this);
+
+		// one untimed dispatch, which also checks the results
+		for (int i=0; i<numElements; i++) outArray[i] = 0;
+		status = okra_execute_kernel(context, kernel, &range);
+		if (status != OKRA_SUCCESS) {cout << "Error while executing kernel:" << (int)status << endl; return -1;}
+		for (int i=0; i<numElements; i++) {
+			if (outArray[i] != (double)i*i + adjustment) {
+				cout << "wrong result at " << i << ": " << outArray[i] << endl;
+				return -1;
+			}
+		}
+
+		double start = nowMillis();
+		for (int j=0; j<iterations; j++) {
+			okra_execute_kernel(context, kernel, &range);
+		}
+		double elapsed = nowMillis() - start;
+		okra_dispose_kernel(kernel);
+		return elapsed / iterations;
+	}
+
+	void runTest(int iterations) {
+		char* source = buildStringFromSourceFile("BenchInlineFunc.hsail");
+		okra_context_t* context = NULL;
+		okra_status_t status = okra_get_context(&context);
+		if (status != OKRA_SUCCESS) {cout << "Error while creating context:" << (int)status << endl; exit(-1);}
+
+		double callMillis = timeKernel(context, source, false, iterations);
+		double inlinedMillis = timeKernel(context, source, true, iterations);
+		if (callMillis < 0 || inlinedMillis < 0) {
+			cout << "FAILED" << endl;
+			exit(-1);
+		}
+		cout << numElements << " elements, " << iterations << " dispatches" << endl;
+		cout << "with call:    " << callMillis << " ms per dispatch" << endl;
+		cout << "inlined:      " << inlinedMillis << " ms per dispatch" << endl;
+		cout << "speedup:      " << callMillis / inlinedMillis << "x" << endl;
+		cout << "PASSED" << endl;
+		okra_dispose_context(context);
+	}
+};
+
+int main(int argc, char *argv[]) {
+	int numElements = (argc > 1 ? atoi(argv[1]) : 4096);
+	int iterations = (argc > 2 ? atoi(argv[2]) : 10);
+	(new BenchInlineFunc(numElements))->runTest(iterations);
+	return 0;
+}
@@ -0,0 +1,141 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "okra.h"
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "utils.h"
+
+using namespace std;
+
+/*************************
+ * Creates the squares kernel several times in the background with
+ * okra_create_kernel_async, polls the pending handles while the calling
+ * thread is free, then waits for each kernel and dispatches it.
+ *
+ ******************/
+
+
+static const int NUMELEMENTS = 40;
+static const int NUMKERNELS = 4;
+float *inArray = new float[NUMELEMENTS];
+float *outArray = new float[NUMELEMENTS];
+
+static bool runKernel(okra_context_t *context, okra_kernel_t *kernel) {
+	for (int i=0; i<NUMELEMENTS; i++) {
+		outArray[i] = 0;
+	}
+	okra_clear_args(kernel);
+	okra_push_pointer(kernel, outArray);
+	okra_push_pointer(kernel, inArray);
+
+	okra_range_t range;
+	range.dimension=1;
+	range.global_size[0] = NUMELEMENTS;
+	range.global_size[1] = range.global_size[2] = 1;
+	range.group_size[0] = NUMELEMENTS;
+	range.group_size[1] = range.group_size[2] = 1;
+
+	okra_status_t status = okra_execute_kernel(context, kernel, &range);
+	if (status != OKRA_SUCCESS) {cout << "Error while executing kernel:" << (int)status << endl; return false;}
+
+	bool passed = true;
+	for (int i=0; i<NUMELEMENTS; i++) {
+		if (outArray[i] != i*i) passed = false;
+	}
+	return passed;
+}
+
+int main(int argc, char *argv[]) {
+	// initialize inArray
+	for (int i=0; i<NUMELEMENTS; i++) {
+		inArray[i] = (float)i;
+	}
+
+	string sourceFileName = "CAsyncKernel.hsail";
+	char* squaresSource = buildStringFromSourceFile(sourceFileName);
+
+	okra_status_t status;
+	okra_context_t* context = NULL;
+	status = okra_get_context(&context);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating context:" << (int)status << endl; exit(-1);}
+
+	okra_pending_kernel_t* pending[NUMKERNELS];
+	for (int k=0; k<NUMKERNELS; k++) {
+		status = okra_create_kernel_async(context, squaresSource, "&run", &pending[k]);
+		if (status != OKRA_SUCCESS) {cout << "Error while queueing kernel:" << (int)status << endl; exit(-1);}
+	}
+
+	// the calling thread is free while the kernels are created
+	int polls = 0;
+	int done = 0;
+	while (done == 0) {
+		okra_pending_kernel_poll(pending[0], &done);
+		if (done == 0) {
+			polls++;
+			usleep(1000);
+		}
+	}
+	cout << "first kernel created after " << polls << " polls" << endl;
+
+	bool passed = true;
+	for (int k=0; k<NUMKERNELS; k++) {
+		okra_kernel_t* kernel = NULL;
+		status = okra_pending_kernel_wait(pending[k], &kernel);
+		if (status != OKRA_SUCCESS || kernel == NULL) {
+			cout << "Error while creating kernel " << k << ":" << (int)status << endl;
+			passed = false;
+		} else {
+			okra_pending_kernel_poll(pending[k], &done);
+			if (done == 0) {cout << "kernel " << k << " not done after wait" << endl; passed = false;}
+			if (!runKernel(context, kernel)) {cout << "kernel " << k << " gave wrong results" << endl; passed = false;}
+			okra_dispose_kernel(kernel);
+		}
+		okra_dispose_pending_kernel(pending[k]);
+	}
+
+ 	cout << (passed ? "PASSED" : "FAILED") << endl;
+
+	okra_dispose_context(context);
+	return 0;
+}
@@ -0,0 +1,159 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "okra.h"
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include "utils.h"
+
+using namespace std;
+
+/*************************
+ * Kernels assembled ahead of time into bundles, then created from the
+ * mapped bundle with no assembly step.  One bundle is written with
+ * okra_write_bundle, the other by running okra-aot (on the PATH next to
+ * the okra library) on the same hsail file.  Kernels are looked up by
+ * name and by the hash of their hsail source.
+ *
+ ******************/
+
+
+static const int NUMELEMENTS = 40;
+float *inArray = new float[NUMELEMENTS];
+float *outArray = new float[NUMELEMENTS];
+
+static bool runKernel(okra_context_t *context, okra_kernel_t *kernel, int power) {
+	for (int i=0; i<NUMELEMENTS; i++) {
+		outArray[i] = 0;
+	}
+	okra_clear_args(kernel);
+	okra_push_pointer(kernel, outArray);
+	okra_push_pointer(kernel, inArray);
+
+	okra_range_t range;
+	range.dimension=1;
+	range.global_size[0] = NUMELEMENTS;
+	range.global_size[1] = range.global_size[2] = 1;
+	range.group_size[0] = NUMELEMENTS;
+	range.group_size[1] = range.group_size[2] = 1;
+
+	okra_status_t status = okra_execute_kernel(context, kernel, &range);
+	if (status != OKRA_SUCCESS) {cout << "Error while executing kernel:" << (int)status << endl; return false;}
+
+	bool passed = true;
+	for (int i=0; i<NUMELEMENTS; i++) {
+		float expected = (power == 2 ? (float)i*i : (float)i*i*i);
+		if (outArray[i] != expected) passed = false;
+	}
+	return passed;
+}
+
+// create &squares and &cubes from the bundle, one by name and one by source hash
+static bool checkBundle(okra_context_t *context, const char *path, const char *squaresName, const char *cubesName, uint64_t sourceHash) {
+	okra_bundle_t* bundle = NULL;
+	okra_status_t status = okra_open_bundle(context, path, &bundle);
+	if (status != OKRA_SUCCESS) {cout << "Error while opening " << path << ":" << (int)status << endl; return false;}
+
+	bool passed = true;
+	okra_kernel_t* squares = NULL;
+	status = okra_bundle_create_kernel(bundle, squaresName, "&squares", &squares);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating &squares from " << path << ":" << (int)status << endl; passed = false;}
+	else if (!runKernel(context, squares, 2)) {cout << "&squares from " << path << " gave wrong results" << endl; passed = false;}
+
+	okra_kernel_t* cubes = NULL;
+	status = okra_bundle_create_kernel(bundle, cubesName, "&cubes", &cubes);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating &cubes from " << path << ":" << (int)status << endl; passed = false;}
+	else if (!runKernel(context, cubes, 3)) {cout << "&cubes from " << path << " gave wrong results" << endl; passed = false;}
+
+	okra_kernel_t* cubesByHash = NULL;
+	status = okra_bundle_create_kernel_by_hash(bundle, sourceHash, "&cubes", &cubesByHash);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating &cubes by hash from " << path << ":" << (int)status << endl; passed = false;}
+	else if (!runKernel(context, cubesByHash, 3)) {cout << "&cubes by hash from " << path << " gave wrong results" << endl; passed = false;}
+
+	okra_kernel_t* missing = NULL;
+	if (okra_bundle_create_kernel(bundle, "nosuchkernel", NULL, &missing) == OKRA_SUCCESS) {
+		cout << "found a kernel that is not in " << path << endl;
+		passed = false;
+	}
+
+	okra_dispose_bundle(bundle);
+	cout << path << (passed ? " ok" : " failed") << endl;
+	return passed;
+}
+
+int main(int argc, char *argv[]) {
+	// initialize inArray
+	for (int i=0; i<NUMELEMENTS; i++) {
+		inArray[i] = (float)i;
+	}
+
+	string sourceFileName = "CBundle.hsail";
+	char* bundleSource = buildStringFromSourceFile(sourceFileName);
+	uint64_t sourceHash = okra_hash_hsail_source(bundleSource);
+
+	okra_status_t status;
+	okra_context_t* context = NULL;
+	status = okra_get_context(&context);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating context:" << (int)status << endl; exit(-1);}
+
+	// both kernels come from the same text, stored under their own names
+	const char *names[] = {"squares", "cubes"};
+	const char *sources[] = {bundleSource, bundleSource};
+	const char *entryNames[] = {"&squares", "&cubes"};
+	status = okra_write_bundle(context, "CBundle-api.okb", 2, names, sources, entryNames);
+	if (status != OKRA_SUCCESS) {cout << "Error while writing bundle:" << (int)status << endl; exit(-1);}
+	bool passed = checkBundle(context, "CBundle-api.okb", "squares", "cubes", sourceHash);
+
+	// okra-aot names both kernels after the file, they differ in entry
+	if (system("okra-aot -o CBundle-aot.okb CBundle.hsail:\\&squares CBundle.hsail:\\&cubes") != 0) {
+		cout << "okra-aot failed" << endl;
+		passed = false;
+	} else {
+		passed &= checkBundle(context, "CBundle-aot.okb", "CBundle", "CBundle", sourceHash);
+	}
+
+ 	cout << (passed ? "PASSED" : "FAILED") << endl;
+
+	okra_dispose_context(context);
+	return 0;
+}
@@ -0,0 +1,128 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "okra.h"
+#include <iostream>
+#include <string>
+#include "utils.h"
+
+using namespace std;
+
+/*************************
+ * One hsail text holding two kernels, &squares and &cubes, is assembled
+ * and loaded once as a module.  Each kernel is finalized the first time
+ * it is looked up, and looking it up again returns the same kernel.
+ *
+ ******************/
+
+
+static const int NUMELEMENTS = 40;
+float *inArray = new float[NUMELEMENTS];
+float *outArray = new float[NUMELEMENTS];
+
+static bool runKernel(okra_context_t *context, okra_kernel_t *kernel, int power) {
+	for (int i=0; i<NUMELEMENTS; i++) {
+		outArray[i] = 0;
+	}
+	okra_clear_args(kernel);
+	okra_push_pointer(kernel, outArray);
+	okra_push_pointer(kernel, inArray);
+
+	okra_range_t range;
+	range.dimension=1;
+	range.global_size[0] = NUMELEMENTS;
+	range.global_size[1] = range.global_size[2] = 1;
+	range.group_size[0] = NUMELEMENTS;
+	range.group_size[1] = range.group_size[2] = 1;
+
+	okra_status_t status = okra_execute_kernel(context, kernel, &range);
+	if (status != OKRA_SUCCESS) {cout << "Error while executing kernel:" << (int)status << endl; return false;}
+
+	bool passed = true;
+	for (int i=0; i<NUMELEMENTS; i++) {
+		float expected = (power == 2 ? (float)i*i : (float)i*i*i);
+		cout << i << "->" << outArray[i] << ",  ";
+		if (outArray[i] != expected) passed = false;
+	}
+	cout << endl;
+	return passed;
+}
+
+int main(int argc, char *argv[]) {
+	// initialize inArray
+	for (int i=0; i<NUMELEMENTS; i++) {
+		inArray[i] = (float)i;
+	}
+
+	string sourceFileName = "CModule.hsail";
+	char* moduleSource = buildStringFromSourceFile(sourceFileName);
+
+	okra_status_t status;
+	okra_context_t* context = NULL;
+	status = okra_get_context(&context);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating context:" << (int)status << endl; exit(-1);}
+
+	okra_module_t* module = NULL;
+	status = okra_create_module(context, moduleSource, &module);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating module:" << (int)status << endl; exit(-1);}
+
+	okra_kernel_t* squares = NULL;
+	okra_kernel_t* cubes = NULL;
+	okra_kernel_t* squaresAgain = NULL;
+	status = okra_module_get_kernel(module, "&squares", &squares);
+	if (status != OKRA_SUCCESS) {cout << "Error while getting &squares:" << (int)status << endl; exit(-1);}
+	status = okra_module_get_kernel(module, "&cubes", &cubes);
+	if (status != OKRA_SUCCESS) {cout << "Error while getting &cubes:" << (int)status << endl; exit(-1);}
+	status = okra_module_get_kernel(module, "&squares", &squaresAgain);
+	if (status != OKRA_SUCCESS) {cout << "Error while getting &squares again:" << (int)status << endl; exit(-1);}
+
+	bool passed = (squaresAgain == squares);
+	if (!passed) cout << "second lookup of &squares returned another kernel" << endl;
+	passed &= runKernel(context, squares, 2);
+	passed &= runKernel(context, cubes, 3);
+
+ 	cout << (passed ? "PASSED" : "FAILED") << endl;
+
+	okra_dispose_module(module);
+	okra_dispose_context(context);
+	return 0;
+}
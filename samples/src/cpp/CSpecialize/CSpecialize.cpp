@@ -0,0 +1,135 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "okra.h"
+#include <iostream>
+#include <string>
+#include "utils.h"
+
+using namespace std;
+
+/*************************
+ * The scale kernarg of
+ *
+ *       (gid) -> { outArray[gid] = inArray[gid] * scale; };
+ *
+ * is marked as a specialization constant, so each scale pushed gets a
+ * variant compiled with it substituted.  Going back to an earlier scale
+ * reuses its variant.
+ *
+ ******************/
+
+
+static const int NUMELEMENTS = 40;
+float *inArray = new float[NUMELEMENTS];
+float *outArray = new float[NUMELEMENTS];
+
+static bool runKernel(okra_context_t *context, okra_kernel_t *kernel, float scale) {
+	for (int i=0; i<NUMELEMENTS; i++) {
+		outArray[i] = 0;
+	}
+	okra_clear_args(kernel);
+	okra_push_pointer(kernel, outArray);
+	okra_push_pointer(kernel, inArray);
+	okra_push_float(kernel, scale);
+
+	okra_range_t range;
+	range.dimension=1;
+	range.global_size[0] = NUMELEMENTS;
+	range.global_size[1] = range.global_size[2] = 1;
+	range.group_size[0] = NUMELEMENTS;
+	range.group_size[1] = range.group_size[2] = 1;
+
+	okra_status_t status = okra_execute_kernel(context, kernel, &range);
+	if (status != OKRA_SUCCESS) {cout << "Error while executing kernel:" << (int)status << endl; return false;}
+
+	bool passed = true;
+	for (int i=0; i<NUMELEMENTS; i++) {
+		if (outArray[i] != inArray[i] * scale) passed = false;
+	}
+	cout << "scale " << scale << (passed ? " ok" : " gave wrong results") << endl;
+	return passed;
+}
+
+int main(int argc, char *argv[]) {
+	// initialize inArray
+	for (int i=0; i<NUMELEMENTS; i++) {
+		inArray[i] = (float)i;
+	}
+
+	string sourceFileName = "CSpecialize.hsail";
+	char* scaleSource = buildStringFromSourceFile(sourceFileName);
+
+	okra_status_t status;
+	okra_context_t* context = NULL;
+	status = okra_get_context(&context);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating context:" << (int)status << endl; exit(-1);}
+
+	okra_kernel_t* kernel = NULL;
+	status = okra_create_kernel(context, scaleSource, "&run", &kernel);
+	if (status != OKRA_SUCCESS) {cout << "Error while creating kernel:" << (int)status << endl; exit(-1);}
+
+	bool passed = true;
+	// the kernel has only three kernargs
+	if (okra_kernel_specialize_arg(kernel, 3) == OKRA_SUCCESS) {
+		cout << "specialized a kernarg that does not exist" << endl;
+		passed = false;
+	}
+	// nor is a pointer
+	if (okra_kernel_specialize_arg(kernel, 0) == OKRA_SUCCESS) {
+		cout << "specialized the out pointer" << endl;
+		passed = false;
+	}
+	status = okra_kernel_specialize_arg(kernel, 2);
+	if (status != OKRA_SUCCESS) {cout << "Error while specializing scale:" << (int)status << endl; exit(-1);}
+
+	float scales[] = {2.0f, 3.0f, 2.0f, 0.5f, 3.0f};
+	for (int j=0; j<sizeof(scales)/sizeof(scales[0]); j++) {
+		passed &= runKernel(context, kernel, scales[j]);
+	}
+
+ 	cout << (passed ? "PASSED" : "FAILED") << endl;
+
+	okra_dispose_kernel(kernel);
+	okra_dispose_context(context);
+	return 0;
+}
@@ -44,9 +44,15 @@
 #define JNI_JAVA(type, className, methodName) JNIEXPORT type JNICALL Java_com_amd_okra_##className##_##methodName
 #include "com_amd_okra_OkraContext.h"
 #include "com_amd_okra_OkraKernel.h"
+#include "com_amd_okra_OkraModule.h"
 #include "okraContext.h"
 #include "arrayBuffer.h"
 #include "objBuffer.h"
+#include "timeUtils.h"
+#include "okraTrace.h"
+#include "okraMetrics.h"
+#include "okraLog.h"
+#include "narrowOop.h"
 #include <vector>
 #include <algorithm>
 
@@ -55,8 +61,9 @@ using namespace std;
 
 static void * getPtrFromObjRef(jobject obj) {
 	// hack to make a pointer from the obj refererence
-	// this probably only works with compressed oops off, or with zero-based compressed oops
-	void **holderPtr = (void **) ((long) obj * 1);
+	// a jni handle points at a slot holding the full (never compressed) oop;
+	// newer jvms tag weak and global handles in the low bits, so strip those
+	void **holderPtr = (void **) ((uintptr_t) obj & ~(uintptr_t) 3);
 	void *ptr = *holderPtr;
 	return ptr;
 }
@@ -66,29 +73,85 @@ class OkraContextHolder {
 public:
 	OkraContext *realContext;
 	ArrayBuffer * dummyArrayBuf;
+	bool jvmCopiesArrays;     // whether GetPrimitiveArrayCritical hands us copies
+	size_t copyThreshold;     // arrays smaller than this many bytes are copied rather than pinned
+	NarrowOopEncoding oopEncoding;   // how references are stored in the heap
 
 	OkraContextHolder(OkraContext *_realContext, JNIEnv *_jenv, jarray _dummyArray) :
 		realContext(_realContext) {
         realContext->setVerbose(getenv("OKRA_VERBOSE") != NULL);
-		dummyArrayBuf = new ArrayBuffer(_dummyArray, sizeof(jint), -1, _jenv);
+		dummyArrayBuf = new ArrayBuffer(_dummyArray, sizeof(jint), 'I', OkraContext::Kernel::ARG_ACCESS_READ_ONLY, 0, -1, -1, _jenv);
+		// find out once whether this jvm pins or copies
+		jboolean isCopy = JNI_FALSE;
+		void *ptr = _jenv->GetPrimitiveArrayCritical(_dummyArray, &isCopy);
+		_jenv->ReleasePrimitiveArrayCritical(_dummyArray, ptr, JNI_ABORT);
+		jvmCopiesArrays = isCopy;
+		// OKRA_COPY_THRESHOLD=0 pins every array
+		char *threshEnv = getenv("OKRA_COPY_THRESHOLD");
+		copyThreshold = (threshEnv != NULL ? strtoul(threshEnv, NULL, 0) : DEFAULT_COPY_THRESHOLD);
+		if (!oopEncoding.discover(_jenv, getPtrFromObjRef)) {
+			OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_WARN, "could not determine the compressed oops encoding, assuming uncompressed");
+		}
+		if (oopEncoding.compressed) {
+			OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_DEBUG, "compressed oops on, base=" << hex << oopEncoding.base << dec << ", shift=" << oopEncoding.shift);
+		} else {
+			OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_DEBUG, "compressed oops off");
+		}
 	}
 
+	static const size_t DEFAULT_COPY_THRESHOLD = 16 * 1024;
+
 	bool isVerbose() {return realContext->isVerbose();}
 };
 
 
 class OkraKernelHolder {
 public:
+	// the first ARG_SLAB_CAPACITY array and object args use records that
+	// are kept across clearArgs, along with their weak refs; the slot is
+	// the position among args of the same kind
+	static const int ARG_SLAB_CAPACITY = 16;
+
 	vector<ArrayBuffer *> arrayBufs;
 	vector<ObjBuffer *> objBufs;
+	ArrayBuffer *arrayBufSlab[ARG_SLAB_CAPACITY];
+	ObjBuffer *objBufSlab[ARG_SLAB_CAPACITY];
 	int arg_count;
 	OkraContextHolder *okraContextHolder;
 	OkraContext::Kernel *realOkraKernel;
+	StagingArena stagingArena;
+	uint64_t criticalStart;          // when the gc critical region was entered, 0 if it was not
+	uint64_t lastCriticalNanos;      // how long the last dispatch held the gc critical region
+	uint64_t marshalNanos;           // this dispatch's staging copies and object addresses
+	uint64_t pinNanos;               // this dispatch's pinning and unpinning
 
 	OkraKernelHolder(OkraContext::Kernel *_realKernel, OkraContextHolder *_okraContextHolder, JNIEnv *_jenv) :
 		realOkraKernel(_realKernel),
 		okraContextHolder(_okraContextHolder),
-	    arg_count(0) {
+	    arg_count(0),
+		criticalStart(0),
+		lastCriticalNanos(0),
+		marshalNanos(0),
+		pinNanos(0) {
+		arrayBufs.reserve(ARG_SLAB_CAPACITY);
+		objBufs.reserve(ARG_SLAB_CAPACITY);
+		for (int i=0; i<ARG_SLAB_CAPACITY; i++) {
+			arrayBufSlab[i] = NULL;
+			objBufSlab[i] = NULL;
+		}
+	}
+
+	ArrayBuffer * newArrayBuffer(jarray ary, int elementSize, char elementType, int access, jint offset, jint length, JNIEnv *_jenv) {
+		int slot = arrayBufs.size();
+		if (slot >= ARG_SLAB_CAPACITY) {
+			return new ArrayBuffer(ary, elementSize, elementType, access, offset, length, arg_count, _jenv);
+		}
+		if (arrayBufSlab[slot] == NULL) {
+			arrayBufSlab[slot] = new ArrayBuffer(ary, elementSize, elementType, access, offset, length, arg_count, _jenv);
+		} else {
+			arrayBufSlab[slot]->rebind(ary, elementSize, elementType, access, offset, length, arg_count, _jenv);
+		}
+		return arrayBufSlab[slot];
 	}
 
 	void pushArrayBuffer(ArrayBuffer *arrayBuffer) {
@@ -96,7 +159,8 @@ public:
 	}
 
 	void clearArrayBuffers(JNIEnv* _jenv) {
-		for (int i=0; i<arrayBufs.size(); i++) {
+		// slab records stay alive for the next set of args
+		for (int i=ARG_SLAB_CAPACITY; i<arrayBufs.size(); i++) {
 			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
          arrayBuffer->dispose(_jenv);
 			delete arrayBuffer;
@@ -105,44 +169,114 @@ public:
 	}
 
 	void unpinArrays(JNIEnv *_jenv) {
-		// check if no real array arguments and if so, unpin our dummyArray 
-		if (arrayBufs.size() == 0) {
-		    okraContextHolder->dummyArrayBuf->unpinCommit(_jenv);
+		uint64_t unpinStart = okraNanoTime();
+		// the dummyArray is only pinned if nothing else was
+		okraContextHolder->dummyArrayBuf->unpinCommit(_jenv);
+		for (int i=0; i<arrayBufs.size(); i++) {
+			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
+			arrayBuffer->unpinCommit(_jenv);
 		}
-		else {
-			for (int i=0; i<arrayBufs.size(); i++) {
-				ArrayBuffer *arrayBuffer = arrayBufs.at(i);
-				arrayBuffer->unpinCommit(_jenv);
-			}
+		lastCriticalNanos = (criticalStart != 0 ? okraNanoTime() - criticalStart : 0);
+		criticalStart = 0;
+		OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_TRACE, "gc critical region held for " << lastCriticalNanos << " ns");
+		uint64_t commitStart = okraNanoTime();
+		pinNanos += commitStart - unpinStart;
+
+		// staged arrays can only be written back once nothing is held critical
+		for (int i=0; i<arrayBufs.size(); i++) {
+			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
+			arrayBuffer->commitStaged(_jenv);
+		}
+		uint64_t commitEnd = okraNanoTime();
+		marshalNanos += commitEnd - commitStart;
+		if (okraTraceOn()) {
+			okraTraceRecord("jni", "unpin", unpinStart, commitStart, NULL, "arrays", arrayBufs.size());
+			okraTraceRecord("jni", "commitStaged", commitStart, commitEnd, NULL, "arrays", arrayBufs.size());
 		}
 	}
 
 	void pinArrays(JNIEnv *_jenv) {
-		// if no real array arguments, use our dummyArray arg so we can pin something
-		if (arrayBufs.size() == 0) {
-			okraContextHolder->dummyArrayBuf->pin(_jenv);
+		bool jvmCopiesArrays = okraContextHolder->jvmCopiesArrays;
+		size_t copyThreshold = okraContextHolder->copyThreshold;
+		uint64_t stageStart = okraNanoTime();
+
+		// staging copies use jni region calls, so they have to happen before anything is pinned
+		size_t stagedBytes = 0;
+		for (int i=0; i<arrayBufs.size(); i++) {
+			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
+			if (arrayBuffer->canStage(jvmCopiesArrays, copyThreshold)) {
+				stagedBytes += StagingArena::roundUp(arrayBuffer->byteSize());
+			}
+		}
+		// if the arena can't grow the arrays are pinned like large ones
+		bool canStage = stagingArena.reserve(stagedBytes);
+		if (!canStage) {
+			OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_WARN, "cannot allocate " << stagedBytes << " bytes of staging, pinning instead");
+			stagedBytes = 0;
 		}
-		else {
-			for (int i=0; i<arrayBufs.size(); i++) {
-				ArrayBuffer *arrayBuffer = arrayBufs.at(i);
-				// FIXME, should be logic here to check for movement?
-				if (!arrayBuffer->isPinned) {
-					arrayBuffer->pin(_jenv);
-					// change the appropriate pointer argument in the arg stack
-					realOkraKernel->setPointerArg(arrayBuffer->arg_idx, arrayBuffer->addr);					
-				}
+		for (int i=0; i<arrayBufs.size() && canStage; i++) {
+			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
+			if (!arrayBuffer->isStaged && arrayBuffer->canStage(jvmCopiesArrays, copyThreshold)) {
+				arrayBuffer->stage(_jenv, stagingArena.alloc(arrayBuffer->byteSize()), jvmCopiesArrays);
+				realOkraKernel->setPointerArg(arrayBuffer->arg_idx, arrayBuffer->addr);
+			}
+		}
+
+		uint64_t pinStart = okraNanoTime();
+		marshalNanos = pinStart - stageStart;
+		criticalStart = 0;
+		size_t pinnedBytes = 0;
+		for (int i=0; i<arrayBufs.size(); i++) {
+			ArrayBuffer *arrayBuffer = arrayBufs.at(i);
+			// FIXME, should be logic here to check for movement?
+			if (!arrayBuffer->isPinned && !arrayBuffer->isStaged) {
+				if (criticalStart == 0) criticalStart = okraNanoTime();
+				arrayBuffer->pin(_jenv);
+				pinnedBytes += arrayBuffer->byteSize();
+				// change the appropriate pointer argument in the arg stack
+				realOkraKernel->setPointerArg(arrayBuffer->arg_idx, arrayBuffer->addr);					
 			}
 		}
+
+		// object args are raw heap addresses, so the gc must be held off while
+		// the kernel runs; if no array got pinned, use our dummyArray for that
+		if (criticalStart == 0 && objBufs.size() > 0) {
+			criticalStart = okraNanoTime();
+			okraContextHolder->dummyArrayBuf->pin(_jenv);
+		}
+		pinNanos = okraNanoTime() - pinStart;
+		if (okraMetricsOn()) {
+			okraMetricAdd(OKRA_METRIC_PINNED_BYTES, pinnedBytes);
+			okraMetricAdd(OKRA_METRIC_STAGED_BYTES, stagedBytes);
+		}
+		if (okraTraceOn()) {
+			okraTraceRecord("jni", "stage", stageStart, pinStart, NULL, "bytes", stagedBytes);
+			okraTraceRecord("jni", "pin", pinStart, pinStart + pinNanos, NULL, "arrays", arrayBufs.size());
+		}
 	}
 	bool isVerbose() {return okraContextHolder->isVerbose();}
 
 
+	ObjBuffer * newObjBuffer(jobject obj, JNIEnv *_jenv) {
+		int slot = objBufs.size();
+		if (slot >= ARG_SLAB_CAPACITY) {
+			return new ObjBuffer(obj, arg_count, _jenv);
+		}
+		if (objBufSlab[slot] == NULL) {
+			objBufSlab[slot] = new ObjBuffer(obj, arg_count, _jenv);
+		} else {
+			objBufSlab[slot]->rebind(obj, arg_count, _jenv);
+		}
+		return objBufSlab[slot];
+	}
+
 	void pushObjBuffer(ObjBuffer *objBuffer) {
 		objBufs.push_back(objBuffer);
 	}
 
 	void clearObjBuffers(JNIEnv* _jenv) {
-		for (int i=0; i<objBufs.size(); i++) {
+		// slab records stay alive for the next set of args
+		for (int i=ARG_SLAB_CAPACITY; i<objBufs.size(); i++) {
 			ObjBuffer *objBuffer = objBufs.at(i);
 			objBuffer->dispose(_jenv);
 			delete objBuffer;
@@ -167,6 +301,12 @@ OkraContextHolder * getOkraContextHolderPointer(JNIEnv *jenv, jobject fromObj) {
 	return (OkraContextHolder *) handle;
 }
 
+OkraContext::Module * getOkraModulePointer(JNIEnv *jenv, jobject fromObj) {
+	jclass fromClass = jenv->GetObjectClass(fromObj);
+	jlong handle = jenv->GetLongField(fromObj, jenv->GetFieldID(fromClass, "moduleHandle", "J"));
+	return (OkraContext::Module *) handle;
+}
+
 OkraKernelHolder * getOkraKernelHolderPointer(JNIEnv *jenv, jobject fromObj) {
 	jclass fromClass = jenv->GetObjectClass(fromObj);
 	jlong handle = jenv->GetLongField(fromObj, jenv->GetFieldID(fromClass, "kernelHandle", "J"));
@@ -174,12 +314,17 @@ OkraKernelHolder * getOkraKernelHolderPointer(JNIEnv *jenv, jobject fromObj) {
 	return (OkraKernelHolder *) handle;
 }
 
-jint pushArrayArgInternal(JNIEnv *jenv , jobject javaOkraKernel, jarray ary, jint elementSize) {
+jint pushArrayArgInternal(JNIEnv *jenv , jobject javaOkraKernel, jarray ary, jint elementSize, char elementType, jint offset, jint length, jint access) {
 	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
 
-	// create a new ArrayBuffer object to hold info of this array
+	// without an explicit qualifier use whatever the kernel source tells us
+	if (access == OkraContext::Kernel::ARG_ACCESS_DEFAULT) {
+		access = kernelHolder->realOkraKernel->getArgAccess(kernelHolder->arg_count);
+	}
+
+	// get an ArrayBuffer object to hold info of this array
 	// and keep it on an internal list so we can unpin it after execution
-	ArrayBuffer *arrayBuffer = new ArrayBuffer(ary, elementSize, kernelHolder->arg_count, jenv);
+	ArrayBuffer *arrayBuffer = kernelHolder->newArrayBuffer(ary, elementSize, elementType, access, offset, length, jenv);
 	kernelHolder->pushArrayBuffer(arrayBuffer);
 
 	// note: pinning and registering of memory will happen at exec time
@@ -209,18 +354,222 @@ JNI_JAVA(jlong, OkraContext, createKernelJNI)  (JNIEnv *jenv , jobject javaOkraC
 	// if we really can create a kernel, return a handle to an internal kernel holder wrapping the real okra kernel
 	// otherwise return a null handle
 	OkraContext::Kernel *realOkraKernel = NULL;
+	{
+		OkraTraceScope trace("jni", "createKernel", entryName_cstr);
         okra_status_t status = okraContextHolder->realContext->createKernel(source_cstr, entryName_cstr, &realOkraKernel);
+	}
+	jenv->ReleaseStringUTFChars(source, source_cstr);
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
 	if (realOkraKernel == NULL) 
 		return (jlong) 0;
 	else
 		return (jlong) new OkraKernelHolder(realOkraKernel, okraContextHolder, jenv);
 }
 
+// hsail already encoded as bytes skips the modified-utf8 conversion of a java
+// string.  The array is not pinned with GetPrimitiveArrayCritical since the
+// build spawns hsailasm, far too long to hold off the gc
+JNI_JAVA(jlong, OkraContext, createKernelFromBytesJNI)  (JNIEnv *jenv , jobject javaOkraContext, jbyteArray source, jint offset, jint length, jstring entryName) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	if (offset < 0 || length < 0 || offset + length > jenv->GetArrayLength(source))
+		return (jlong) 0;
+	jbyte *sourceBytes = jenv->GetByteArrayElements(source, NULL);
+	const char *entryName_cstr = jenv->GetStringUTFChars(entryName, NULL);
+	OkraContext::Kernel *realOkraKernel = NULL;
+	{
+		OkraTraceScope trace("jni", "createKernel", entryName_cstr, "bytes", length);
+		okraContextHolder->realContext->createKernel((const char *) sourceBytes + offset, length, entryName_cstr, NULL, &realOkraKernel);
+	}
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
+	jenv->ReleaseByteArrayElements(source, sourceBytes, JNI_ABORT);
+	if (realOkraKernel == NULL) 
+		return (jlong) 0;
+	else
+		return (jlong) new OkraKernelHolder(realOkraKernel, okraContextHolder, jenv);
+}
+
+// a direct buffer is handed to the build in place
+JNI_JAVA(jlong, OkraContext, createKernelFromBufferJNI)  (JNIEnv *jenv , jobject javaOkraContext, jobject source, jint position, jint length, jstring entryName) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	const char *sourceBytes = (const char *) jenv->GetDirectBufferAddress(source);
+	if (sourceBytes == NULL || position < 0 || length < 0 || position + length > jenv->GetDirectBufferCapacity(source))
+		return (jlong) 0;
+	const char *entryName_cstr = jenv->GetStringUTFChars(entryName, NULL);
+	OkraContext::Kernel *realOkraKernel = NULL;
+	{
+		OkraTraceScope trace("jni", "createKernel", entryName_cstr, "bytes", length);
+		okraContextHolder->realContext->createKernel(sourceBytes + position, length, entryName_cstr, NULL, &realOkraKernel);
+	}
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
+	if (realOkraKernel == NULL) 
+		return (jlong) 0;
+	else
+		return (jlong) new OkraKernelHolder(realOkraKernel, okraContextHolder, jenv);
+}
+
+JNI_JAVA(jlong, OkraContext, createKernelWithOptionsJNI)  (JNIEnv *jenv , jobject javaOkraContext, jstring source, jstring entryName,
+		jboolean debugInfo, jboolean inlineFunctions) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	okra_compile_options_t options;
+	options.debug_info = debugInfo;
+	options.inline_functions = inlineFunctions;
+
+	const char *source_cstr = jenv->GetStringUTFChars(source, NULL);
+	const char *entryName_cstr = jenv->GetStringUTFChars(entryName, NULL);
+	OkraContext::Kernel *realOkraKernel = NULL;
+	{
+		OkraTraceScope trace("jni", "createKernel", entryName_cstr);
+		okraContextHolder->realContext->createKernel(source_cstr, entryName_cstr, &options, &realOkraKernel);
+	}
+	jenv->ReleaseStringUTFChars(source, source_cstr);
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
+	if (realOkraKernel == NULL) 
+		return (jlong) 0;
+	else
+		return (jlong) new OkraKernelHolder(realOkraKernel, okraContextHolder, jenv);
+}
+
+// everything the compile thread needs to complete the java future
+struct AsyncKernelRequest {
+	JavaVM *jvm;
+	OkraContextHolder *okraContextHolder;
+	jobject javaOkraContext;       // global refs
+	jobject future;
+	jclass contextClass;
+	jmethodID completeMethod;
+};
+
+// runs on a compile thread, which stays attached to the jvm as a daemon
+static void asyncKernelDone(void *arg, okra_status_t status, OkraContext::Kernel *realOkraKernel) {
+	AsyncKernelRequest *request = (AsyncKernelRequest *) arg;
+	JNIEnv *jenv = NULL;
+	if (request->jvm->AttachCurrentThreadAsDaemon((void **) &jenv, NULL) != JNI_OK) {
+		OKRA_LOG(OKRA_LOG_JNI, OKRA_LOG_ERROR, "could not attach compile thread to the jvm");
+		return;
+	}
+	jlong handle = (realOkraKernel == NULL ? 0 : (jlong) new OkraKernelHolder(realOkraKernel, request->okraContextHolder, jenv));
+	jenv->CallStaticVoidMethod(request->contextClass, request->completeMethod, request->javaOkraContext, request->future, handle);
+	jenv->DeleteGlobalRef(request->javaOkraContext);
+	jenv->DeleteGlobalRef(request->future);
+	jenv->DeleteGlobalRef(request->contextClass);
+	delete request;
+}
+
+JNI_JAVA(jboolean, OkraContext, createKernelAsyncJNI)  (JNIEnv *jenv , jobject javaOkraContext, jstring source, jstring entryName, jobject future) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	AsyncKernelRequest *request = new AsyncKernelRequest();
+	jenv->GetJavaVM(&request->jvm);
+	request->okraContextHolder = okraContextHolder;
+	request->javaOkraContext = jenv->NewGlobalRef(javaOkraContext);
+	request->future = jenv->NewGlobalRef(future);
+	// look the callback up here, FindClass on the compile thread would use the wrong class loader
+	jclass contextClass = jenv->GetObjectClass(javaOkraContext);
+	request->contextClass = (jclass) jenv->NewGlobalRef(contextClass);
+	request->completeMethod = jenv->GetStaticMethodID(contextClass, "completeKernelFuture",
+		"(Lcom/amd/okra/OkraContext;Ljava/util/concurrent/CompletableFuture;J)V");
+
+	const char *source_cstr = jenv->GetStringUTFChars(source, NULL);
+	const char *entryName_cstr = jenv->GetStringUTFChars(entryName, NULL);
+	OkraContext::PendingKernel *pending = NULL;
+	okra_status_t status = okraContextHolder->realContext->createKernelAsync(source_cstr, entryName_cstr, &pending, asyncKernelDone, request);
+	jenv->ReleaseStringUTFChars(source, source_cstr);
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
+
+	if (status != OKRA_SUCCESS) {
+		jenv->DeleteGlobalRef(request->javaOkraContext);
+		jenv->DeleteGlobalRef(request->future);
+		jenv->DeleteGlobalRef(request->contextClass);
+		delete request;
+		return false;
+	}
+	// the future is completed by the callback, so the handle is not needed
+	pending->dispose();
+	return true;
+}
+
+JNI_JAVA(jlong, OkraContext, createModuleJNI)  (JNIEnv *jenv , jobject javaOkraContext, jstring source) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	const char *source_cstr = jenv->GetStringUTFChars(source, NULL);
+	OkraContext::Module *realOkraModule = NULL;
+	okraContextHolder->realContext->createModule(source_cstr, &realOkraModule);
+	jenv->ReleaseStringUTFChars(source, source_cstr);
+	return (jlong) realOkraModule;
+}
+
+JNI_JAVA(jlong, OkraContext, createModuleFromBinaryJNI)  (JNIEnv *jenv , jobject javaOkraContext, jbyteArray brig) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	jboolean isCopy;
+	jbyte *brigBytes = jenv->GetByteArrayElements(brig, &isCopy);
+	OkraContext::Module *realOkraModule = NULL;
+	okraContextHolder->realContext->createModuleFromBinary((const char *) brigBytes, jenv->GetArrayLength(brig), &realOkraModule);
+	jenv->ReleaseByteArrayElements(brig, brigBytes, JNI_ABORT);
+	return (jlong) realOkraModule;
+}
+
+JNI_JAVA(jlong, OkraModule, getKernelJNI)  (JNIEnv *jenv , jobject javaOkraModule, jstring entryName) {
+	OkraContext::Module *realOkraModule = getOkraModulePointer(jenv, javaOkraModule);
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraModule);
+	const char *entryName_cstr = jenv->GetStringUTFChars(entryName, NULL);
+	OkraContext::Kernel *realOkraKernel = NULL;
+	realOkraModule->getKernel(entryName_cstr, &realOkraKernel);
+	jenv->ReleaseStringUTFChars(entryName, entryName_cstr);
+	if (realOkraKernel == NULL) 
+		return (jlong) 0;
+	else
+		return (jlong) new OkraKernelHolder(realOkraKernel, okraContextHolder, jenv);
+}
+
+JNI_JAVA(jlongArray, OkraContext, createKernelsJNI)  (JNIEnv *jenv , jobject javaOkraContext, jobjectArray sources, jobjectArray entryNames, jlongArray stageNanos) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	int numKernels = jenv->GetArrayLength(sources);
+	OkraTraceScope trace("jni", "createKernels", NULL, "kernels", numKernels);
+	vector<jstring> sourceStrs(numKernels), entryStrs(numKernels);
+	vector<const char *> sourceCstrs(numKernels), entryCstrs(numKernels);
+	for (int i=0; i<numKernels; i++) {
+		sourceStrs[i] = (jstring) jenv->GetObjectArrayElement(sources, i);
+		entryStrs[i] = (jstring) jenv->GetObjectArrayElement(entryNames, i);
+		sourceCstrs[i] = jenv->GetStringUTFChars(sourceStrs[i], NULL);
+		entryCstrs[i] = jenv->GetStringUTFChars(entryStrs[i], NULL);
+	}
+
+	vector<OkraContext::Kernel *> realOkraKernels(numKernels);
+	okra_batch_times_t times;
+	okraContextHolder->realContext->createKernels(numKernels, sourceCstrs.data(), entryCstrs.data(), realOkraKernels.data(), &times);
+
+	// null handles for any kernel that failed, as with createKernelJNI
+	vector<jlong> handles(numKernels);
+	for (int i=0; i<numKernels; i++) {
+		handles[i] = (realOkraKernels[i] == NULL ? 0 : (jlong) new OkraKernelHolder(realOkraKernels[i], okraContextHolder, jenv));
+		jenv->ReleaseStringUTFChars(sourceStrs[i], sourceCstrs[i]);
+		jenv->ReleaseStringUTFChars(entryStrs[i], entryCstrs[i]);
+		jenv->DeleteLocalRef(sourceStrs[i]);
+		jenv->DeleteLocalRef(entryStrs[i]);
+	}
+	jlongArray result = jenv->NewLongArray(numKernels);
+	jenv->SetLongArrayRegion(result, 0, numKernels, handles.data());
+
+	if (stageNanos != NULL) {
+		jlong timeVals[] = {(jlong) times.fix_ns, (jlong) times.assemble_ns, (jlong) times.finalize_ns, (jlong) times.wall_ns};
+		jenv->SetLongArrayRegion(stageNanos, 0, std::min(4, (int) jenv->GetArrayLength(stageNanos)), timeVals);
+	}
+	return result;
+}
+
 JNI_JAVA(jint, OkraContext, dispose)  (JNIEnv *jenv , jobject javaOkraContext) {
 	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
 	return okraContextHolder->realContext->dispose();
 }
 
+JNI_JAVA(void, OkraContext, setNarrowOopEncoding)  (JNIEnv *jenv , jobject javaOkraContext, jboolean compressed, jlong base, jint shift) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	okraContextHolder->oopEncoding.set(compressed, base, shift);
+}
+
+JNI_JAVA(jboolean, OkraContext, isCompressedOops)  (JNIEnv *jenv , jobject javaOkraContext) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	return okraContextHolder->oopEncoding.compressed;
+}
+
 JNI_JAVA(void, OkraContext, setVerbose)  (JNIEnv *jenv , jobject javaOkraContext, jboolean isVerbose) {
 	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
 	okraContextHolder->realContext->setVerbose(isVerbose);
@@ -258,34 +607,35 @@ JNI_JAVA(void, OkraContext, useRefHandle)  (JNIEnv *jenv , jclass clazz, jlong h
 }
 
 // would have been nice if we could have used templates here...
-JNI_JAVA(jint, OkraKernel, pushFloatArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jfloatArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jfloat));
+JNI_JAVA(jint, OkraKernel, pushFloatArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jfloatArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jfloat), 'F', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushDoubleArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jdoubleArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jdouble));
+JNI_JAVA(jint, OkraKernel, pushDoubleArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jdoubleArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jdouble), 'D', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushBooleanArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jbooleanArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jboolean));
+JNI_JAVA(jint, OkraKernel, pushBooleanArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jbooleanArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jboolean), 'Z', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushByteArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jbyteArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jbyte));
+JNI_JAVA(jint, OkraKernel, pushByteArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jbyteArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jbyte), 'B', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushIntArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jintArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jint));
+JNI_JAVA(jint, OkraKernel, pushIntArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jintArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jint), 'I', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushLongArrayArg) (JNIEnv *jenv , jobject javaOkraKernel, jlongArray ary) {
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jlong));
+JNI_JAVA(jint, OkraKernel, pushLongArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jlongArray ary, jint offset, jint length, jint access) {
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, sizeof(jlong), 'J', offset, length, access);
 }
 
-JNI_JAVA(jint, OkraKernel, pushObjectArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jobjectArray ary) {
-	// while we don't know exactly the size of each reference, it won't be more than 8
-	// and it's ok to register memory that is bigger than necessary
-	return pushArrayArgInternal(jenv, javaOkraKernel, ary, 8);
+JNI_JAVA(jint, OkraKernel, pushObjectArrayArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jobjectArray ary, jint offset, jint length, jint access) {
+	// references are 4 bytes with compressed oops, 8 otherwise
+	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	int refSize = kernelHolder->okraContextHolder->oopEncoding.heapOopSize();
+	return pushArrayArgInternal(jenv, javaOkraKernel, ary, refSize, 'L', offset, length, access);
 }
 
 
@@ -326,15 +676,23 @@ JNI_JAVA(jint, OkraKernel, pushLongArg) (JNIEnv *jenv , jobject javaOkraKernel,
 	return kernelHolder->realOkraKernel->pushLongArg(arg);
 }
 
-JNI_JAVA(jint, OkraKernel, pushObjectArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jobject arg) {
+// object arrays reach the kernel as the jvm stores them, 4 byte narrow oops with
+// compressed oops on; this pushes the u64 base and u32 shift the kernel decodes them with
+JNI_JAVA(jint, OkraKernel, pushNarrowOopArgs) (JNIEnv *jenv , jobject javaOkraKernel) {
 	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	NarrowOopEncoding &oopEncoding = kernelHolder->okraContextHolder->oopEncoding;
+	kernelHolder->arg_count += 2;
+	okra_status_t status = kernelHolder->realOkraKernel->pushLongArg(oopEncoding.base);
+	if (status != OKRA_SUCCESS) return status;
+	return kernelHolder->realOkraKernel->pushIntArg(oopEncoding.shift);
+}
 
-	jweak ref = jenv->NewWeakGlobalRef(arg);
-	// cout << "pushObjectArg, weakref is " << ref << endl;
+JNI_JAVA(jint, OkraKernel, pushObjectArgJNI) (JNIEnv *jenv , jobject javaOkraKernel, jobject arg) {
+	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
 
-	// create a new ObjBuffer object to hold info of this object
+	// get an ObjBuffer object (which holds a weak ref) to hold info of this object
 	// and keep it on an internal list so we can get the real address at execution time
-	ObjBuffer *objBuffer = new ObjBuffer(ref, kernelHolder->arg_count, jenv);
+	ObjBuffer *objBuffer = kernelHolder->newObjBuffer(arg, jenv);
 	kernelHolder->pushObjBuffer(objBuffer);
 
 	// for now we push a dummy value
@@ -366,6 +724,7 @@ JNI_JAVA(jint, OkraKernel, setLaunchAttributes) (JNIEnv *jenv , jobject javaOkra
 
 JNI_JAVA(jint, OkraKernel, dispatchKernelWaitCompleteJNI) (JNIEnv *jenv , jobject javaOkraKernel) {
 	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	OkraTraceScope trace("jni", "dispatchKernelWaitComplete", NULL, "args", kernelHolder->arg_count);
 
 	//cout << "before dispatch: array args = " << kernelHolder->arrayBufs.size() 
     //	 << ", object args = " << kernelHolder->objBufs.size() << endl;
@@ -373,17 +732,65 @@ JNI_JAVA(jint, OkraKernel, dispatchKernelWaitCompleteJNI) (JNIEnv *jenv , jobjec
 	// pin any arrays that are being used as args
 	kernelHolder->pinArrays(jenv);
 	// and get final addresses of any objects
+	uint64_t objStart = okraNanoTime();
 	kernelHolder->saveObjAddresses();
+	kernelHolder->marshalNanos += okraNanoTime() - objStart;
 	// make okra call
 	jint status = kernelHolder->realOkraKernel->dispatchKernelWaitComplete(kernelHolder->okraContextHolder->realContext);
 	// unpin any pinned arrays we had
 	kernelHolder->unpinArrays(jenv);
+	kernelHolder->realOkraKernel->addDispatchHostTimes(kernelHolder->marshalNanos, kernelHolder->pinNanos);
 
 	//cout << "after dispatch:" << endl;
 
 	return status;
 }
 
+JNI_JAVA(jlong, OkraKernel, getCriticalRegionNanos) (JNIEnv *jenv , jobject javaOkraKernel) {
+	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	return kernelHolder->lastCriticalNanos;
+}
+
+JNI_JAVA(jint, OkraKernel, specializeArg) (JNIEnv *jenv , jobject javaOkraKernel, jint idx) {
+	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	return kernelHolder->realOkraKernel->specializeArg(idx);
+}
+
+// laid out as the OkraBuildStats constructor reads it, the counts are only
+// filled in for context totals
+static jlongArray buildStatsArray(JNIEnv *jenv, const okra_kernel_build_info_t &info, const okra_context_build_info_t *counts) {
+	jlong vals[15] = {
+		(jlong) info.convert_ns, (jlong) info.scan_ns, (jlong) info.cache_ns, (jlong) info.write_ns,
+		(jlong) info.assemble_ns, (jlong) info.read_ns, (jlong) info.create_program_ns,
+		(jlong) info.lock_wait_ns, (jlong) info.compile_kernel_ns, (jlong) info.total_ns, (jlong) info.cached,
+		0, 0, 0, 0
+	};
+	if (counts != NULL) {
+		vals[10] = 0;
+		vals[11] = counts->kernels;
+		vals[12] = counts->assembled;
+		vals[13] = counts->cache_hits;
+		vals[14] = counts->failures;
+	}
+	jlongArray result = jenv->NewLongArray(15);
+	jenv->SetLongArrayRegion(result, 0, 15, vals);
+	return result;
+}
+
+JNI_JAVA(jlongArray, OkraKernel, getBuildStatsJNI) (JNIEnv *jenv , jobject javaOkraKernel) {
+	OkraKernelHolder * kernelHolder = getOkraKernelHolderPointer(jenv, javaOkraKernel);
+	okra_kernel_build_info_t info;
+	kernelHolder->realOkraKernel->getBuildInfo(&info);
+	return buildStatsArray(jenv, info, NULL);
+}
+
+JNI_JAVA(jlongArray, OkraContext, getBuildStatsJNI) (JNIEnv *jenv , jobject javaOkraContext) {
+	OkraContextHolder * okraContextHolder = getOkraContextHolderPointer(jenv, javaOkraContext);
+	okra_context_build_info_t info;
+	okraContextHolder->realContext->getBuildInfo(&info);
+	return buildStatsArray(jenv, info.totals, &info);
+}
+
 JNI_JAVA(jboolean, OkraContext, isSimulator)  (JNIEnv *jenv , jclass clazz) {
 	return OkraContext::isSimulator();
 }
@@ -43,27 +43,51 @@
 #ifndef ARRAYBUFFER_H
 #define ARRAYBUFFER_H
 #include "common.h"
+#include "okraContext.h"
 
 class ArrayBuffer{
    public:
       jobject javaArray;        // The java array that this arg is mapped to 
-      jint length;              // the number of elements for arrays (used only when ARRAYLENGTH bit is set for this arg)
-      void *addr;               // the last address where we saw this java array object
+      jint length;              // the number of elements passed to the kernel (the whole array unless a slice was pushed)
+      jint offset;              // index of the first element passed to the kernel
+      void *addr;               // the last address where we saw this java array object (offset already applied)
+      void *pinnedBase;         // what GetPrimitiveArrayCritical returned, needed for the release
       int  arg_idx;             // its position in the arg stack
 	  int  elementSize;
+      char elementType;         // jni signature letter of the element type ('I', 'F', 'L', ...)
+      int  access;              // an OkraContext::Kernel::ArgAccess value, never ARG_ACCESS_DEFAULT
       jboolean isCopy;
       jboolean isPinned;
+      jboolean isStaged;        // addr points at a native copy in a StagingArena rather than a pinned array
+      jboolean isSlice;         // only part of the java array is passed
 
-	ArrayBuffer(jarray _ary, int _elementSize, int _idx, JNIEnv *_jenv):
-		javaArray(_jenv->NewWeakGlobalRef(_ary)), 
-		length(_jenv->GetArrayLength(_ary)),
-		elementSize(_elementSize),
-		addr(NULL),
-		arg_idx(_idx),
-		isCopy(false),
-		isPinned(false){
+	// a negative _length means the rest of the array from _offset
+	ArrayBuffer(jarray _ary, int _elementSize, char _elementType, int _access, jint _offset, jint _length, int _idx, JNIEnv *_jenv):
+		javaArray(NULL) {
+		rebind(_ary, _elementSize, _elementType, _access, _offset, _length, _idx, _jenv);
    }
 
+	// reuse this record for another arg; the weak ref is kept if it is the same java array
+	void rebind(jarray _ary, int _elementSize, char _elementType, int _access, jint _offset, jint _length, int _idx, JNIEnv *_jenv) {
+		if (javaArray == NULL || !_jenv->IsSameObject(javaArray, _ary)) {
+			if (javaArray) _jenv->DeleteWeakGlobalRef(javaArray);
+			javaArray = _jenv->NewWeakGlobalRef(_ary);
+		}
+		offset = _offset;
+		elementSize = _elementSize;
+		elementType = _elementType;
+		access = _access;
+		addr = NULL;
+		pinnedBase = NULL;
+		arg_idx = _idx;
+		isCopy = false;
+		isPinned = false;
+		isStaged = false;
+		jint arrayLength = _jenv->GetArrayLength(_ary);
+		length = (_length < 0 ? arrayLength - offset : _length);
+		isSlice = (offset != 0 || length != arrayLength);
+	}
+
 	void dispose(JNIEnv *_jenv) {
 		if (javaArray) {
          //cout << "deleted weak ref " << javaArray <<endl;
@@ -78,29 +102,138 @@ class ArrayBuffer{
 		}
 	}
 
+	bool isReadOnly() {return access == OkraContext::Kernel::ARG_ACCESS_READ_ONLY;}
+	bool isWriteOnly() {return access == OkraContext::Kernel::ARG_ACCESS_WRITE_ONLY;}
+
 	void unpinAbort(JNIEnv *jenv){
 		if (isPinned) {
          //cout << "unpinning abort " << addr << " " << javaArray << endl;
-			jenv->ReleasePrimitiveArrayCritical((jarray)javaArray, addr,JNI_ABORT);
+			jenv->ReleasePrimitiveArrayCritical((jarray)javaArray, pinnedBase, JNI_ABORT);
 			isPinned = JNI_FALSE;
 		}
 	}
 
+	// a read-only array never needs its contents copied back
 	void unpinCommit(JNIEnv *jenv){
 		if (isPinned) {
          //cout << "unpinning commit " << addr << " " <<javaArray << endl;
-			jenv->ReleasePrimitiveArrayCritical((jarray)javaArray, addr, 0);
+			jenv->ReleasePrimitiveArrayCritical((jarray)javaArray, pinnedBase, isReadOnly() ? JNI_ABORT : 0);
 			isPinned = JNI_FALSE;
 		}
 	}
 
 	void pin(JNIEnv *jenv){
-		void *ptr = addr;
-		addr = jenv->GetPrimitiveArrayCritical((jarray)javaArray,&isCopy);
+		pinnedBase = jenv->GetPrimitiveArrayCritical((jarray)javaArray,&isCopy);
+		addr = (jbyte *)pinnedBase + (size_t)offset * elementSize;
       //cout << "pinning " << addr << " " <<javaArray << endl;
 		isPinned = JNI_TRUE;
 	}
 
+	size_t byteSize() {return (size_t)length * elementSize;}
+
+	// decide whether to copy into a native buffer instead of pinning.
+	// Arrays smaller than copyThreshold bytes are always copied, which keeps
+	// them out of the gc critical region.  When the jvm would copy anyway,
+	// it is also cheaper to copy only what the kernel needs: nothing for a
+	// write-only array and just the slice for a sub-array.  Object arrays
+	// hold references the gc could move, so they are always pinned.
+	bool canStage(bool jvmCopiesArrays, size_t copyThreshold) {
+		if (elementType == 'L') return false;
+		return byteSize() < copyThreshold || (jvmCopiesArrays && (isWriteOnly() || isSlice));
+	}
+
+	// must not be called while any other array is held critical.
+	// A write-only array skips the copy in only where the jvm would have
+	// copied anyway; it gets zeroes rather than stale arena bytes, since
+	// whatever the kernel leaves unwritten is copied back to java.
+	void stage(JNIEnv *jenv, void *buf, bool jvmCopiesArrays) {
+		addr = buf;
+		if (isWriteOnly() && jvmCopiesArrays) {
+			memset(addr, 0, byteSize());
+		} else {
+			copyRegion(jenv, false);
+		}
+		isCopy = JNI_TRUE;
+		isStaged = JNI_TRUE;
+	}
+
+	// must not be called while any other array is held critical
+	void commitStaged(JNIEnv *jenv) {
+		if (!isStaged) return;
+		if (!isReadOnly()) {
+			copyRegion(jenv, true);
+		}
+		isStaged = JNI_FALSE;
+	}
+
+private:
+	// copy our slice between the java array and addr
+	void copyRegion(JNIEnv *jenv, bool toJava) {
+		switch (elementType) {
+			case 'Z':
+				if (toJava) jenv->SetBooleanArrayRegion((jbooleanArray)javaArray, offset, length, (jboolean *)addr);
+				else jenv->GetBooleanArrayRegion((jbooleanArray)javaArray, offset, length, (jboolean *)addr);
+				break;
+			case 'B':
+				if (toJava) jenv->SetByteArrayRegion((jbyteArray)javaArray, offset, length, (jbyte *)addr);
+				else jenv->GetByteArrayRegion((jbyteArray)javaArray, offset, length, (jbyte *)addr);
+				break;
+			case 'I':
+				if (toJava) jenv->SetIntArrayRegion((jintArray)javaArray, offset, length, (jint *)addr);
+				else jenv->GetIntArrayRegion((jintArray)javaArray, offset, length, (jint *)addr);
+				break;
+			case 'J':
+				if (toJava) jenv->SetLongArrayRegion((jlongArray)javaArray, offset, length, (jlong *)addr);
+				else jenv->GetLongArrayRegion((jlongArray)javaArray, offset, length, (jlong *)addr);
+				break;
+			case 'F':
+				if (toJava) jenv->SetFloatArrayRegion((jfloatArray)javaArray, offset, length, (jfloat *)addr);
+				else jenv->GetFloatArrayRegion((jfloatArray)javaArray, offset, length, (jfloat *)addr);
+				break;
+			case 'D':
+				if (toJava) jenv->SetDoubleArrayRegion((jdoubleArray)javaArray, offset, length, (jdouble *)addr);
+				else jenv->GetDoubleArrayRegion((jdoubleArray)javaArray, offset, length, (jdouble *)addr);
+				break;
+		}
+	}
+
+};
+
+// Bump allocator for staged array copies.  The buffer is reserved for the
+// total size up front so earlier allocations never move, and is reused
+// (only ever grown) from one dispatch to the next.
+class StagingArena{
+   public:
+      char *base;
+      size_t capacity;
+      size_t used;
+
+	StagingArena() : base(NULL), capacity(0), used(0) {
+	}
+
+	~StagingArena() {
+		free(base);
+	}
+
+	static size_t roundUp(size_t bytes) {return (bytes + 15) & ~(size_t)15;}
+
+	// discard previous allocations and make sure totalBytes (as summed with roundUp)
+	// fit, false if the buffer could not be grown and nothing can be allocated
+	bool reserve(size_t totalBytes) {
+		used = 0;
+		if (totalBytes > capacity) {
+			free(base);
+			base = (char *) malloc(totalBytes);
+			capacity = (base == NULL ? 0 : totalBytes);
+		}
+		return (totalBytes <= capacity);
+	}
+
+	void *alloc(size_t bytes) {
+		void *ptr = base + used;
+		used += roundUp(bytes);
+		return ptr;
+	}
 };
 
 #endif // ARRAYBUFFER_H
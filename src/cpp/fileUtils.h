@@ -45,6 +45,10 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 	char *readFile(std::string source_filename, size_t& size)
 	{
@@ -75,6 +79,52 @@
 		return ptr;
 	}
 	
+	// map a whole file instead of reading it, so nothing is copied and other
+	// processes mapping the same file share its pages through the page cache.
+	// The mapping is private and copy-on-write in case the consumer writes to it,
+	// and stays valid after the file is closed or removed.
+	char *mapFile(std::string filename, size_t& size)
+	{
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return NULL;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return NULL;
+		}
+		void *ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED) {
+			return NULL;
+		}
+		size = st.st_size;
+		return reinterpret_cast<char*>(ptr);
+	}
+
+	// "<path> <size> <mtime>" of the program the shell would run for name,
+	// empty if it is not on the PATH.  Enough to notice a rebuilt binary.
+	std::string programIdentity(const char *name)
+	{
+		const char *pathEnv = getenv("PATH");
+		std::string dirs = (pathEnv == NULL ? "" : pathEnv);
+		size_t start = 0;
+		while (start <= dirs.size()) {
+			size_t end = dirs.find(':', start);
+			if (end == std::string::npos) end = dirs.size();
+			std::string candidate = (end == start ? "." : dirs.substr(start, end - start)) + "/" + name;
+			struct stat st;
+			if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+				char stamp[64];
+				sprintf(stamp, " %lld %lld", (long long) st.st_size, (long long) st.st_mtime);
+				return candidate + stamp;
+			}
+			start = end + 1;
+		}
+		return "";
+	}
+
 	//later move this to the helper file
 	void writeToFile(const void *buf, size_t length, char* filename)
 	{
@@ -1,6 +1,7 @@
 #include <string>
 #include <string.h>
 #include <regex.h>
+#include <ctype.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -44,44 +45,107 @@ static int FindNextPattern(const char *text, const char* pattern, regmatch_t* ma
           printf("regcomp() failed, returning nonzero (%d)\n", rc);
           return rc;
     }
-    return regexec(&reg_pattern, text, number_matches, match, 0);
+    rc = regexec(&reg_pattern, text, number_matches, match, 0);
+    regfree(&reg_pattern);
+    return rc;
 }
 
+// the literal text any match of pattern has to start with, so patterns that
+// can't occur are skipped without a regex pass; empty if there is none
+static std::string RegexLiteralPrefix(const std::string &pattern) {
+    std::string literal;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char next = pattern[i + 1];
+            if (next == 'b' && literal.empty()) { i++; continue; }
+            if (next == '(' || next == ')' || next == '[' || next == ']' || next == '$' || next == '.') {
+                literal += next;
+                i++;
+                continue;
+            }
+            break;
+        }
+        if (strchr("()[]{}|.*+?^$", c) != NULL) {
+            // a quantifier applies to the last literal char, which is then optional
+            if ((c == '*' || c == '?' || c == '{') && !literal.empty()) literal.erase(literal.size() - 1);
+            break;
+        }
+        literal += c;
+    }
+    return literal;
+}
+
+// one pass over the text for each pattern that occurs, the regex is compiled
+// once and the text is rebuilt into a single new string
 static void IteratePatterns(std::string &text, std::string pattern, 
         std::string replace_string,
         Modifier pattern_modifier,
         int number_matches) {
-    
+    std::string literal = RegexLiteralPrefix(pattern);
+    if (!literal.empty() && text.find(literal) == std::string::npos) {
+        return;
+    }
+    regex_t reg_pattern;
+    int rc;
+    if (0 != (rc = regcomp(&reg_pattern, pattern.c_str(), REG_EXTENDED))) {
+        printf("regcomp() failed, returning nonzero (%d)\n", rc);
+        return;
+    }
+
     std::string modified_string;
-    char *input_string = new char[text.length() + 1];
-    memcpy(input_string, text.c_str(), text.length());
-    input_string[text.length()] = '\0';
-    uint input_length = strlen(input_string);
-    uint read_offset = 0;
-    
-    while (read_offset < input_length) {
+    char *input_string = const_cast<char *>(text.c_str());
+    bool matched = false;
+    while (*input_string) {
         //Change this to dynamic sizing
         regmatch_t match[5];
-        if (FindNextPattern(input_string, pattern.c_str(), match, number_matches) != 0) {
+        if (regexec(&reg_pattern, input_string, number_matches, match, 0) != 0 || match[0].rm_eo == 0) {
             //Found no more patterns
             break;
         }
+        if (!matched) {
+            modified_string.reserve(text.size() + text.size() / 8);
+            matched = true;
+        }
         //Append till the p
-        std::string pre_modifier (input_string, 
-                        0, 
-                        match[0].rm_so);
-        std::string modifier = pattern_modifier(input_string,
+        modified_string.append (input_string, match[0].rm_so);
+        modified_string.append (pattern_modifier(input_string,
                         replace_string, match, 
-                        number_matches);
-
-        modified_string.append (pre_modifier);
-        modified_string.append (modifier);
-        read_offset += match[0].rm_eo;
+                        number_matches));
         input_string += match[0].rm_eo;
     }
-    //Append the reset of the string
-    modified_string.append(input_string);
-    text = modified_string;
+    regfree(&reg_pattern);
+    if (matched) {
+        //Append the reset of the string
+        modified_string.append(input_string);
+        text.swap(modified_string);
+    }
+}
+
+// whether ConvertHsail would change the text, without copying it: anything
+// but a 0:95 version statement is converted
+static bool HsailNeedsConvert(const char *text, size_t length) {
+    const char *end = text + length;
+    for (const char *p = text; p + 7 <= end; p++) {
+        if (memcmp(p, "version", 7) != 0 || (p > text && (isalnum(p[-1]) || p[-1] == '_'))) continue;
+        const char *q = p + 7;
+        if (q >= end || !isspace(*q)) continue;
+        while (q < end && isspace(*q)) q++;
+        long major = 0, minor = 0;
+        const char *digits = q;
+        while (q < end && isdigit(*q)) major = major * 10 + (*q++ - '0');
+        if (q == digits) return false;
+        while (q < end && isspace(*q)) q++;
+        if (q >= end || *q != ':') return false;
+        q++;
+        while (q < end && isspace(*q)) q++;
+        digits = q;
+        while (q < end && isdigit(*q)) minor = minor * 10 + (*q++ - '0');
+        if (q == digits) return false;
+        return !(major == 0 && minor == 95);
+    }
+    // ConvertHsail leaves text without a version alone
+    return false;
 }
 
 static void ConvertHsail(std::string& hsail_text){
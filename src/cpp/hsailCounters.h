@@ -0,0 +1,324 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef HSAILCOUNTERS_H
+#define HSAILCOUNTERS_H
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "okra.h"
+#include "kernargAccess.h"
+#include "hsailInline.h"
+using namespace std;
+
+// Instrumentation of a kernel for dispatch counters.  The simulator engine
+// has no counters of its own, so the kernel is rewritten to count how often
+// each of its basic blocks runs: a kernarg holding the address of a u64 per
+// block is appended to the signature, and every block starts with
+//
+//   atomicnoret_add_global_u64 [$dN+8*block], 1;
+//
+// Since every instruction of a block runs as often as the block is entered,
+// instruction classes, memory bytes, atomics and barriers are the block
+// counts times what each block holds.  A cbr is followed by a block of its
+// own, counting only the fall through, so taken and not taken are exact too.
+
+struct HsailBlockCounts {
+	uint32_t byClass[OKRA_INST_CLASSES];
+	uint32_t globalLoadBytes;     // global and flat segment
+	uint32_t globalStoreBytes;
+	uint32_t groupLoadBytes;
+	uint32_t groupStoreBytes;
+	uint32_t atomics;
+	uint32_t barriers;
+	int fallThroughOf;            // the block ending in the cbr this block falls through from, or -1
+};
+
+// where an instruction came from, for profiles: its 1-based line in the
+// source and the block that counts it
+struct HsailInstructionLine {
+	int line;
+	int block;
+};
+
+// name of the kernarg holding the counter buffer
+#define HSAIL_COUNTERS_KERNARG "%__okra_counters"
+
+static int hsailTypeBytes(const string &opcode) {
+	size_t last = opcode.rfind('_');
+	if (last == string::npos) return 0;
+	int bits = atoi(opcode.c_str() + last + 2);
+	int lanes = 1;
+	size_t v = opcode.find("_v");
+	if (v != string::npos && v + 2 < opcode.size() && isdigit(opcode[v + 2])) lanes = opcode[v + 2] - '0';
+	return (bits / 8) * lanes;
+}
+
+static int classifyHsailOpcode(const string &opcode) {
+	if (opcode.compare(0, 3, "ld_") == 0 || opcode.compare(0, 3, "st_") == 0) return OKRA_INST_MEMORY;
+	if (opcode.compare(0, 6, "atomic") == 0) return OKRA_INST_ATOMIC;
+	if (opcode == "ret" || opcode.compare(0, 3, "brn") == 0 || opcode.compare(0, 3, "cbr") == 0
+			|| opcode.compare(0, 3, "sbr") == 0 || opcode.compare(0, 4, "call") == 0) {
+		return OKRA_INST_BRANCH;
+	}
+	if (opcode.compare(0, 7, "barrier") == 0 || opcode.compare(0, 4, "sync") == 0
+			|| opcode.compare(0, 4, "fbar") == 0 || opcode.compare(0, 9, "memfence") == 0) {
+		return OKRA_INST_SYNC;
+	}
+	if (opcode.compare(0, 4, "cvt_") == 0) return OKRA_INST_CONVERT;
+	if (opcode.compare(0, 4, "mov_") == 0 || opcode.compare(0, 8, "workitem") == 0 || opcode.compare(0, 9, "workgroup") == 0
+			|| opcode.compare(0, 4, "grid") == 0 || opcode.compare(0, 16, "currentworkgroup") == 0
+			|| opcode.compare(0, 3, "dim") == 0 || opcode.compare(0, 6, "laneid") == 0) {
+		return OKRA_INST_MOVE;
+	}
+	size_t last = opcode.rfind('_');
+	if (last != string::npos && last + 1 < opcode.size() && opcode[last + 1] == 'f' && isdigit(opcode[last + 2])) {
+		return OKRA_INST_FLOAT;
+	}
+	return (last == string::npos ? OKRA_INST_OTHER : OKRA_INST_INT);
+}
+
+// declarations in a kernel body are not instructions
+static bool isHsailDeclaration(const string &opcode) {
+	static const char *declPrefixes[] = {"arg_", "private_", "spill_", "group_", "global_", "readonly_", "align", "fbarrier", "kernarg_", NULL};
+	for (int p = 0; declPrefixes[p] != NULL; p++) {
+		if (opcode.compare(0, strlen(declPrefixes[p]), declPrefixes[p]) == 0) return true;
+	}
+	return false;
+}
+
+static void countHsailInstruction(const string &opcode, HsailBlockCounts &block) {
+	int cls = classifyHsailOpcode(opcode);
+	block.byClass[cls]++;
+	if (cls == OKRA_INST_MEMORY) {
+		string seg = hsailOpcodeSegment(opcode);
+		int bytes = hsailTypeBytes(opcode);
+		bool isLoad = (opcode[0] == 'l');
+		if (seg == "group") {
+			(isLoad ? block.groupLoadBytes : block.groupStoreBytes) += bytes;
+		} else if (!isNonGlobalSegment(seg)) {
+			(isLoad ? block.globalLoadBytes : block.globalStoreBytes) += bytes;
+		}
+	} else if (cls == OKRA_INST_ATOMIC) {
+		block.atomics++;
+	} else if (cls == OKRA_INST_SYNC && opcode.compare(0, 7, "barrier") == 0) {
+		block.barriers++;
+	}
+}
+
+static void newHsailBlock(vector<HsailBlockCounts> &blocks, const string &baseReg, string &out, int fallThroughOf = -1) {
+	HsailBlockCounts block;
+	memset(&block, 0, sizeof(block));
+	block.fallThroughOf = fallThroughOf;
+	char counter[96];
+	sprintf(counter, "\n\tatomicnoret_add_global_u64 [%s+%d], 1;", baseReg.c_str(), (int) blocks.size() * 8);
+	out += counter;
+	blocks.push_back(block);
+}
+
+// rewrite hsail (without its comments) so entryName counts its blocks, false
+// if the kernel can't be found or there is no register left for the buffer.
+// lines, if given, gets the source line and block of every instruction.
+static bool instrumentHsailKernel(string &hsail, const char *entryName, vector<HsailBlockCounts> &blocks,
+								  vector<HsailInstructionLine> *lines = NULL) {
+	string s = stripHsailComments(hsail.c_str());
+	size_t sigStart = findHsailKernel(s, entryName);
+	if (sigStart == string::npos) return false;
+	size_t sigEnd = s.find(')', sigStart);
+	size_t bodyStart = s.find('{', sigEnd);
+	if (sigEnd == string::npos || bodyStart == string::npos) return false;
+	size_t bodyEnd = bodyStart;
+	for (int depth = 0; bodyEnd < s.size(); bodyEnd++) {
+		if (s[bodyEnd] == '{') depth++;
+		if (s[bodyEnd] == '}' && --depth == 0) break;
+	}
+	if (bodyEnd >= s.size()) return false;
+
+	// the buffer address goes in a $d register the kernel doesn't use
+	vector<string> regs;
+	findHsailRegs(s.substr(bodyStart, bodyEnd - bodyStart), regs);
+	set<string> used(regs.begin(), regs.end());
+	string baseReg;
+	if (!allocHsailReg('d', used, baseReg)) return false;
+
+	blocks.clear();
+	string body = "\n\tld_kernarg_u64 " + baseReg + ", [" HSAIL_COUNTERS_KERNARG "];";
+	newHsailBlock(blocks, baseReg, body);
+	bool blockEnded = false;
+	int line = 1 + std::count(s.begin(), s.begin() + bodyStart + 1, '\n');
+	size_t stmtStart = bodyStart + 1;
+	for (size_t semi = s.find(';', stmtStart); semi != string::npos && semi < bodyEnd; stmtStart = semi + 1, semi = s.find(';', stmtStart)) {
+		string raw = s.substr(stmtStart, semi - stmtStart);
+		// skip arg block braces and labels to get to the instruction
+		size_t p = 0;
+		size_t afterLabel = string::npos;
+		while (p < raw.size()) {
+			if (isspace(raw[p]) || raw[p] == '{' || raw[p] == '}') {
+				p++;
+			} else if (raw[p] == '@') {
+				size_t colon = raw.find(':', p);
+				if (colon == string::npos) break;
+				p = afterLabel = colon + 1;
+			} else {
+				break;
+			}
+		}
+		string opcode = hsailOpcode(raw.substr(p));
+		bool isInstruction = !opcode.empty() && !isHsailDeclaration(opcode);
+		if (afterLabel != string::npos) {
+			body += raw.substr(0, afterLabel);
+			newHsailBlock(blocks, baseReg, body);
+			body += raw.substr(afterLabel) + ";";
+		} else {
+			if (blockEnded && isInstruction) {
+				newHsailBlock(blocks, baseReg, body);
+			}
+			body += raw + ";";
+		}
+		if (isInstruction) {
+			blockEnded = false;
+			countHsailInstruction(opcode, blocks.back());
+			if (lines != NULL) {
+				HsailInstructionLine where;
+				where.line = line + std::count(raw.begin(), raw.begin() + p, '\n');
+				where.block = blocks.size() - 1;
+				lines->push_back(where);
+			}
+			if (opcode.compare(0, 3, "cbr") == 0) {
+				newHsailBlock(blocks, baseReg, body, blocks.size() - 1);
+			} else if (opcode == "ret" || opcode.compare(0, 3, "brn") == 0 || opcode.compare(0, 3, "sbr") == 0) {
+				blockEnded = true;
+			}
+		}
+		line += std::count(raw.begin(), raw.end(), '\n');
+	}
+	body += s.substr(stmtStart, bodyEnd - stmtStart);
+
+	string sig = trimHsail(s.substr(sigStart + 1, sigEnd - sigStart - 1));
+	string newSig = sig + (sig.empty() ? "" : ",\n   ") + "align 8 kernarg_u64 " HSAIL_COUNTERS_KERNARG;
+	hsail = s.substr(0, sigStart + 1) + newSig + s.substr(sigEnd, bodyStart + 1 - sigEnd) + body + s.substr(bodyEnd);
+	return true;
+}
+
+// turn the block counts of one dispatch into counters
+static void hsailBlockCounters(const vector<HsailBlockCounts> &blocks, const uint64_t *execs, okra_dispatch_counters_t *counters) {
+	memset(counters, 0, sizeof(*counters));
+	for (int b = 0; b < blocks.size(); b++) {
+		const HsailBlockCounts &block = blocks[b];
+		for (int c = 0; c < OKRA_INST_CLASSES; c++) {
+			counters->by_class[c] += execs[b] * block.byClass[c];
+			counters->instructions += execs[b] * block.byClass[c];
+		}
+		counters->global_load_bytes += execs[b] * block.globalLoadBytes;
+		counters->global_store_bytes += execs[b] * block.globalStoreBytes;
+		counters->group_load_bytes += execs[b] * block.groupLoadBytes;
+		counters->group_store_bytes += execs[b] * block.groupStoreBytes;
+		counters->atomics += execs[b] * block.atomics;
+		counters->barriers += execs[b] * block.barriers;
+		if (block.fallThroughOf >= 0) {
+			uint64_t executed = execs[block.fallThroughOf];
+			uint64_t notTaken = execs[b];
+			counters->branch_sites++;
+			counters->branches += executed;
+			counters->branches_taken += executed - notTaken;
+			if (notTaken != 0 && notTaken != executed) counters->divergent_branches++;
+		}
+	}
+}
+
+static bool hotterHsailLine(const pair<uint64_t, int> &a, const pair<uint64_t, int> &b) {
+	return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// Annotated listing of source: the hottest lines first, then every line with
+// its executions.  execs are block counts summed over the profiled
+// dispatches.  The engine can't time instructions, so each line is given the
+// share of executeNanos that it has of the instructions executed.
+static void writeHsailProfile(FILE *file, const string &source, const char *entryName,
+							  const vector<HsailInstructionLine> &lines, const vector<uint64_t> &execs,
+							  uint64_t dispatches, uint64_t executeNanos, int hottest = 20) {
+	vector<string> sourceLines;
+	size_t start = 0;
+	for (size_t nl = source.find('\n'); ; start = nl + 1, nl = source.find('\n', start)) {
+		string text = source.substr(start, nl == string::npos ? string::npos : nl - start);
+		if (!text.empty() && text[text.size() - 1] == '\r') text.erase(text.size() - 1);
+		sourceLines.push_back(text);
+		if (nl == string::npos) break;
+	}
+
+	vector<uint64_t> lineExecs(sourceLines.size() + 1, 0);
+	uint64_t total = 0;
+	for (int i = 0; i < lines.size(); i++) {
+		if (lines[i].line < lineExecs.size() && lines[i].block < execs.size()) {
+			lineExecs[lines[i].line] += execs[lines[i].block];
+			total += execs[lines[i].block];
+		}
+	}
+
+	fprintf(file, "okra profile of %s: %llu dispatches, %llu instructions, %.3f ms\n\n", entryName,
+			(unsigned long long) dispatches, (unsigned long long) total, executeNanos / 1e6);
+	vector<pair<uint64_t, int> > hot;
+	for (int line = 1; line < lineExecs.size(); line++) {
+		if (lineExecs[line] != 0) hot.push_back(make_pair(lineExecs[line], line));
+	}
+	std::sort(hot.begin(), hot.end(), hotterHsailLine);
+	fprintf(file, "hottest lines\n%8s %14s %12s %6s  %s\n", "share", "executions", "est us", "line", "source");
+	for (int i = 0; i < hot.size() && i < hottest; i++) {
+		double share = (double) hot[i].first / total;
+		fprintf(file, "%7.2f%% %14llu %12.1f %6d  %s\n", share * 100, (unsigned long long) hot[i].first,
+				share * executeNanos / 1000.0, hot[i].second, trimHsail(sourceLines[hot[i].second - 1]).c_str());
+	}
+
+	fprintf(file, "\nlisting\n");
+	for (int line = 1; line <= sourceLines.size(); line++) {
+		if (lineExecs[line] != 0) {
+			fprintf(file, "%14llu %6d | %s\n", (unsigned long long) lineExecs[line], line, sourceLines[line - 1].c_str());
+		} else {
+			fprintf(file, "%14s %6d | %s\n", "", line, sourceLines[line - 1].c_str());
+		}
+	}
+}
+
+#endif // HSAILCOUNTERS_H
@@ -0,0 +1,342 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef HSAILINLINE_H
+#define HSAILINLINE_H
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "kernargAccess.h"
+using namespace std;
+
+// Pre-assembly pass that inlines small HSAIL functions at their call sites.
+// Only straight-line leaf functions are taken: no branches, labels, calls,
+// variable declarations or private/spill accesses, a single ret at the end,
+// and results stored to their output args only just before that ret.
+// At each call the arg block is replaced by the callee body with its
+// registers renamed to ones the caller never uses, ld_arg of an input
+// becoming a mov from the register the caller stored, and st_arg of an
+// output a mov into the register the caller loads it into.  Calls passing
+// immediates, or that would exceed the register budget, are left alone.
+
+// one function definition, statements are trimmed and without their ';'
+struct HsailFunction {
+	vector<string> outs;      // formal names, e.g. %_result
+	vector<string> ins;
+	vector<string> body;
+	bool inlinable;
+};
+
+static string hsailOpcode(const string &stmt) {
+	size_t sp = 0;
+	while (sp < stmt.size() && !isspace(stmt[sp])) sp++;
+	return stmt.substr(0, sp);
+}
+
+static void splitHsailStatements(const string &body, vector<string> &stmts) {
+	size_t start = 0;
+	for (size_t semi = body.find(';'); semi != string::npos; start = semi + 1, semi = body.find(';', start)) {
+		string stmt = trimHsail(body.substr(start, semi - start));
+		if (!stmt.empty()) stmts.push_back(stmt);
+	}
+	if (!trimHsail(body.substr(start)).empty()) stmts.push_back(trimHsail(body.substr(start)));
+}
+
+// names of the formals in "arg_f64 %a, arg_u64 %b"; false for array args
+static bool parseHsailFormals(const string &list, vector<string> &names) {
+	vector<string> params;
+	splitHsailOperands(list, params);
+	for (int i = 0; i < params.size(); i++) {
+		size_t pct = params[i].find('%');
+		if (pct == string::npos || params[i].find('[') != string::npos) return false;
+		names.push_back(trimHsail(params[i].substr(pct)));
+	}
+	return true;
+}
+
+// the name in an arg address, "[%_val]" gives "%_val"
+static string hsailArgName(const string &operand) {
+	string op = trimHsail(operand);
+	if (op.size() < 3 || op[0] != '[' || op[op.size()-1] != ']') return "";
+	string name = trimHsail(op.substr(1, op.size() - 2));
+	return (name.size() > 1 && name[0] == '%' ? name : "");
+}
+
+static string hsailMovForReg(const string &reg) {
+	switch (reg[1]) {
+	case 'c': return "mov_b1";
+	case 's': return "mov_b32";
+	case 'd': return "mov_b64";
+	default: return "mov_b128";
+	}
+}
+
+static string renameHsailRegs(const string &stmt, const map<string, string> &regMap) {
+	string out;
+	for (size_t i = 0; i < stmt.size(); i++) {
+		if (stmt[i] == '$' && i + 1 < stmt.size() && isalpha(stmt[i+1])) {
+			size_t j = i + 2;
+			while (j < stmt.size() && isdigit(stmt[j])) j++;
+			map<string, string>::const_iterator it = regMap.find(stmt.substr(i, j - i));
+			out += (it == regMap.end() ? stmt.substr(i, j - i) : it->second);
+			i = j - 1;
+		} else {
+			out += stmt[i];
+		}
+	}
+	return out;
+}
+
+// the whole register file is $c0-7 and 128 words shared by $s (1), $d (2) and $q (4)
+static bool allocHsailReg(char cls, set<string> &used, string &reg) {
+	int limit = (cls == 'c' ? 8 : cls == 's' ? 128 : cls == 'd' ? 64 : 32);
+	for (int n = 0; n < limit; n++) {
+		char name[16];
+		sprintf(name, "$%c%d", cls, n);
+		if (used.count(name) == 0) {
+			used.insert(name);
+			reg = name;
+			break;
+		}
+	}
+	if (reg.empty()) return false;
+	int words = 0;
+	for (set<string>::iterator it = used.begin(); it != used.end(); ++it) {
+		char c = (*it)[1];
+		words += (c == 's' ? 1 : c == 'd' ? 2 : c == 'q' ? 4 : 0);
+	}
+	return words <= 128;
+}
+
+static bool isHsailInlinable(const HsailFunction &fn, int threshold) {
+	if (fn.body.empty() || fn.body.back() != "ret" || (int) fn.body.size() - 1 > threshold) return false;
+	static const char *declPrefixes[] = {"arg_", "private_", "spill_", "group_", "global_", "readonly_", "align", "fbarrier", "kernarg_", NULL};
+	bool storingResults = false;
+	for (int n = 0; n + 1 < fn.body.size(); n++) {
+		const string &stmt = fn.body[n];
+		if (stmt.find('@') != string::npos || stmt.find('{') != string::npos) return false;
+		string opcode = hsailOpcode(stmt);
+		if (opcode == "ret" || opcode.compare(0, 2, "br") == 0 || opcode.compare(0, 3, "cbr") == 0
+				|| opcode.compare(0, 3, "sbr") == 0 || opcode.find("call") != string::npos) {
+			return false;
+		}
+		for (int p = 0; declPrefixes[p] != NULL; p++) {
+			if (opcode.compare(0, strlen(declPrefixes[p]), declPrefixes[p]) == 0) return false;
+		}
+		string seg = hsailOpcodeSegment(opcode);
+		bool isArgAccess = (opcode.compare(0, 3, "ld_") == 0 || opcode.compare(0, 3, "st_") == 0) && seg == "arg";
+		if (seg == "private" || seg == "spill" || seg == "kernarg") return false;
+		if (storingResults && !(isArgAccess && opcode[0] == 's')) return false;
+		if (!isArgAccess) continue;
+
+		vector<string> ops;
+		splitHsailOperands(stmt.substr(opcode.size()), ops);
+		if (ops.size() != 2 || !isHsailRegister(ops[0])) return false;
+		string name = hsailArgName(ops[1]);
+		const vector<string> &formals = (opcode[0] == 'l' ? fn.ins : fn.outs);
+		if (std::find(formals.begin(), formals.end(), name) == formals.end()) return false;
+		if (opcode[0] == 's') storingResults = true;
+	}
+	return true;
+}
+
+// replace one arg block with the inlined callee, false to leave it as a call
+static bool inlineHsailCall(const string &block, const map<string, HsailFunction> &functions,
+							set<string> &used, map<string, map<string, string> > &regMaps, string &out) {
+	vector<string> stmts;
+	splitHsailStatements(block, stmts);
+	map<string, string> inputRegs;    // caller arg name -> register stored into it
+	map<string, string> outputRegs;   // caller arg name -> register loaded from it
+	string callee;
+	vector<string> actualOuts, actualIns;
+	for (int n = 0; n < stmts.size(); n++) {
+		const string &stmt = stmts[n];
+		string opcode = hsailOpcode(stmt);
+		if (opcode.compare(0, 4, "arg_") == 0) {
+			if (stmt.find('[') != string::npos) return false;
+			continue;
+		}
+		if (opcode == "call") {
+			if (!callee.empty()) return false;
+			string rest = trimHsail(stmt.substr(4));
+			size_t nameEnd = rest.find_first_of(" \t\n(");
+			if (rest.empty() || rest[0] != '&' || nameEnd == string::npos) return false;
+			callee = rest.substr(0, nameEnd);
+			size_t o1 = rest.find('(', nameEnd), c1 = rest.find(')', o1);
+			if (o1 == string::npos || c1 == string::npos) return false;
+			size_t o2 = rest.find('(', c1), c2 = rest.find(')', o2);
+			if (o2 == string::npos || c2 == string::npos || !trimHsail(rest.substr(c2 + 1)).empty()) return false;
+			if (!trimHsail(rest.substr(c1 + 1, o2 - c1 - 1)).empty()) return false;
+			splitHsailOperands(rest.substr(o1 + 1, c1 - o1 - 1), actualOuts);
+			splitHsailOperands(rest.substr(o2 + 1, c2 - o2 - 1), actualIns);
+			continue;
+		}
+		vector<string> ops;
+		splitHsailOperands(stmt.substr(opcode.size()), ops);
+		bool isSt = opcode.compare(0, 7, "st_arg_") == 0, isLd = opcode.compare(0, 7, "ld_arg_") == 0;
+		if (!(isSt && callee.empty()) && !(isLd && !callee.empty())) return false;
+		if (ops.size() != 2 || !isHsailRegister(ops[0]) || hsailArgName(ops[1]).empty()) return false;
+		(isSt ? inputRegs : outputRegs)[hsailArgName(ops[1])] = ops[0];
+	}
+
+	map<string, HsailFunction>::const_iterator fit = functions.find(callee);
+	if (fit == functions.end() || !fit->second.inlinable) return false;
+	const HsailFunction &fn = fit->second;
+	if (fn.ins.size() != actualIns.size() || fn.outs.size() != actualOuts.size()) return false;
+	map<string, string> formalIn, formalOut;
+	for (int i = 0; i < fn.ins.size(); i++) {
+		if (inputRegs.count(actualIns[i]) == 0) return false;
+		formalIn[fn.ins[i]] = inputRegs[actualIns[i]];
+	}
+	for (int i = 0; i < fn.outs.size(); i++) {
+		if (outputRegs.count(actualOuts[i]) != 0) formalOut[fn.outs[i]] = outputRegs[actualOuts[i]];
+	}
+
+	// fresh registers for the callee, shared by every call of it from this body
+	map<string, string> &regMap = regMaps[callee];
+	for (int n = 0; n < fn.body.size(); n++) {
+		vector<string> regs;
+		findHsailRegs(fn.body[n], regs);
+		for (int r = 0; r < regs.size(); r++) {
+			if (regMap.count(regs[r]) != 0) continue;
+			string fresh;
+			if (!allocHsailReg(regs[r][1], used, fresh)) return false;
+			regMap[regs[r]] = fresh;
+		}
+	}
+
+	out = "\n";
+	for (int n = 0; n + 1 < fn.body.size(); n++) {
+		const string &stmt = fn.body[n];
+		string opcode = hsailOpcode(stmt);
+		string seg = hsailOpcodeSegment(opcode);
+		if ((opcode.compare(0, 3, "ld_") == 0 || opcode.compare(0, 3, "st_") == 0) && seg == "arg") {
+			vector<string> ops;
+			splitHsailOperands(stmt.substr(opcode.size()), ops);
+			string reg = renameHsailRegs(ops[0], regMap);
+			string name = hsailArgName(ops[1]);
+			if (opcode[0] == 'l') {
+				out += "\t" + hsailMovForReg(reg) + " " + reg + ", " + formalIn[name] + ";\n";
+			} else if (formalOut.count(name) != 0) {
+				out += "\t" + hsailMovForReg(reg) + " " + formalOut[name] + ", " + reg + ";\n";
+			}
+		} else {
+			out += "\t" + renameHsailRegs(stmt, regMap) + ";\n";
+		}
+	}
+	return true;
+}
+
+// returns the number of calls inlined, hsail is only rewritten (without its comments) if that is nonzero
+static int inlineHsailFunctions(string &hsail, int threshold) {
+	string s = stripHsailComments(hsail.c_str());
+
+	// collect the function definitions
+	map<string, HsailFunction> functions;
+	for (size_t pos = s.find("function"); pos != string::npos; pos = s.find("function", pos + 1)) {
+		if (pos > 0 && (isalnum(s[pos-1]) || s[pos-1] == '_')) continue;
+		size_t p = pos + 8;
+		if (p >= s.size() || !isspace(s[p])) continue;
+		while (p < s.size() && isspace(s[p])) p++;
+		size_t nameEnd = s.find_first_of(" \t\r\n(", p);
+		if (s[p] != '&' || nameEnd == string::npos) continue;
+		string name = s.substr(p, nameEnd - p);
+		size_t o1 = s.find('(', nameEnd), c1 = s.find(')', o1);
+		size_t o2 = s.find('(', c1), c2 = s.find(')', o2);
+		if (o1 == string::npos || c1 == string::npos || o2 == string::npos || c2 == string::npos) continue;
+		size_t brace = s.find_first_not_of(" \t\r\n", c2 + 1);
+		if (brace == string::npos || s[brace] != '{') continue;   // a declaration
+		size_t end = s.find('}', brace);
+		if (end == string::npos) continue;
+		HsailFunction fn;
+		fn.inlinable = parseHsailFormals(s.substr(o1 + 1, c1 - o1 - 1), fn.outs)
+			&& parseHsailFormals(s.substr(o2 + 1, c2 - o2 - 1), fn.ins);
+		// a nested brace is an arg block, so the function makes calls
+		string body = s.substr(brace + 1, end - brace - 1);
+		if (body.find('{') != string::npos) fn.inlinable = false;
+		splitHsailStatements(body, fn.body);
+		fn.inlinable = fn.inlinable && isHsailInlinable(fn, threshold);
+		functions[name] = fn;
+	}
+	if (functions.empty()) return 0;
+
+	// walk the top level bodies and replace their arg blocks
+	int inlined = 0;
+	string result;
+	size_t copied = 0;
+	for (size_t open = s.find('{'); open != string::npos; open = s.find('{', open + 1)) {
+		size_t close = open;
+		for (int depth = 0; close < s.size(); close++) {
+			if (s[close] == '{') depth++;
+			if (s[close] == '}' && --depth == 0) break;
+		}
+		if (close >= s.size()) break;
+		string body = s.substr(open, close - open);
+		set<string> used;
+		vector<string> regs;
+		findHsailRegs(body, regs);
+		used.insert(regs.begin(), regs.end());
+		map<string, map<string, string> > regMaps;
+		for (size_t blockOpen = s.find('{', open + 1); blockOpen != string::npos && blockOpen < close;
+			 blockOpen = s.find('{', blockOpen + 1)) {
+			size_t blockClose = s.find('}', blockOpen);
+			string replacement;
+			if (inlineHsailCall(s.substr(blockOpen + 1, blockClose - blockOpen - 1), functions, used, regMaps, replacement)) {
+				result += s.substr(copied, blockOpen - copied) + replacement;
+				copied = blockClose + 1;
+				inlined++;
+			}
+		}
+		open = close;
+	}
+	if (inlined > 0) {
+		result += s.substr(copied);
+		hsail.swap(result);
+	}
+	return inlined;
+}
+
+#endif // HSAILINLINE_H
@@ -0,0 +1,486 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef HSAILMEMTRACE_H
+#define HSAILMEMTRACE_H
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "hsailCounters.h"
+using namespace std;
+
+// Memory access tracing of a kernel.  Like the counters, this rewrites the
+// kernel: a kernarg holding the address of a trace buffer is appended to the
+// signature, and every global (or flat) ld, st and atomic whose address is
+// a $d register plus an offset is preceded by a store of the register, the
+// offset and the access's index.  Only the work-items of the sampled
+// work-groups store anything, each into a buffer of its own that keeps its
+// first recordsPerItem accesses.
+//
+// The buffer starts with the first traced work-item and their count (u32
+// each, filled in by the host before each dispatch so any launch shape can
+// be sampled), padded to 16 bytes.  Each traced work-item then has a 16
+// byte header with the bytes of records written and recordsPerItem records.
+//
+// From the addresses the report works out, per access, how the lanes of a
+// wavefront would coalesce and the strides between neighbouring lanes, the
+// reuse distance of cache lines within each work-group, and the bytes each
+// pointer kernarg's data is accessed and touched with.  Lanes are taken to
+// run in lockstep, a wavefront's nth access being made by all its lanes
+// together.
+
+// name of the kernarg holding the trace buffer
+#define HSAIL_MEMTRACE_KERNARG "%__okra_memtrace"
+
+#define HSAIL_MEMTRACE_WAVEFRONT 64      // lanes coalesced together
+#define HSAIL_MEMTRACE_SEGMENT 64        // bytes of a coalesced transaction and a cache line
+#define HSAIL_MEMTRACE_STRIDES 6
+#define HSAIL_MEMTRACE_REUSE_BUCKETS 24
+
+// one access of the kernel
+struct HsailMemAccess {
+	string text;
+	int line;
+	int bytes;
+	char kind;                // 'l'oad, 's'tore or 'a'tomic
+};
+
+// what the kernel stores for each access
+struct HsailMemRecord {
+	uint64_t base;            // the address register
+	uint32_t access;
+	int32_t offset;
+};
+
+static const char *hsailMemStrideNames[HSAIL_MEMTRACE_STRIDES] = {"0", "unit", "2-4u", "<64B", ">=64B", "neg"};
+
+// an access over every traced dispatch
+struct HsailMemSiteReport {
+	uint64_t executions;      // by lanes
+	uint64_t wavefronts;      // by wavefronts
+	uint64_t segments;        // segments those touched
+	uint64_t usefulBytes;     // distinct bytes those asked for
+	uint64_t strides[HSAIL_MEMTRACE_STRIDES];
+};
+
+// a kernarg's data over every traced dispatch, lines are counted per dispatch
+struct HsailMemArgReport {
+	uint64_t accesses;
+	uint64_t bytes;
+	uint64_t lines;
+};
+
+struct HsailMemReport {
+	vector<HsailMemAccess> accesses;
+	vector<HsailMemSiteReport> sites;
+	map<int, HsailMemArgReport> args;   // by kernarg index, -1 for addresses no kernarg points below
+	uint64_t reuse[HSAIL_MEMTRACE_REUSE_BUCKETS];   // cold, then distances 0, 1, 2-3, 4-7, ...
+	uint64_t dispatches;
+	uint64_t workItems;
+	uint64_t records;
+	uint64_t dropped;         // past the end of a work-item's buffer
+};
+
+static bool isHsailGlobalAccess(const string &opcode) {
+	bool memory = (opcode.compare(0, 3, "ld_") == 0 || opcode.compare(0, 3, "st_") == 0 || opcode.compare(0, 6, "atomic") == 0);
+	if (!memory) return false;
+	static const char *otherSegments[] = {"group", "private", "kernarg", "readonly", "spill", "arg", NULL};
+	size_t start = 0;
+	for (size_t us = opcode.find('_'); ; start = us + 1, us = opcode.find('_', start)) {
+		string part = opcode.substr(start, us == string::npos ? string::npos : us - start);
+		for (int s = 0; otherSegments[s] != NULL; s++) {
+			if (part == otherSegments[s]) return false;
+		}
+		if (us == string::npos) break;
+	}
+	return true;
+}
+
+// "[$d2+8]" gives $d2 and 8, false for other address forms
+static bool parseHsailAddress(const string &operand, string &reg, int32_t &offset) {
+	string op = trimHsail(operand);
+	if (op.size() < 5 || op[0] != '[' || op[op.size()-1] != ']') return false;
+	string inner = trimHsail(op.substr(1, op.size() - 2));
+	if (inner.size() < 3 || inner[0] != '$' || inner[1] != 'd') return false;
+	size_t end = 2;
+	while (end < inner.size() && isdigit(inner[end])) end++;
+	reg = inner.substr(0, end);
+	string rest = trimHsail(inner.substr(end));
+	offset = 0;
+	if (rest.empty()) return true;
+	if (rest[0] != '+' && rest[0] != '-') return false;
+	char *stop;
+	long value = strtol(trimHsail(rest.substr(1)).c_str(), &stop, 0);
+	if (*stop != '\0') return false;
+	offset = (int32_t) (rest[0] == '-' ? -value : value);
+	return true;
+}
+
+// rewrite hsail (without its comments) so entryName traces its global
+// accesses, keeping the first recordsPerItem of each traced work-item.
+// False if the kernel can't be found or there are no registers left.
+static bool instrumentHsailMemTrace(string &hsail, const char *entryName, uint32_t recordsPerItem,
+									vector<HsailMemAccess> &accesses) {
+	string s = stripHsailComments(hsail.c_str());
+	size_t sigStart = findHsailKernel(s, entryName);
+	if (sigStart == string::npos) return false;
+	size_t sigEnd = s.find(')', sigStart);
+	size_t bodyStart = s.find('{', sigEnd);
+	if (sigEnd == string::npos || bodyStart == string::npos) return false;
+	size_t bodyEnd = bodyStart;
+	for (int depth = 0; bodyEnd < s.size(); bodyEnd++) {
+		if (s[bodyEnd] == '{') depth++;
+		if (s[bodyEnd] == '}' && --depth == 0) break;
+	}
+	if (bodyEnd >= s.size()) return false;
+
+	// the work-item's buffer, its cursor (in bytes), a scratch address, two
+	// words for finding the work-item and the flag of those not traced
+	vector<string> regs;
+	findHsailRegs(s.substr(bodyStart, bodyEnd - bodyStart), regs);
+	set<string> used(regs.begin(), regs.end());
+	string baseReg, cursorReg, addrReg, wordReg, countReg, offReg;
+	if (!allocHsailReg('d', used, baseReg) || !allocHsailReg('d', used, cursorReg) || !allocHsailReg('d', used, addrReg)
+			|| !allocHsailReg('s', used, wordReg) || !allocHsailReg('s', used, countReg) || !allocHsailReg('c', used, offReg)) {
+		return false;
+	}
+
+	uint64_t itemBytes = 16 + (uint64_t) recordsPerItem * sizeof(HsailMemRecord);
+	char code[512];
+	sprintf(code, "\n\tld_kernarg_u64 %s, [%s];"
+			"\n\tworkitemabsid_u32 %s, 0;"
+			"\n\tld_global_u32 %s, [%s];"
+			"\n\tsub_u32 %s, %s, %s;"
+			"\n\tld_global_u32 %s, [%s+4];"
+			"\n\tcmp_ge_b1_u32 %s, %s, %s;"
+			"\n\tcvt_u64_u32 %s, %s;"
+			"\n\tmul_u64 %s, %s, %llu;"
+			"\n\tadd_u64 %s, %s, %s;"
+			"\n\tadd_u64 %s, %s, 16;"
+			"\n\tmov_b64 %s, 0;",
+			baseReg.c_str(), HSAIL_MEMTRACE_KERNARG, wordReg.c_str(), countReg.c_str(), baseReg.c_str(),
+			wordReg.c_str(), wordReg.c_str(), countReg.c_str(), countReg.c_str(), baseReg.c_str(),
+			offReg.c_str(), wordReg.c_str(), countReg.c_str(), addrReg.c_str(), wordReg.c_str(),
+			addrReg.c_str(), addrReg.c_str(), (unsigned long long) itemBytes,
+			baseReg.c_str(), baseReg.c_str(), addrReg.c_str(), baseReg.c_str(), baseReg.c_str(), cursorReg.c_str());
+	string body = code;
+
+	accesses.clear();
+	int labels = 0;
+	int line = 1 + std::count(s.begin(), s.begin() + bodyStart + 1, '\n');
+	size_t stmtStart = bodyStart + 1;
+	for (size_t semi = s.find(';', stmtStart); semi != string::npos && semi < bodyEnd; stmtStart = semi + 1, semi = s.find(';', stmtStart)) {
+		string raw = s.substr(stmtStart, semi - stmtStart);
+		size_t p = 0;
+		while (p < raw.size()) {
+			if (isspace(raw[p]) || raw[p] == '{' || raw[p] == '}') {
+				p++;
+			} else if (raw[p] == '@') {
+				size_t colon = raw.find(':', p);
+				if (colon == string::npos) break;
+				p = colon + 1;
+			} else {
+				break;
+			}
+		}
+		string stmt = raw.substr(p);
+		string opcode = hsailOpcode(stmt);
+		int stmtLine = line + std::count(raw.begin(), raw.begin() + p, '\n');
+		line += std::count(raw.begin(), raw.end(), '\n');
+
+		// the record is stored before the instruction, which may overwrite its address register
+		string before;
+		if (opcode == "ret") {
+			sprintf(code, "\n\tcbr %s, @__okra_mt%d;\n\tst_global_u64 %s, [%s-16];\n@__okra_mt%d:",
+					offReg.c_str(), labels, cursorReg.c_str(), baseReg.c_str(), labels);
+			before = code;
+			labels++;
+		} else if (!opcode.empty() && isHsailGlobalAccess(opcode)) {
+			vector<string> ops;
+			splitHsailOperands(stmt.substr(opcode.size()), ops);
+			string reg;
+			int32_t offset = 0;
+			for (int o = 0; o < ops.size(); o++) {
+				if (!ops[o].empty() && ops[o][0] == '[') {
+					if (!parseHsailAddress(ops[o], reg, offset)) reg.clear();
+					break;
+				}
+			}
+			if (!reg.empty()) {
+				HsailMemAccess access;
+				access.text = trimHsail(stmt);
+				access.line = stmtLine;
+				access.bytes = hsailTypeBytes(opcode);
+				access.kind = (opcode[0] == 'l' ? 'l' : opcode[0] == 's' ? 's' : 'a');
+				uint64_t tag = accesses.size() | ((uint64_t) (uint32_t) offset << 32);
+				accesses.push_back(access);
+				sprintf(code, "\n\tcbr %s, @__okra_mt%d;\n\tmin_u64 %s, %s, %llu;\n\tadd_u64 %s, %s, %s;"
+						"\n\tst_global_u64 %s, [%s];\n\tst_global_u64 %llu, [%s+8];\n\tadd_u64 %s, %s, 16;\n@__okra_mt%d:",
+						offReg.c_str(), labels, addrReg.c_str(), cursorReg.c_str(), (unsigned long long) (recordsPerItem - 1) * 16,
+						addrReg.c_str(), addrReg.c_str(), baseReg.c_str(), reg.c_str(), addrReg.c_str(),
+						(unsigned long long) tag, addrReg.c_str(), cursorReg.c_str(), cursorReg.c_str(), labels);
+				before = code;
+				labels++;
+			}
+		}
+		body += raw.substr(0, p) + before + (before.empty() ? "" : "\n\t") + stmt + ";";
+	}
+	body += s.substr(stmtStart, bodyEnd - stmtStart);
+
+	string sig = trimHsail(s.substr(sigStart + 1, sigEnd - sigStart - 1));
+	string newSig = sig + (sig.empty() ? "" : ",\n   ") + "align 8 kernarg_u64 " HSAIL_MEMTRACE_KERNARG;
+	hsail = s.substr(0, sigStart + 1) + newSig + s.substr(sigEnd, bodyStart + 1 - sigEnd) + body + s.substr(bodyEnd);
+	return true;
+}
+
+static int hsailMemStrideBucket(int64_t stride, int bytes) {
+	if (stride == 0) return 0;
+	if (stride < 0) return 5;
+	if (stride == bytes) return 1;
+	if (stride <= 4 * bytes) return 2;
+	return (stride < HSAIL_MEMTRACE_SEGMENT ? 3 : 4);
+}
+
+static int hsailMemReuseBucket(uint64_t distance) {
+	int bucket = 1;
+	while (distance > 0 && bucket < HSAIL_MEMTRACE_REUSE_BUCKETS - 1) {
+		distance >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+// fenwick tree over positions in an access sequence, for the distinct lines
+// used between two uses of a line
+static void hsailFenwickAdd(vector<int> &tree, size_t pos, int delta) {
+	for (pos++; pos < tree.size(); pos += pos & -pos) tree[pos] += delta;
+}
+
+static int hsailFenwickSum(const vector<int> &tree, size_t pos) {
+	int sum = 0;
+	for (; pos > 0; pos -= pos & -pos) sum += tree[pos];
+	return sum;
+}
+
+// the record a lane made at a step of its sequence, with the address worked out
+struct HsailMemLaneAccess {
+	uint64_t address;
+	uint32_t access;
+	uint32_t lane;
+};
+
+static bool hsailMemBySite(const HsailMemLaneAccess &a, const HsailMemLaneAccess &b) {
+	return a.access < b.access || (a.access == b.access && a.lane < b.lane);
+}
+
+// add one dispatch to report.  buffer is what the instrumented kernel filled
+// in for numItems work-items from the start of a work-group; argBases are
+// the values of the pointer kernargs with their indices.
+static void addHsailMemTrace(HsailMemReport &report, const uint64_t *buffer, uint32_t numItems, uint32_t recordsPerItem,
+							 uint32_t groupSize, vector<pair<uint64_t, int> > argBases) {
+	if (report.sites.size() != report.accesses.size()) {
+		HsailMemSiteReport empty;
+		memset(&empty, 0, sizeof(empty));
+		report.sites.assign(report.accesses.size(), empty);
+	}
+	std::sort(argBases.begin(), argBases.end());
+	report.dispatches++;
+	report.workItems += numItems;
+
+	size_t itemWords = 2 + 2 * (size_t) recordsPerItem;
+	const uint64_t *items = buffer + 2;
+	vector<uint32_t> valid(numItems);
+	for (uint32_t i = 0; i < numItems; i++) {
+		uint64_t written = items[i * itemWords] / 16;
+		// once full, the last record is overwritten by every later access
+		valid[i] = (uint32_t) (written > recordsPerItem ? recordsPerItem - 1 : written);
+		report.records += valid[i];
+		report.dropped += written - valid[i];
+	}
+	map<int, set<uint64_t> > argLines;
+	if (groupSize == 0) groupSize = numItems;
+
+	for (uint32_t group = 0; group < numItems; group += groupSize) {
+		uint32_t groupEnd = std::min(numItems, group + groupSize);
+		uint32_t steps = 0;
+		for (uint32_t i = group; i < groupEnd; i++) steps = std::max(steps, valid[i]);
+
+		// the group's lines in lockstep order, each wavefront's lanes at a step together
+		vector<uint64_t> sequence;
+		for (uint32_t step = 0; step < steps; step++) {
+			for (uint32_t wave = group; wave < groupEnd; wave += HSAIL_MEMTRACE_WAVEFRONT) {
+				vector<HsailMemLaneAccess> lanes;
+				for (uint32_t i = wave; i < std::min(groupEnd, wave + HSAIL_MEMTRACE_WAVEFRONT); i++) {
+					if (step >= valid[i]) continue;
+					const HsailMemRecord &record = ((const HsailMemRecord *) (items + i * itemWords + 2))[step];
+					if (record.access >= report.accesses.size()) continue;
+					HsailMemLaneAccess lane;
+					lane.address = record.base + (int64_t) record.offset;
+					lane.access = record.access;
+					lane.lane = i - wave;
+					lanes.push_back(lane);
+					sequence.push_back(lane.address / HSAIL_MEMTRACE_SEGMENT);
+
+					int bytes = report.accesses[record.access].bytes;
+					vector<pair<uint64_t, int> >::iterator above =
+						std::upper_bound(argBases.begin(), argBases.end(), make_pair(lane.address, INT_MAX));
+					int arg = (above == argBases.begin() ? -1 : (above - 1)->second);
+					HsailMemArgReport &argReport = report.args[arg];
+					argReport.accesses++;
+					argReport.bytes += bytes;
+					argLines[arg].insert(lane.address / HSAIL_MEMTRACE_SEGMENT);
+				}
+
+				// lanes that diverged to different accesses coalesce separately
+				std::sort(lanes.begin(), lanes.end(), hsailMemBySite);
+				for (size_t first = 0, last; first < lanes.size(); first = last) {
+					for (last = first; last < lanes.size() && lanes[last].access == lanes[first].access; last++);
+					HsailMemSiteReport &site = report.sites[lanes[first].access];
+					int bytes = std::max(1, report.accesses[lanes[first].access].bytes);
+					set<uint64_t> segments;
+					set<uint64_t> addresses;
+					for (size_t l = first; l < last; l++) {
+						segments.insert(lanes[l].address / HSAIL_MEMTRACE_SEGMENT);
+						segments.insert((lanes[l].address + bytes - 1) / HSAIL_MEMTRACE_SEGMENT);
+						addresses.insert(lanes[l].address);
+						if (l > first) {
+							site.strides[hsailMemStrideBucket((int64_t) (lanes[l].address - lanes[l-1].address), bytes)]++;
+						}
+					}
+					site.executions += last - first;
+					site.wavefronts++;
+					site.segments += segments.size();
+					site.usefulBytes += addresses.size() * bytes;
+				}
+			}
+		}
+
+		// distinct lines since the last use of each line
+		vector<int> tree(sequence.size() + 1, 0);
+		map<uint64_t, size_t> lastUse;
+		for (size_t pos = 0; pos < sequence.size(); pos++) {
+			map<uint64_t, size_t>::iterator prev = lastUse.find(sequence[pos]);
+			if (prev == lastUse.end()) {
+				report.reuse[0]++;
+			} else {
+				int distance = hsailFenwickSum(tree, pos) - hsailFenwickSum(tree, prev->second + 1);
+				report.reuse[hsailMemReuseBucket(distance)]++;
+				hsailFenwickAdd(tree, prev->second, -1);
+			}
+			hsailFenwickAdd(tree, pos, 1);
+			lastUse[sequence[pos]] = pos;
+		}
+	}
+	for (map<int, set<uint64_t> >::iterator it = argLines.begin(); it != argLines.end(); ++it) {
+		report.args[it->first].lines += it->second.size();
+	}
+}
+
+static void writeHsailMemReport(FILE *file, const HsailMemReport &report, const char *entryName,
+								const vector<HsailKernarg> &kernargs) {
+	fprintf(file, "okra memory report of %s: %llu dispatches, %llu work-items traced, %llu accesses",
+			entryName, (unsigned long long) report.dispatches, (unsigned long long) report.workItems,
+			(unsigned long long) report.records);
+	if (report.dropped != 0) fprintf(file, " (%llu more past the buffers)", (unsigned long long) report.dropped);
+	fprintf(file, "\n\naccesses (wavefronts of %d lanes, %d byte segments)\n", HSAIL_MEMTRACE_WAVEFRONT, HSAIL_MEMTRACE_SEGMENT);
+	fprintf(file, "%6s %4s %5s %12s %10s %9s", "line", "kind", "bytes", "executions", "coalesced", "seg/wave");
+	for (int b = 0; b < HSAIL_MEMTRACE_STRIDES; b++) fprintf(file, " %6s", hsailMemStrideNames[b]);
+	fprintf(file, "  source\n");
+	for (int a = 0; a < report.accesses.size() && a < report.sites.size(); a++) {
+		const HsailMemAccess &access = report.accesses[a];
+		const HsailMemSiteReport &site = report.sites[a];
+		const char *kind = (access.kind == 'l' ? "ld" : access.kind == 's' ? "st" : "atom");
+		if (site.wavefronts == 0) {
+			fprintf(file, "%6d %4s %5d %12s %10s %9s", access.line, kind, access.bytes, "0", "", "");
+			for (int b = 0; b < HSAIL_MEMTRACE_STRIDES; b++) fprintf(file, " %6s", "");
+		} else {
+			// useful bytes over the bytes of the segments moved
+			double coalesced = (double) site.usefulBytes / (site.segments * HSAIL_MEMTRACE_SEGMENT);
+			fprintf(file, "%6d %4s %5d %12llu %9.1f%% %9.2f", access.line, kind, access.bytes,
+					(unsigned long long) site.executions, std::min(1.0, coalesced) * 100,
+					(double) site.segments / site.wavefronts);
+			uint64_t pairs = 0;
+			for (int b = 0; b < HSAIL_MEMTRACE_STRIDES; b++) pairs += site.strides[b];
+			for (int b = 0; b < HSAIL_MEMTRACE_STRIDES; b++) {
+				fprintf(file, " %5.1f%%", pairs == 0 ? 0.0 : 100.0 * site.strides[b] / pairs);
+			}
+		}
+		fprintf(file, "  %s\n", access.text.c_str());
+	}
+
+	fprintf(file, "\nreuse distance (distinct %d byte lines between uses within a work-group)\n", HSAIL_MEMTRACE_SEGMENT);
+	uint64_t uses = 0;
+	for (int b = 0; b < HSAIL_MEMTRACE_REUSE_BUCKETS; b++) uses += report.reuse[b];
+	for (int b = 0; b < HSAIL_MEMTRACE_REUSE_BUCKETS; b++) {
+		if (report.reuse[b] == 0) continue;
+		char range[32];
+		if (b == 0) {
+			strcpy(range, "first use");
+		} else if (b <= 2) {
+			sprintf(range, "%d", b - 1);
+		} else if (b == HSAIL_MEMTRACE_REUSE_BUCKETS - 1) {
+			sprintf(range, ">= %llu", 1ULL << (b - 2));
+		} else {
+			sprintf(range, "%llu-%llu", 1ULL << (b - 2), (1ULL << (b - 1)) - 1);
+		}
+		fprintf(file, "%14s %12llu %6.1f%%\n", range, (unsigned long long) report.reuse[b], 100.0 * report.reuse[b] / uses);
+	}
+
+	fprintf(file, "\nkernargs (accessed at or above the pointer they hold)\n");
+	fprintf(file, "%4s %-20s %12s %14s %14s\n", "arg", "name", "accesses", "bytes", "bytes touched");
+	for (map<int, HsailMemArgReport>::const_iterator it = report.args.begin(); it != report.args.end(); ++it) {
+		string name = (it->first < 0 ? "(other)" : it->first < kernargs.size() ? kernargs[it->first].name : "?");
+		char index[16];
+		sprintf(index, "%d", it->first);
+		fprintf(file, "%4s %-20s %12llu %14llu %14llu\n", it->first < 0 ? "" : index, name.c_str(),
+				(unsigned long long) it->second.accesses, (unsigned long long) it->second.bytes,
+				(unsigned long long) it->second.lines * HSAIL_MEMTRACE_SEGMENT);
+	}
+}
+
+#endif // HSAILMEMTRACE_H
@@ -0,0 +1,315 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef HSAILREGTRACE_H
+#define HSAILREGTRACE_H
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hsailCounters.h"
+using namespace std;
+
+// Register tracing of a kernel.  The simulator engine can't be asked for its
+// register state, so the kernel is rewritten to record its own register
+// writes: a kernarg holding the address of a trace buffer is appended to the
+// signature, and every instruction writing a $c, $s or $d register is
+// followed by a store of a 16 byte record into a ring owned by the
+// work-item.  Only work-items in [first, first + count) of dimension 0
+// record anything; the rest skip the stores with a cbr.
+//
+// The buffer holds, for each traced work-item, a 16 byte header with the
+// bytes of records written so far, then recordsPerItem records.  A ring
+// keeps the last recordsPerItem writes, so tracing a long loop costs a
+// fixed amount of memory.  After a dispatch the rings are appended to a
+// file, oldest record first, and okra-regtrace decodes them.
+
+// name of the kernarg holding the trace buffer
+#define HSAIL_REGTRACE_KERNARG "%__okra_regtrace"
+
+#define OKRA_REGTRACE_MAGIC "OKRAREGT"
+#define OKRA_REGTRACE_VERSION 1
+#define OKRA_REGTRACE_DISPATCH 0x44524b4f   // "OKRD"
+
+// one register write, as stored by the kernel
+struct OkraRegTraceRecord {
+	uint32_t statement;       // index into the dispatch's statements
+	uint16_t regClass;        // 'c', 's' or 'd'
+	uint16_t regNumber;
+	uint64_t value;
+};
+
+// the file starts with this
+struct OkraRegTraceFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordBytes;
+};
+
+// then for each traced dispatch this, followed by the entry name (with its
+// nul), a u32 source line per statement, the statement texts (each with its
+// nul) and tracedItems items
+struct OkraRegTraceDispatchHeader {
+	uint32_t magic;
+	uint32_t dispatch;        // of this kernel, counting from 0
+	uint32_t firstItem;
+	uint32_t numItems;        // work-items in the traced range
+	uint32_t recordsPerItem;
+	uint32_t tracedItems;     // work-items that wrote a register
+	uint32_t numStatements;
+	uint32_t nameBytes;
+	uint32_t textBytes;
+};
+
+// an item is this followed by numRecords records, oldest first
+struct OkraRegTraceItemHeader {
+	uint32_t workItem;
+	uint32_t numRecords;
+	uint64_t written;         // records written, more than numRecords if the ring wrapped
+};
+
+// the instructions of an instrumented kernel that write a register
+struct HsailRegTraceInfo {
+	vector<string> statements;
+	vector<uint32_t> lines;
+};
+
+static bool hsailWritesNoRegister(const string &opcode) {
+	static const char *prefixes[] = {"st_", "cbr", "brn", "br", "sbr", "ret", "call", "barrier", "sync", "fbar",
+									  "memfence", "atomicnoret", NULL};
+	for (int p = 0; prefixes[p] != NULL; p++) {
+		if (opcode.compare(0, strlen(prefixes[p]), prefixes[p]) == 0) return true;
+	}
+	return false;
+}
+
+static uint32_t hsailRegTraceRecordsPerItem(uint32_t records) {
+	uint32_t rounded = 1;
+	while (rounded < records && rounded < (1u << 24)) rounded <<= 1;
+	return rounded;
+}
+
+// rewrite hsail (without its comments) so entryName traces the register
+// writes of work-items [firstItem, firstItem + numItems), keeping the last
+// recordsPerItem (a power of two) of each.  False if the kernel can't be
+// found or there are no registers left for the tracing.
+static bool instrumentHsailRegTrace(string &hsail, const char *entryName, uint32_t firstItem, uint32_t numItems,
+									uint32_t recordsPerItem, HsailRegTraceInfo &info) {
+	string s = stripHsailComments(hsail.c_str());
+	size_t sigStart = findHsailKernel(s, entryName);
+	if (sigStart == string::npos) return false;
+	size_t sigEnd = s.find(')', sigStart);
+	size_t bodyStart = s.find('{', sigEnd);
+	if (sigEnd == string::npos || bodyStart == string::npos) return false;
+	size_t bodyEnd = bodyStart;
+	for (int depth = 0; bodyEnd < s.size(); bodyEnd++) {
+		if (s[bodyEnd] == '{') depth++;
+		if (s[bodyEnd] == '}' && --depth == 0) break;
+	}
+	if (bodyEnd >= s.size()) return false;
+
+	// the ring base, its cursor (in bytes) and a scratch address, a word for
+	// $c values and the flag of work-items outside the range
+	vector<string> regs;
+	findHsailRegs(s.substr(bodyStart, bodyEnd - bodyStart), regs);
+	set<string> used(regs.begin(), regs.end());
+	string baseReg, cursorReg, addrReg, wordReg, offReg;
+	if (!allocHsailReg('d', used, baseReg) || !allocHsailReg('d', used, cursorReg) || !allocHsailReg('d', used, addrReg)
+			|| !allocHsailReg('s', used, wordReg) || !allocHsailReg('c', used, offReg)) {
+		return false;
+	}
+
+	uint64_t itemBytes = 16 + (uint64_t) recordsPerItem * sizeof(OkraRegTraceRecord);
+	char code[256];
+	sprintf(code, "\n\tld_kernarg_u64 %s, [%s];"
+			"\n\tworkitemabsid_u32 %s, 0;"
+			"\n\tsub_u32 %s, %s, %u;"
+			"\n\tcmp_ge_b1_u32 %s, %s, %u;"
+			"\n\tcvt_u64_u32 %s, %s;"
+			"\n\tmul_u64 %s, %s, %llu;"
+			"\n\tadd_u64 %s, %s, %s;"
+			"\n\tmov_b64 %s, 0;",
+			baseReg.c_str(), HSAIL_REGTRACE_KERNARG, wordReg.c_str(), wordReg.c_str(), wordReg.c_str(), firstItem,
+			offReg.c_str(), wordReg.c_str(), numItems, addrReg.c_str(), wordReg.c_str(),
+			addrReg.c_str(), addrReg.c_str(), (unsigned long long) itemBytes,
+			baseReg.c_str(), baseReg.c_str(), addrReg.c_str(), cursorReg.c_str());
+	string body = code;
+
+	info.statements.clear();
+	info.lines.clear();
+	int labels = 0;
+	int line = 1 + std::count(s.begin(), s.begin() + bodyStart + 1, '\n');
+	size_t stmtStart = bodyStart + 1;
+	for (size_t semi = s.find(';', stmtStart); semi != string::npos && semi < bodyEnd; stmtStart = semi + 1, semi = s.find(';', stmtStart)) {
+		string raw = s.substr(stmtStart, semi - stmtStart);
+		size_t p = 0;
+		size_t afterLabel = string::npos;
+		while (p < raw.size()) {
+			if (isspace(raw[p]) || raw[p] == '{' || raw[p] == '}') {
+				p++;
+			} else if (raw[p] == '@') {
+				size_t colon = raw.find(':', p);
+				if (colon == string::npos) break;
+				p = afterLabel = colon + 1;
+			} else {
+				break;
+			}
+		}
+		string stmt = raw.substr(p);
+		string opcode = hsailOpcode(stmt);
+		int stmtLine = line + std::count(raw.begin(), raw.begin() + p, '\n');
+		line += std::count(raw.begin(), raw.end(), '\n');
+		if (opcode == "ret") {
+			// the cursor goes in the ring's header on the way out
+			sprintf(code, "\n\tcbr %s, @__okra_rt%d;\n\tst_global_u64 %s, [%s];\n@__okra_rt%d:",
+					offReg.c_str(), labels, cursorReg.c_str(), baseReg.c_str(), labels);
+			labels++;
+			size_t split = (afterLabel == string::npos ? 0 : afterLabel);
+			body += raw.substr(0, split) + code + raw.substr(split) + ";";
+			continue;
+		}
+		body += raw + ";";
+		if (opcode.empty() || isHsailDeclaration(opcode) || hsailWritesNoRegister(opcode)) continue;
+		vector<string> ops;
+		splitHsailOperands(stmt.substr(opcode.size()), ops);
+		if (ops.empty() || !isHsailRegister(ops[0])) continue;
+		char cls = ops[0][1];
+		if (cls != 'c' && cls != 's' && cls != 'd') continue;
+
+		uint64_t tag = info.statements.size() | ((uint64_t) cls << 32) | ((uint64_t) atoi(ops[0].c_str() + 2) << 48);
+		info.statements.push_back(trimHsail(stmt));
+		info.lines.push_back(stmtLine);
+		sprintf(code, "\n\tcbr %s, @__okra_rt%d;\n\tand_b64 %s, %s, %llu;\n\tadd_u64 %s, %s, %s;\n\tst_global_u64 %llu, [%s+16];",
+				offReg.c_str(), labels, addrReg.c_str(), cursorReg.c_str(), (unsigned long long) (recordsPerItem - 1) * 16,
+				addrReg.c_str(), addrReg.c_str(), baseReg.c_str(), (unsigned long long) tag, addrReg.c_str());
+		body += code;
+		if (cls == 'd') {
+			sprintf(code, "\n\tst_global_u64 %s, [%s+24];", ops[0].c_str(), addrReg.c_str());
+		} else if (cls == 's') {
+			sprintf(code, "\n\tst_global_u32 %s, [%s+24];\n\tst_global_u32 0, [%s+28];", ops[0].c_str(), addrReg.c_str(), addrReg.c_str());
+		} else {
+			sprintf(code, "\n\tcmov_b32 %s, %s, 1, 0;\n\tst_global_u32 %s, [%s+24];\n\tst_global_u32 0, [%s+28];",
+					wordReg.c_str(), ops[0].c_str(), wordReg.c_str(), addrReg.c_str(), addrReg.c_str());
+		}
+		body += code;
+		sprintf(code, "\n\tadd_u64 %s, %s, 16;\n@__okra_rt%d:", cursorReg.c_str(), cursorReg.c_str(), labels);
+		body += code;
+		labels++;
+	}
+	body += s.substr(stmtStart, bodyEnd - stmtStart);
+
+	string sig = trimHsail(s.substr(sigStart + 1, sigEnd - sigStart - 1));
+	string newSig = sig + (sig.empty() ? "" : ",\n   ") + "align 8 kernarg_u64 " HSAIL_REGTRACE_KERNARG;
+	hsail = s.substr(0, sigStart + 1) + newSig + s.substr(sigEnd, bodyStart + 1 - sigEnd) + body + s.substr(bodyEnd);
+	return true;
+}
+
+// append the rings of one dispatch to path, starting the file if it is
+// empty.  buffer is what the instrumented kernel filled in.
+static bool writeHsailRegTrace(const char *path, const char *entryName, uint32_t dispatch, uint32_t firstItem,
+							   uint32_t numItems, uint32_t recordsPerItem, const HsailRegTraceInfo &info,
+							   const uint64_t *buffer) {
+	static pthread_mutex_t fileMutex = PTHREAD_MUTEX_INITIALIZER;
+	size_t itemWords = 2 + 2 * (size_t) recordsPerItem;
+
+	string text;
+	for (int i = 0; i < info.statements.size(); i++) {
+		text += info.statements[i];
+		text += '\0';
+	}
+	OkraRegTraceDispatchHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = OKRA_REGTRACE_DISPATCH;
+	header.dispatch = dispatch;
+	header.firstItem = firstItem;
+	header.numItems = numItems;
+	header.recordsPerItem = recordsPerItem;
+	header.numStatements = info.statements.size();
+	header.nameBytes = strlen(entryName) + 1;
+	header.textBytes = text.size();
+	for (uint32_t i = 0; i < numItems; i++) {
+		if (buffer[i * itemWords] != 0) header.tracedItems++;
+	}
+
+	pthread_mutex_lock(&fileMutex);
+	FILE *file = fopen(path, "ab");
+	if (file == NULL) {
+		pthread_mutex_unlock(&fileMutex);
+		return false;
+	}
+	if (ftell(file) == 0) {
+		OkraRegTraceFileHeader fileHeader;
+		memcpy(fileHeader.magic, OKRA_REGTRACE_MAGIC, 8);
+		fileHeader.version = OKRA_REGTRACE_VERSION;
+		fileHeader.recordBytes = sizeof(OkraRegTraceRecord);
+		fwrite(&fileHeader, sizeof(fileHeader), 1, file);
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(entryName, header.nameBytes, 1, file);
+	if (!info.lines.empty()) fwrite(&info.lines[0], sizeof(uint32_t), info.lines.size(), file);
+	fwrite(text.data(), 1, text.size(), file);
+	for (uint32_t i = 0; i < numItems; i++) {
+		const uint64_t *ring = buffer + i * itemWords;
+		uint64_t written = ring[0] / 16;
+		if (written == 0) continue;
+		OkraRegTraceItemHeader item;
+		item.workItem = firstItem + i;
+		item.written = written;
+		item.numRecords = (uint32_t) std::min(written, (uint64_t) recordsPerItem);
+		fwrite(&item, sizeof(item), 1, file);
+		// the oldest record is at the cursor once the ring has wrapped
+		const OkraRegTraceRecord *records = (const OkraRegTraceRecord *) (ring + 2);
+		uint32_t oldest = (written > recordsPerItem ? (uint32_t) (written % recordsPerItem) : 0);
+		fwrite(records + oldest, sizeof(OkraRegTraceRecord), item.numRecords - oldest, file);
+		fwrite(records, sizeof(OkraRegTraceRecord), oldest, file);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	pthread_mutex_unlock(&fileMutex);
+	return ok;
+}
+
+#endif // HSAILREGTRACE_H
@@ -0,0 +1,225 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef HSAILSPECIALIZE_H
+#define HSAILSPECIALIZE_H
+#include <string>
+#include <vector>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include "kernargAccess.h"
+using namespace std;
+
+// Substitution of constant values for scalar kernargs.  Every load of a
+// specialized kernarg, "ld_kernarg_u32 $s0, [%_siz]", becomes a mov of the
+// value into the same register, "mov_b32 $s0, 0x40", and the finalizer can
+// fold it from there.  The kernarg itself stays in the signature so the
+// variant takes the same args as the generic kernel.  A kernarg that is used
+// any other way (lda, an offset address) can't be specialized, and neither
+// can a pointer: a variant per array address would never be reused.
+
+struct HsailKernarg {
+	string name;      // %_siz
+	string type;      // u32
+};
+
+// kernarg names and types of entryName in declaration order, false if it is not found
+static bool findHsailKernargs(const string &s, const char *entryName, vector<HsailKernarg> &kernargs) {
+	size_t sigStart = findHsailKernel(s, entryName);
+	if (sigStart == string::npos) return false;
+	size_t sigEnd = s.find(')', sigStart);
+	if (sigEnd == string::npos) return false;
+	vector<string> params;
+	splitHsailOperands(s.substr(sigStart + 1, sigEnd - sigStart - 1), params);
+	for (int i = 0; i < params.size(); i++) {
+		size_t kpos = params[i].find("kernarg_");
+		size_t pct = params[i].find('%');
+		if (kpos == string::npos || pct == string::npos) return false;
+		size_t typeEnd = kpos + 8;
+		while (typeEnd < params[i].size() && isalnum(params[i][typeEnd])) typeEnd++;
+		HsailKernarg kernarg;
+		kernarg.type = params[i].substr(kpos + 8, typeEnd - kpos - 8);
+		kernarg.name = trimHsail(params[i].substr(pct));
+		kernargs.push_back(kernarg);
+	}
+	return true;
+}
+
+static int hsailTypeBits(const string &type) {
+	return (type.size() > 1 ? atoi(type.c_str() + 1) : 0);
+}
+
+// the bits a kernarg of this type would hold for a pushed value, loads of
+// narrow kernargs extend into 32 bits so the value is extended the same way
+static uint64_t hsailKernargBits(const string &type, uint64_t raw) {
+	switch (hsailTypeBits(type)) {
+	case 8:  return (type[0] == 's' ? (uint32_t) (int32_t) (int8_t) raw : (uint32_t) (uint8_t) raw);
+	case 16: return (type[0] == 's' ? (uint32_t) (int32_t) (int16_t) raw : (uint32_t) (uint16_t) raw);
+	case 32: return (uint32_t) raw;
+	default: return raw;
+	}
+}
+
+static string hsailKernargLiteral(const string &type, uint64_t bits) {
+	char literal[32];
+	if (type == "f32") {
+		sprintf(literal, "0F%08x", (uint32_t) bits);
+	} else if (type == "f64") {
+		sprintf(literal, "0D%016llx", (unsigned long long) bits);
+	} else if (hsailTypeBits(type) == 64) {
+		sprintf(literal, "0x%llx", (unsigned long long) bits);
+	} else {
+		sprintf(literal, "0x%x", (uint32_t) bits);
+	}
+	return literal;
+}
+
+// whether reg, loaded from a 64-bit integer kernarg, reaches the address of
+// a memory access through 64-bit registers, which makes the kernarg a
+// pointer.  A 32-bit index or size only gets there through a cvt, which
+// stops the taint.  Taint is only accumulated, which is conservative for loops.
+static bool hsailRegisterReachesAddress(const vector<string> &opcodes, const vector<vector<string> > &operands, const string &reg) {
+	map<string, bool> tainted;
+	tainted[reg] = true;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int n = 0; n < opcodes.size(); n++) {
+			const vector<string> &ops = operands[n];
+			bool isStore = opcodes[n].compare(0, 3, "st_") == 0;
+			for (int k = 0; k < ops.size(); k++) {
+				vector<string> regs;
+				findHsailRegs(ops[k], regs);
+				for (int r = 0; r < regs.size(); r++) {
+					if (!tainted[regs[r]]) continue;
+					if (ops[k].find('[') != string::npos) return true;
+					if (k > 0 && !isStore && isHsailRegister(ops[0]) && ops[0][1] == 'd' && !tainted[ops[0]]) {
+						tainted[ops[0]] = true;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// values maps kernarg index to hsailKernargBits; hsail is rewritten (without
+// its comments) only if every specialized kernarg could be substituted.
+// False for a pointer kernarg, see hsailRegisterReachesAddress.
+static bool specializeHsailKernargs(string &hsail, const char *entryName, const map<int, uint64_t> &values) {
+	string s = stripHsailComments(hsail.c_str());
+	vector<HsailKernarg> kernargs;
+	if (!findHsailKernargs(s, entryName, kernargs)) return false;
+	map<string, string> movs;   // kernarg name -> literal
+	map<string, bool> mayBePointer;
+	for (map<int, uint64_t>::const_iterator it = values.begin(); it != values.end(); ++it) {
+		if (it->first < 0 || it->first >= kernargs.size()) return false;
+		const HsailKernarg &kernarg = kernargs[it->first];
+		movs[kernarg.name] = hsailKernargLiteral(kernarg.type, it->second);
+		mayBePointer[kernarg.name] = (hsailTypeBits(kernarg.type) == 64 && kernarg.type[0] != 'f');
+	}
+
+	size_t bodyStart = s.find('{', findHsailKernel(s, entryName));
+	if (bodyStart == string::npos) return false;
+	size_t bodyEnd = bodyStart;
+	for (int depth = 0; bodyEnd < s.size(); bodyEnd++) {
+		if (s[bodyEnd] == '{') depth++;
+		if (s[bodyEnd] == '}' && --depth == 0) break;
+	}
+	if (bodyEnd >= s.size()) return false;
+
+	string body;
+	vector<string> opcodes;
+	vector<vector<string> > operands;
+	vector<string> pointerRegs;   // loaded from specialized kernargs that may be pointers
+	size_t stmtStart = bodyStart + 1;
+	for (size_t semi = s.find(';', stmtStart); semi != string::npos && semi < bodyEnd; stmtStart = semi + 1, semi = s.find(';', stmtStart)) {
+		string raw = s.substr(stmtStart, semi - stmtStart);
+		string stmt = trimHsail(raw);
+		size_t sp = 0;
+		while (sp < stmt.size() && !isspace(stmt[sp])) sp++;
+		string opcode = stmt.substr(0, sp);
+		if (opcode.compare(0, 11, "ld_kernarg_") == 0) {
+			vector<string> ops;
+			splitHsailOperands(stmt.substr(sp), ops);
+			if (ops.size() == 2 && isHsailRegister(ops[0]) && ops[1].size() > 2 && ops[1][0] == '[') {
+				string name = trimHsail(ops[1].substr(1, ops[1].size() - 2));
+				map<string, string>::iterator it = movs.find(name);
+				if (it != movs.end()) {
+					string mov = (ops[0][1] == 'd' ? "mov_b64 " : "mov_b32 ");
+					raw = raw.substr(0, raw.find(stmt)) + mov + ops[0] + ", " + it->second;
+					if (mayBePointer[name]) pointerRegs.push_back(ops[0]);
+				}
+			}
+		}
+		body += raw + ";";
+
+		// the instruction without its labels, for following the pointer candidates
+		while (!stmt.empty() && stmt[0] == '@' && stmt.find(':') != string::npos) {
+			stmt = trimHsail(stmt.substr(stmt.find(':') + 1));
+		}
+		sp = 0;
+		while (sp < stmt.size() && !isspace(stmt[sp])) sp++;
+		opcodes.push_back(stmt.substr(0, sp));
+		operands.push_back(vector<string>());
+		splitHsailOperands(stmt.substr(sp), operands.back());
+	}
+	body += s.substr(stmtStart, bodyEnd - stmtStart);
+
+	for (int i = 0; i < pointerRegs.size(); i++) {
+		if (hsailRegisterReachesAddress(opcodes, operands, pointerRegs[i])) return false;
+	}
+
+	// anything left referring to a specialized kernarg is a use we don't handle
+	for (map<string, string>::iterator it = movs.begin(); it != movs.end(); ++it) {
+		for (size_t pos = body.find(it->first); pos != string::npos; pos = body.find(it->first, pos + 1)) {
+			size_t end = pos + it->first.size();
+			if (end >= body.size() || !(isalnum(body[end]) || body[end] == '_')) return false;
+		}
+	}
+	hsail = s.substr(0, bodyStart + 1) + body + s.substr(bodyEnd);
+	return true;
+}
+
+#endif // HSAILSPECIALIZE_H
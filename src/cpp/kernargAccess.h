@@ -0,0 +1,295 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef KERNARGACCESS_H
+#define KERNARGACCESS_H
+#include <string>
+#include <vector>
+#include <map>
+#include <ctype.h>
+#include <stdint.h>
+#include "okraContext.h"
+using namespace std;
+
+// Conservative scan of the HSAIL text of one kernel to find which kernarg
+// pointers are never used (directly or through registers derived from them)
+// as the address of a global store or atomic.  Such args are reported as
+// ARG_ACCESS_READ_ONLY, everything else as ARG_ACCESS_READ_WRITE.
+// Straight-line kernels are followed in order, so a register that is
+// reused for a different pointer loses its old taint.  Once there is any
+// branch, taint is only ever accumulated, which is conservative for loops.  Anything we cannot follow (calls,
+// stores through pointers that were loaded from memory) makes every arg
+// read-write.  We never infer write-only, since a kernel that only writes
+// some of the elements still needs the original contents copied in.
+
+static const uint64_t KERNARG_TAINT_UNKNOWN = 1ULL << 63;
+static const int KERNARG_MAX_TRACKED = 63;
+
+// the text need not be nul terminated.  Newlines inside block comments are
+// kept so the result has the same line numbers as the source.
+static string stripHsailComments(const char *src, size_t length) {
+	string s;
+	s.reserve(length);
+	const char *end = src + length;
+	for (const char *p = src; p < end; p++) {
+		if (p[0] == '/' && p + 1 < end && p[1] == '/') {
+			while (p < end && *p != '\n') p++;
+			if (p == end) break;
+		} else if (p[0] == '/' && p + 1 < end && p[1] == '*') {
+			p += 2;
+			while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) {
+				if (*p == '\n') s += '\n';
+				p++;
+			}
+			if (p + 1 >= end) break;
+			p++;
+			continue;
+		}
+		s += *p;
+	}
+	return s;
+}
+
+static string stripHsailComments(const char *src) {
+	return stripHsailComments(src, strlen(src));
+}
+
+static string trimHsail(const string &s) {
+	size_t b = 0, e = s.size();
+	while (b < e && isspace(s[b])) b++;
+	while (e > b && isspace(s[e-1])) e--;
+	return s.substr(b, e - b);
+}
+
+// split an operand list on the commas that are not inside brackets or parens
+static void splitHsailOperands(const string &ops, vector<string> &out) {
+	int depth = 0;
+	string cur;
+	for (size_t i = 0; i < ops.size(); i++) {
+		char c = ops[i];
+		if (c == '[' || c == '(') depth++;
+		if (c == ']' || c == ')') depth--;
+		if (c == ',' && depth == 0) {
+			out.push_back(trimHsail(cur));
+			cur.clear();
+		} else {
+			cur += c;
+		}
+	}
+	if (!trimHsail(cur).empty()) out.push_back(trimHsail(cur));
+}
+
+static void findHsailRegs(const string &s, vector<string> &regs) {
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '$' && i + 1 < s.size() && isalpha(s[i+1])) {
+			size_t j = i + 2;
+			while (j < s.size() && isdigit(s[j])) j++;
+			regs.push_back(s.substr(i, j - i));
+			i = j - 1;
+		}
+	}
+}
+
+static bool isHsailRegister(const string &s) {
+	return s.size() > 2 && s[0] == '$' && isalpha(s[1]);
+}
+
+// return the segment part of an ld_/st_ opcode, e.g. "global" for st_global_f32
+static string hsailOpcodeSegment(const string &opcode) {
+	size_t first = opcode.find('_');
+	if (first == string::npos) return "";
+	size_t second = opcode.find('_', first + 1);
+	return opcode.substr(first + 1, second == string::npos ? string::npos : second - first - 1);
+}
+
+static bool isNonGlobalSegment(const string &seg) {
+	return seg == "arg" || seg == "private" || seg == "spill" || seg == "group" || seg == "kernarg";
+}
+
+// locate "kernel <entryName> (" and return the offset of the open paren, or npos
+static size_t findHsailKernel(const string &s, const char *entryName) {
+	size_t entryLen = strlen(entryName);
+	for (size_t pos = s.find("kernel"); pos != string::npos; pos = s.find("kernel", pos + 1)) {
+		if (pos > 0 && (isalnum(s[pos-1]) || s[pos-1] == '_')) continue;
+		size_t p = pos + 6;
+		if (p >= s.size() || !isspace(s[p])) continue;
+		while (p < s.size() && isspace(s[p])) p++;
+		if (s.compare(p, entryLen, entryName) != 0) continue;
+		p += entryLen;
+		while (p < s.size() && isspace(s[p])) p++;
+		if (p < s.size() && s[p] == '(') return p;
+	}
+	return string::npos;
+}
+
+// fill access with one ARG_ACCESS_ value per kernarg; returns false if the kernel could not be found
+static bool inferKernargAccess(const char *hsail, size_t length, const char *entryName, vector<int> &access) {
+	access.clear();
+	string s = stripHsailComments(hsail, length);
+	size_t sigStart = findHsailKernel(s, entryName);
+	if (sigStart == string::npos) return false;
+	size_t sigEnd = s.find(')', sigStart);
+	if (sigEnd == string::npos) return false;
+
+	// kernarg names in declaration order
+	map<string, int> argIndex;
+	vector<string> params;
+	splitHsailOperands(s.substr(sigStart + 1, sigEnd - sigStart - 1), params);
+	for (int i = 0; i < params.size(); i++) {
+		size_t pct = params[i].find('%');
+		if (pct != string::npos) {
+			size_t e = pct + 1;
+			while (e < params[i].size() && (isalnum(params[i][e]) || params[i][e] == '_')) e++;
+			argIndex[params[i].substr(pct, e - pct)] = i;
+		}
+		access.push_back(OkraContext::Kernel::ARG_ACCESS_READ_WRITE);
+	}
+
+	// body runs to the brace matching the first one after the signature
+	size_t bodyStart = s.find('{', sigEnd);
+	if (bodyStart == string::npos) return false;
+	size_t bodyEnd = bodyStart;
+	for (int depth = 0; bodyEnd < s.size(); bodyEnd++) {
+		if (s[bodyEnd] == '{') depth++;
+		if (s[bodyEnd] == '}' && --depth == 0) break;
+	}
+	if (params.size() > KERNARG_MAX_TRACKED) return true;
+
+	// break the body into (opcode, operands) pairs
+	bool hasBranches = false;
+	vector<string> opcodes;
+	vector<vector<string> > operands;
+	string body = s.substr(bodyStart + 1, bodyEnd - bodyStart - 1);
+	size_t stmtStart = 0;
+	for (size_t semi = body.find(';'); semi != string::npos; stmtStart = semi + 1, semi = body.find(';', stmtStart)) {
+		string stmt = body.substr(stmtStart, semi - stmtStart);
+		for (size_t i = 0; i < stmt.size(); i++) {
+			if (stmt[i] == '{' || stmt[i] == '}') stmt[i] = ' ';
+		}
+		stmt = trimHsail(stmt);
+		// drop any labels in front of the instruction
+		while (!stmt.empty() && stmt[0] == '@' && stmt.find(':') != string::npos) {
+			stmt = trimHsail(stmt.substr(stmt.find(':') + 1));
+		}
+		if (stmt.empty()) continue;
+		size_t sp = 0;
+		while (sp < stmt.size() && !isspace(stmt[sp])) sp++;
+		string opcode = stmt.substr(0, sp);
+		if (opcode.compare(0, 4, "call") == 0 || opcode == "scall" || opcode == "icall") {
+			// we don't follow pointers into functions
+			return true;
+		}
+		if (opcode.compare(0, 2, "br") == 0 || opcode.compare(0, 3, "cbr") == 0 || opcode.compare(0, 3, "sbr") == 0) {
+			hasBranches = true;
+		}
+		vector<string> ops;
+		splitHsailOperands(stmt.substr(sp), ops);
+		opcodes.push_back(opcode);
+		operands.push_back(ops);
+	}
+
+	// propagate taint until nothing changes, then collect the written args
+	map<string, uint64_t> taint;
+	uint64_t written = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int n = 0; n < opcodes.size(); n++) {
+			const string &opcode = opcodes[n];
+			const vector<string> &ops = operands[n];
+			if (ops.empty()) continue;
+			string seg = hsailOpcodeSegment(opcode);
+			bool isStore = opcode.compare(0, 3, "st_") == 0 && !isNonGlobalSegment(seg);
+			bool isAtomic = opcode.compare(0, 6, "atomic") == 0 && opcode.find("_group") == string::npos;
+			bool isLoad = opcode.compare(0, 3, "ld_") == 0;
+			uint64_t newTaint = 0;
+
+			if (isStore || isAtomic) {
+				for (int k = 0; k < ops.size(); k++) {
+					if (ops[k].find('[') == string::npos) continue;
+					vector<string> regs;
+					findHsailRegs(ops[k], regs);
+					for (int r = 0; r < regs.size(); r++) written |= taint[regs[r]];
+				}
+			}
+			if (isStore || !isHsailRegister(ops[0])) continue;
+
+			if (seg == "kernarg") {
+				size_t pct = ops.size() > 1 ? ops[1].find('%') : string::npos;
+				map<string, int>::iterator it = argIndex.end();
+				if (pct != string::npos) {
+					size_t e = ops[1].find_first_of("]+ ", pct);
+					it = argIndex.find(ops[1].substr(pct, e == string::npos ? string::npos : e - pct));
+				}
+				newTaint = (it == argIndex.end() ? KERNARG_TAINT_UNKNOWN : 1ULL << it->second);
+			} else if (isLoad || isAtomic) {
+				// values loaded from memory could be any pointer
+				newTaint = KERNARG_TAINT_UNKNOWN;
+			} else {
+				for (int k = 1; k < ops.size(); k++) {
+					vector<string> regs;
+					findHsailRegs(ops[k], regs);
+					for (int r = 0; r < regs.size(); r++) newTaint |= taint[regs[r]];
+				}
+			}
+			uint64_t &destTaint = taint[ops[0]];
+			if (!hasBranches) {
+				destTaint = newTaint;
+			} else if ((destTaint | newTaint) != destTaint) {
+				destTaint |= newTaint;
+				changed = true;
+			}
+		}
+	}
+
+	if (written & KERNARG_TAINT_UNKNOWN) return true;
+	for (int i = 0; i < access.size(); i++) {
+		if (!(written & (1ULL << i))) access[i] = OkraContext::Kernel::ARG_ACCESS_READ_ONLY;
+	}
+	return true;
+}
+
+static bool inferKernargAccess(const char *hsail, const char *entryName, vector<int> &access) {
+	return inferKernargAccess(hsail, strlen(hsail), entryName, access);
+}
+
+#endif // KERNARGACCESS_H
@@ -0,0 +1,318 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef KERNELBUNDLE_H
+#define KERNELBUNDLE_H
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// A kernel bundle holds the brig for any number of (kernel, entry) pairs,
+// assembled ahead of time by okra-aot, so that kernels can be created from it
+// with no hsail fixing or assembly.  It is meant to be mapped, everything is
+// addressed by file offset and the file is laid out as
+//
+//   KernelBundleHeader
+//   KernelBundleEntry[numEntries]
+//   uint32_t nameTable[tableSize]     index+1 of the entry, probed by name hash
+//   uint32_t sourceTable[tableSize]   index+1 of the entry, probed by source hash
+//   strings and kernarg access bytes
+//   brig images, each aligned to KERNEL_BUNDLE_ALIGN
+//
+// The tables use linear probing, 0 marks an empty slot and tableSize is a power of two.
+
+#define KERNEL_BUNDLE_MAGIC "OKRABNDL"
+#define KERNEL_BUNDLE_VERSION 1
+#define KERNEL_BUNDLE_ALIGN 16
+
+	// 64-bit FNV-1a, the source hash is taken over the hsail text exactly as
+	// it would be passed to createKernel; pass a previous hash to continue it
+	static inline uint64_t okraHashBytes(const char *bytes, size_t length, uint64_t hash = 14695981039346656037ULL) {
+		for (size_t i = 0; i < length; i++) {
+			hash ^= (unsigned char) bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static inline uint64_t okraHashString(const char *str) {
+		return okraHashBytes(str, strlen(str));
+	}
+
+	struct KernelBundleHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t numEntries;
+		uint32_t tableSize;
+		uint32_t reserved;
+		uint64_t entriesOffset;
+		uint64_t nameTableOffset;
+		uint64_t sourceTableOffset;
+		uint64_t fileSize;
+	};
+
+	struct KernelBundleEntry {
+		uint64_t sourceHash;
+		uint64_t brigOffset;
+		uint64_t brigSize;
+		uint32_t nameOffset;       // nul terminated
+		uint32_t entryNameOffset;  // nul terminated
+		uint32_t accessOffset;     // one byte per kernarg, see Kernel::ArgAccess
+		uint32_t accessCount;
+	};
+
+	class KernelBundleWriter {
+	private:
+		struct Item {
+			std::string name;
+			std::string entryName;
+			uint64_t sourceHash;
+			std::vector<int> argAccess;
+			const char *brig;
+			size_t brigSize;
+		};
+		std::vector<Item> items;
+
+		static uint64_t alignUp(uint64_t offset) {
+			return (offset + KERNEL_BUNDLE_ALIGN - 1) & ~(uint64_t) (KERNEL_BUNDLE_ALIGN - 1);
+		}
+
+		static void insert(std::vector<uint32_t> &table, uint64_t hash, uint32_t index) {
+			uint32_t mask = table.size() - 1;
+			uint32_t slot = (uint32_t) hash & mask;
+			while (table[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			table[slot] = index + 1;
+		}
+
+	public:
+		// the brig is not copied, it has to stay alive until write returns
+		void add(const char *name, const char *entryName, uint64_t sourceHash, const std::vector<int> &argAccess,
+				 const char *brig, size_t brigSize) {
+			Item item;
+			item.name = name;
+			item.entryName = entryName;
+			item.sourceHash = sourceHash;
+			item.argAccess = argAccess;
+			item.brig = brig;
+			item.brigSize = brigSize;
+			items.push_back(item);
+		}
+
+		// written to a temporary file and renamed so a reader never maps a partial bundle
+		bool write(const char *path) {
+			uint32_t numEntries = items.size();
+			uint32_t tableSize = 1;
+			while (tableSize < numEntries * 2) {
+				tableSize <<= 1;
+			}
+
+			KernelBundleHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, KERNEL_BUNDLE_MAGIC, sizeof(header.magic));
+			header.version = KERNEL_BUNDLE_VERSION;
+			header.numEntries = numEntries;
+			header.tableSize = tableSize;
+			header.entriesOffset = sizeof(KernelBundleHeader);
+			header.nameTableOffset = header.entriesOffset + numEntries * sizeof(KernelBundleEntry);
+			header.sourceTableOffset = header.nameTableOffset + tableSize * sizeof(uint32_t);
+
+			std::vector<KernelBundleEntry> entries(numEntries);
+			std::vector<uint32_t> nameTable(tableSize, 0);
+			std::vector<uint32_t> sourceTable(tableSize, 0);
+			std::string strings;
+			uint64_t stringsOffset = header.sourceTableOffset + tableSize * sizeof(uint32_t);
+			for (uint32_t i = 0; i < numEntries; i++) {
+				Item &item = items[i];
+				KernelBundleEntry &entry = entries[i];
+				entry.sourceHash = item.sourceHash;
+				entry.nameOffset = stringsOffset + strings.size();
+				strings.append(item.name.c_str(), item.name.size() + 1);
+				entry.entryNameOffset = stringsOffset + strings.size();
+				strings.append(item.entryName.c_str(), item.entryName.size() + 1);
+				entry.accessOffset = stringsOffset + strings.size();
+				entry.accessCount = item.argAccess.size();
+				for (size_t a = 0; a < item.argAccess.size(); a++) {
+					strings.push_back((char) item.argAccess[a]);
+				}
+				insert(nameTable, okraHashString(item.name.c_str()), i);
+				insert(sourceTable, item.sourceHash, i);
+			}
+			uint64_t offset = alignUp(stringsOffset + strings.size());
+			for (uint32_t i = 0; i < numEntries; i++) {
+				entries[i].brigOffset = offset;
+				entries[i].brigSize = items[i].brigSize;
+				offset = alignUp(offset + items[i].brigSize);
+			}
+			header.fileSize = offset;
+
+			char suffix[32];
+			sprintf(suffix, ".tmp%d", (int) getpid());
+			std::string tmpPath = std::string(path) + suffix;
+			FILE *fp = fopen(tmpPath.c_str(), "wb");
+			if (fp == NULL) {
+				return false;
+			}
+			static const char padding[KERNEL_BUNDLE_ALIGN] = {0};
+			bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+			ok = ok && (numEntries == 0 || fwrite(&entries[0], sizeof(KernelBundleEntry), numEntries, fp) == numEntries);
+			ok = ok && fwrite(&nameTable[0], sizeof(uint32_t), tableSize, fp) == tableSize;
+			ok = ok && fwrite(&sourceTable[0], sizeof(uint32_t), tableSize, fp) == tableSize;
+			ok = ok && fwrite(strings.data(), 1, strings.size(), fp) == strings.size();
+			uint64_t written = stringsOffset + strings.size();
+			for (uint32_t i = 0; ok && i < numEntries; i++) {
+				size_t pad = entries[i].brigOffset - written;
+				ok = fwrite(padding, 1, pad, fp) == pad;
+				ok = ok && fwrite(items[i].brig, 1, items[i].brigSize, fp) == items[i].brigSize;
+				written = entries[i].brigOffset + items[i].brigSize;
+			}
+			size_t pad = header.fileSize - written;
+			ok = ok && fwrite(padding, 1, pad, fp) == pad;
+			ok = (fclose(fp) == 0) && ok;
+			if (!ok || rename(tmpPath.c_str(), path) != 0) {
+				remove(tmpPath.c_str());
+				return false;
+			}
+			return true;
+		}
+	};
+
+	// read side, over a mapping of the whole bundle file
+	class KernelBundleReader {
+	private:
+		char *base;
+		size_t size;
+		const KernelBundleHeader *header;
+
+		const uint32_t *table(uint64_t offset) const {
+			return (const uint32_t *) (base + offset);
+		}
+
+		bool matches(const KernelBundleEntry *entry, const char *entryName) const {
+			return entryName == NULL || strcmp(getEntryName(entry), entryName) == 0;
+		}
+
+	public:
+		KernelBundleReader() : base(NULL), size(0), header(NULL) {
+		}
+
+		// takes over a mapping of the file, false if it is not a usable bundle
+		bool attach(char *_base, size_t _size) {
+			if (_size < sizeof(KernelBundleHeader)) return false;
+			const KernelBundleHeader *h = (const KernelBundleHeader *) _base;
+			if (memcmp(h->magic, KERNEL_BUNDLE_MAGIC, sizeof(h->magic)) != 0
+					|| h->version != KERNEL_BUNDLE_VERSION
+					|| h->fileSize > _size
+					|| h->tableSize == 0 || (h->tableSize & (h->tableSize - 1)) != 0) {
+				return false;
+			}
+			base = _base;
+			size = _size;
+			header = h;
+			return true;
+		}
+
+		void detach() {
+			if (base != NULL) {
+				munmap(base, size);
+			}
+			base = NULL;
+			header = NULL;
+		}
+
+		uint32_t getNumEntries() const {
+			return header->numEntries;
+		}
+
+		const KernelBundleEntry *getEntry(uint32_t index) const {
+			return (const KernelBundleEntry *) (base + header->entriesOffset) + index;
+		}
+
+		const char *getName(const KernelBundleEntry *entry) const {
+			return base + entry->nameOffset;
+		}
+
+		const char *getEntryName(const KernelBundleEntry *entry) const {
+			return base + entry->entryNameOffset;
+		}
+
+		char *getBrig(const KernelBundleEntry *entry) const {
+			return base + entry->brigOffset;
+		}
+
+		void getArgAccess(const KernelBundleEntry *entry, std::vector<int> &argAccess) const {
+			const char *bytes = base + entry->accessOffset;
+			argAccess.assign(bytes, bytes + entry->accessCount);
+		}
+
+		// entryName may be NULL to take the first entry under the name
+		const KernelBundleEntry *findByName(const char *name, const char *entryName) const {
+			uint32_t mask = header->tableSize - 1;
+			const uint32_t *names = table(header->nameTableOffset);
+			for (uint32_t slot = (uint32_t) okraHashString(name) & mask; names[slot] != 0; slot = (slot + 1) & mask) {
+				const KernelBundleEntry *entry = getEntry(names[slot] - 1);
+				if (strcmp(getName(entry), name) == 0 && matches(entry, entryName)) {
+					return entry;
+				}
+			}
+			return NULL;
+		}
+
+		const KernelBundleEntry *findBySourceHash(uint64_t sourceHash, const char *entryName) const {
+			uint32_t mask = header->tableSize - 1;
+			const uint32_t *sources = table(header->sourceTableOffset);
+			for (uint32_t slot = (uint32_t) sourceHash & mask; sources[slot] != 0; slot = (slot + 1) & mask) {
+				const KernelBundleEntry *entry = getEntry(sources[slot] - 1);
+				if (entry->sourceHash == sourceHash && matches(entry, entryName)) {
+					return entry;
+				}
+			}
+			return NULL;
+		}
+	};
+
+#endif //KERNELBUNDLE_H
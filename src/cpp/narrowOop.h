@@ -0,0 +1,126 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef NARROWOOP_H
+#define NARROWOOP_H
+#include "common.h"
+
+// How the jvm stores references inside the heap.  With compressed oops an
+// array element or field holds a 32 bit narrow oop which decodes to
+// base + (narrow << shift); JNI handles always hold the full address.
+class NarrowOopEncoding{
+   public:
+      bool compressed;
+      uint64_t base;
+      int shift;
+
+	NarrowOopEncoding() : compressed(false), base(0), shift(0) {
+	}
+
+	void set(bool _compressed, uint64_t _base, int _shift) {
+		compressed = _compressed;
+		base = _base;
+		shift = _shift;
+	}
+
+	// size of a reference in an object array or field
+	int heapOopSize() {return compressed ? 4 : 8;}
+
+	// work out the encoding by storing a few objects in an Object[] and
+	// comparing the raw elements against the addresses in their handles.
+	// getPtr is the same handle dereference used for object args.
+	// The array has 2 * NUM_PROBES elements, so reading NUM_PROBES 8 byte
+	// words stays inside it even when each element is only 4 bytes.
+	bool discover(JNIEnv *jenv, void *(*getPtr)(jobject)) {
+		static const int NUM_PROBES = 4;
+		jclass objClass = jenv->FindClass("java/lang/Object");
+		jmethodID ctor = jenv->GetMethodID(objClass, "<init>", "()V");
+		jobjectArray probes = jenv->NewObjectArray(2 * NUM_PROBES, objClass, NULL);
+		jobject objs[2 * NUM_PROBES];
+		for (int i=0; i<2 * NUM_PROBES; i++) {
+			objs[i] = jenv->NewObject(objClass, ctor);
+			jenv->SetObjectArrayElement(probes, i, objs[i]);
+		}
+
+		// nothing can move while the array is held critical
+		uint64_t full[NUM_PROBES];
+		uint64_t wide[NUM_PROBES];
+		uint32_t narrow[NUM_PROBES];
+		jboolean isCopy = JNI_FALSE;
+		void *elems = jenv->GetPrimitiveArrayCritical(probes, &isCopy);
+		for (int i=0; i<NUM_PROBES; i++) {
+			full[i] = (uint64_t) getPtr(objs[i]);
+			wide[i] = ((uint64_t *) elems)[i];
+			narrow[i] = ((uint32_t *) elems)[i];
+		}
+		jenv->ReleasePrimitiveArrayCritical(probes, elems, JNI_ABORT);
+
+		for (int i=0; i<2 * NUM_PROBES; i++) {
+			jenv->DeleteLocalRef(objs[i]);
+		}
+		jenv->DeleteLocalRef(probes);
+		jenv->DeleteLocalRef(objClass);
+
+		bool matchesWide = true;
+		for (int i=0; i<NUM_PROBES; i++) {
+			if (wide[i] != full[i]) matchesWide = false;
+		}
+		if (matchesWide) {
+			set(false, 0, 0);
+			return true;
+		}
+		for (int s=0; s<=4; s++) {
+			uint64_t b = full[0] - ((uint64_t) narrow[0] << s);
+			bool matches = true;
+			for (int i=1; i<NUM_PROBES; i++) {
+				if (b + ((uint64_t) narrow[i] << s) != full[i]) matches = false;
+			}
+			if (matches) {
+				set(true, b, s);
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#endif // NARROWOOP_H
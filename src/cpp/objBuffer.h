@@ -49,11 +49,20 @@ class ObjBuffer{
       jobject javaObj;        // The java obj that this arg is mapped to 
       int  arg_idx;             // its position in the arg stack
 
-	ObjBuffer(jobject _javaObj, int _idx, JNIEnv *_jenv):
-		javaObj(_javaObj),
-		arg_idx(_idx) {
+	ObjBuffer(jobject _obj, int _idx, JNIEnv *_jenv):
+		javaObj(NULL) {
+		rebind(_obj, _idx, _jenv);
    }
 
+	// reuse this record for another arg; the weak ref is kept if it is the same java object
+	void rebind(jobject _obj, int _idx, JNIEnv *_jenv) {
+		if (javaObj == NULL || !_jenv->IsSameObject(javaObj, _obj)) {
+			if (javaObj) _jenv->DeleteWeakGlobalRef(javaObj);
+			javaObj = _jenv->NewWeakGlobalRef(_obj);
+		}
+		arg_idx = _idx;
+	}
+
 	void dispose(JNIEnv* _jenv) {
 		if (javaObj) {
          //cout << "deleted weak ref " << javaObj <<endl;
@@ -28,6 +28,12 @@ typedef uint64_t okra_context_t;
 //opaque okra kernel
 typedef uint64_t okra_kernel_t;
 
+typedef uint64_t okra_module_t;
+
+typedef uint64_t okra_pending_kernel_t;
+
+typedef uint64_t okra_bundle_t;
+
 //launch attributes that defines execution range
 typedef struct okra_range_s
 {
@@ -38,6 +44,145 @@ typedef struct okra_range_s
 } okra_range_t;
 
 
+// per-stage times for okra_create_kernels_timed.  Each is the wall time
+// from the first kernel entering the stage to the last one leaving it, so
+// the stages overlap: the assembler threads feed finalize as they go, and
+// fix runs inside assemble.  A stage near wall_ns is the bottleneck.
+typedef struct okra_batch_times_s
+{
+  uint64_t fix_ns;           // ConvertHsail, inlining and the kernarg scan, 0 if every brig was cached
+  uint64_t assemble_ns;      // brig cache, fix, temp files, hsailasm and reading the brig
+  uint64_t finalize_ns;      // createProgram and compileKernel
+  uint64_t wall_ns;          // elapsed time of the whole batch
+  uint32_t threads;          // assembler threads used
+} okra_batch_times_t;
+
+// where the time went creating one kernel, from okra_get_kernel_build_info.
+// Phases a kernel did not go through are zero, e.g. everything before
+// create_program_ns for a kernel created from brig.
+//
+// OKRA_CACHE_DIR=<dir> keeps the brig assembled from hsail text on disk, so
+// a kernel created again from the same text, entry and options skips
+// ConvertHsail and hsailasm.  It is a brig cache only: no native code is
+// cached, createProgram and compileKernel run on every start, and kernels
+// created from brig get nothing from it.
+typedef struct okra_kernel_build_info_s
+{
+  uint64_t convert_ns;        // ConvertHsail and inlining, zero if the text needed neither
+  uint64_t scan_ns;           // kernarg access scan of the hsail
+  uint64_t cache_ns;          // brig cache lookup and store
+  uint64_t write_ns;          // creating and writing the temp hsail file
+  uint64_t assemble_ns;       // the hsailasm process
+  uint64_t read_ns;           // mapping the brig hsailasm wrote
+  uint64_t create_program_ns; // createProgram
+  uint64_t lock_wait_ns;      // waiting for another thread's compileKernel
+  uint64_t compile_kernel_ns; // compileKernel
+  uint64_t total_ns;          // the sum of the above
+  uint32_t cached;            // nonzero if the brig came from the cache
+} okra_kernel_build_info_t;
+
+// build times summed over every kernel a context has created, from
+// okra_get_context_build_info; the cached field of totals is unused
+typedef struct okra_context_build_info_s
+{
+  uint64_t kernels;           // kernels finalized, including module and bundle kernels
+  uint64_t assembled;         // hsail assemblies attempted, cache hits included
+  uint64_t cache_hits;
+  uint64_t failures;          // assemblies or finalizes that failed
+  okra_kernel_build_info_t totals;
+} okra_context_build_info_t;
+
+// one dispatch of a kernel.  marshal_ns and pin_ns are only filled in when
+// the kernel is dispatched through the java interface, apart from the
+// variant selection (and compile on first use) of specialized kernels
+typedef struct okra_dispatch_info_s
+{
+  uint64_t marshal_ns;        // staging array copies, object addresses and variant selection
+  uint64_t pin_ns;            // pinning and unpinning java arrays
+  uint64_t execute_ns;        // wall time of the simulator dispatch
+  uint32_t dims;
+  uint32_t global_size[3];    // work-items in each dimension
+  uint32_t group_size[3];
+  uint64_t work_items;
+  double work_items_per_sec;
+} okra_dispatch_info_t;
+
+// bucket 0 counts dispatches under 1 us and bucket i counts [2^(i-1), 2^i) us,
+// the last bucket also takes anything longer
+#define OKRA_STATS_HISTOGRAM_BUCKETS 32
+
+// cumulative dispatch counters of one kernel, from okra_get_kernel_stats
+typedef struct okra_kernel_stats_s
+{
+  uint64_t dispatches;
+  uint64_t work_items;
+  uint64_t marshal_ns;
+  uint64_t pin_ns;
+  uint64_t execute_ns;
+  uint64_t min_execute_ns;
+  uint64_t max_execute_ns;
+  uint64_t execute_histogram[OKRA_STATS_HISTOGRAM_BUCKETS];
+  okra_dispatch_info_t last;  // the most recent dispatch
+} okra_kernel_stats_t;
+
+// instruction classes of okra_dispatch_counters_t
+typedef enum okra_inst_class_e {
+   OKRA_INST_INT = 0,         // integer and bit arithmetic, compares, lda
+   OKRA_INST_FLOAT,           // floating point arithmetic and compares
+   OKRA_INST_CONVERT,         // cvt
+   OKRA_INST_MOVE,            // mov and work-item/work-group queries
+   OKRA_INST_MEMORY,          // ld and st in any segment
+   OKRA_INST_ATOMIC,
+   OKRA_INST_BRANCH,          // brn, cbr, ret and call
+   OKRA_INST_SYNC,            // barrier, sync and memfence
+   OKRA_INST_OTHER,
+   OKRA_INST_CLASSES
+} okra_inst_class_t;
+
+// what one dispatch of a kernel with counters enabled executed, summed over
+// its work-items.  The simulator runs each work-item on its own so a branch
+// is counted as divergent if it went both ways anywhere in the dispatch.
+typedef struct okra_dispatch_counters_s
+{
+  uint64_t instructions;
+  uint64_t by_class[OKRA_INST_CLASSES];
+  uint64_t global_load_bytes;     // global and flat segment
+  uint64_t global_store_bytes;
+  uint64_t group_load_bytes;
+  uint64_t group_store_bytes;
+  uint64_t atomics;
+  uint64_t barriers;              // barriers reached
+  uint64_t branches;              // conditional branches executed
+  uint64_t branches_taken;
+  uint32_t branch_sites;          // cbr instructions in the kernel
+  uint32_t divergent_branches;    // of those, the ones that were both taken and not taken
+} okra_dispatch_counters_t;
+
+// the counters of every kernel a context has dispatched, summed, from
+// okra_get_context_stats; the last field of totals is unused
+typedef struct okra_context_stats_s
+{
+  uint64_t kernels;           // kernels dispatched at least once
+  okra_kernel_stats_t totals;
+} okra_context_stats_t;
+
+// how a kernel is assembled from hsail; the simulator's finalizer takes no
+// options.  okra_get_compile_profile fills in the named profiles: "default"
+// and "debug" (debug info) and "throughput" (no debug info, inlining).
+// OKRA_COMPILE_PROFILE picks the profile used when no options are given.
+typedef struct okra_compile_options_s
+{
+  uint32_t debug_info;        // nonzero assembles with debug information (hsailasm -g)
+  uint32_t inline_functions;  // nonzero inlines small hsail functions before assembly,
+                              // OKRA_INLINE_THRESHOLD is the size limit (default 32)
+} okra_compile_options_t;
+
+// flags for okra_create_kernel_from_binary_ex
+typedef enum okra_binary_flags_e {
+   OKRA_BINARY_COPY = 0,            // copy the binary, it can be freed after the call
+   OKRA_BINARY_CALLER_OWNED = 1     // use the binary in place, it must outlive the kernel
+} okra_binary_flags_t;
+
 //This is the list of errors that okra supports
 //@Note: Will add more error codes as needed
 typedef enum okra_status_t {
@@ -87,12 +232,105 @@ okra_status_t OKRA_API okra_create_kernel(okra_context_t* context,
                         const char *hsail_source, const char *entryName, 
                         okra_kernel_t **kernel);
 
+// asynchronous creation: queue creation of a kernel on a background thread
+// (OKRA_ASYNC_COMPILE_THREADS) and return at once with a pending handle
+okra_status_t OKRA_API okra_create_kernel_async(okra_context_t* context, 
+                        const char *hsail_source, const char *entryName, 
+                        okra_pending_kernel_t **pending);
+
+// *done is set to 1 once the kernel has been created (or failed), else 0
+okra_status_t OKRA_API okra_pending_kernel_poll(okra_pending_kernel_t* pending, int *done);
+
+// block until the kernel has been created, returns the creation status
+okra_status_t OKRA_API okra_pending_kernel_wait(okra_pending_kernel_t* pending, 
+                        okra_kernel_t **kernel);
+
+// may be called before the kernel is done, the kernel itself is not disposed
+okra_status_t OKRA_API okra_dispose_pending_kernel(okra_pending_kernel_t* pending);
+
+// create count kernels at once, assembling them on a pool of threads
+// (OKRA_COMPILE_THREADS) and finalizing each as it becomes ready.  kernels[i]
+// is NULL for a kernel that failed, the first failure is returned.
+okra_status_t OKRA_API okra_create_kernels(okra_context_t* context, uint32_t count,
+                        const char **hsail_sources, const char **entryNames,
+                        okra_kernel_t **kernels);
+
+okra_status_t OKRA_API okra_create_kernels_timed(okra_context_t* context, uint32_t count,
+                        const char **hsail_sources, const char **entryNames,
+                        okra_kernel_t **kernels, okra_batch_times_t *times);
+
 //create kernel that can be dispatched - takes in binary as input and creates a
 //kernel
 okra_status_t OKRA_API okra_create_kernel_from_binary(okra_context_t *context, 
                         const char *binary, size_t size, const char *entryName,
                         okra_kernel_t **kernel);
 
+// modules: one hsail text or brig holding any number of kernels, assembled
+// and loaded once; each kernel is finalized when it is first looked up
+okra_status_t OKRA_API okra_create_module(okra_context_t* context,
+                        const char *hsail_source, okra_module_t **module);
+
+okra_status_t OKRA_API okra_create_module_from_binary(okra_context_t* context,
+                        const char *binary, size_t size, okra_module_t **module);
+
+// kernels are finalized on first lookup, later lookups return the same kernel
+// and each lookup is matched by an okra_dispose_kernel
+okra_status_t OKRA_API okra_module_get_kernel(okra_module_t* module,
+                        const char *entryName, okra_kernel_t **kernel);
+
+// the module's program and brig are freed once its kernels are disposed too
+okra_status_t OKRA_API okra_dispose_module(okra_module_t* module);
+
+okra_status_t OKRA_API okra_get_compile_profile(const char *name, okra_compile_options_t *options);
+
+// the options used when none are given, from OKRA_COMPILE_PROFILE
+okra_status_t OKRA_API okra_get_default_compile_options(okra_context_t *context,
+                        okra_compile_options_t *options);
+
+// options may be NULL for the defaults
+okra_status_t OKRA_API okra_create_kernel_with_options(okra_context_t* context, 
+                        const char *hsail_source, const char *entryName, 
+                        const okra_compile_options_t *options, okra_kernel_t **kernel);
+
+// from length bytes of hsail that need not be nul terminated, the text is
+// only copied if it has to be rewritten.  options may be NULL.
+okra_status_t OKRA_API okra_create_kernel_from_buffer(okra_context_t* context, 
+                        const char *hsail_source, size_t length, const char *entryName, 
+                        const okra_compile_options_t *options, okra_kernel_t **kernel);
+
+okra_status_t OKRA_API okra_create_kernel_from_binary_ex(okra_context_t *context, 
+                        const char *binary, size_t size, const char *entryName,
+                        uint32_t flags, okra_kernel_t **kernel);
+
+// map a brig file (shared through the page cache) instead of reading it
+okra_status_t OKRA_API okra_create_kernel_from_file(okra_context_t *context, 
+                        const char *path, const char *entryName,
+                        okra_kernel_t **kernel);
+
+// kernel bundles hold brig assembled ahead of time (by okra-aot or
+// okra_write_bundle) and are mapped when opened, kernels are created from
+// them with no assembly.  Kernels are found by the name given when the
+// bundle was written or by the hash of their hsail source; entryName may be
+// NULL to take the first entry.
+okra_status_t OKRA_API okra_write_bundle(okra_context_t *context, const char *path,
+                        int numKernels, const char **names, const char **hsail_sources,
+                        const char **entryNames);
+
+okra_status_t OKRA_API okra_open_bundle(okra_context_t *context, const char *path,
+                        okra_bundle_t **bundle);
+
+okra_status_t OKRA_API okra_bundle_create_kernel(okra_bundle_t *bundle,
+                        const char *name, const char *entryName, okra_kernel_t **kernel);
+
+okra_status_t OKRA_API okra_bundle_create_kernel_by_hash(okra_bundle_t *bundle,
+                        uint64_t sourceHash, const char *entryName, okra_kernel_t **kernel);
+
+uint64_t OKRA_API okra_hash_hsail_source(const char *hsail_source);
+
+// the mapping is kept until the bundle's kernels are disposed too; like
+// module kernels, each lookup of a bundle kernel is matched by okra_dispose_kernel
+okra_status_t OKRA_API okra_dispose_bundle(okra_bundle_t *bundle);
+
 //Following are set of apis to push kernel args to the kernel
 //for pointers and objects
 okra_status_t OKRA_API okra_push_pointer(okra_kernel_t* kernel, 
@@ -126,6 +364,71 @@ okra_status_t OKRA_API okra_push_long(okra_kernel_t* kernel,
 
 // Call clearargs between executions of a kernel before setting the new args
 okra_status_t OKRA_API okra_clear_args(okra_kernel_t* kernel);
+
+// mark the scalar kernarg at index as a specialization constant; each set of
+// values pushed for the marked args gets its own variant of the kernel,
+// compiled with the values substituted, and the generic kernel is used if a
+// variant can't be made.  OKRA_SPECIALIZE_LIMIT caps the variants per kernel (default 16).
+// A variant is compiled on the dispatch that first pushes its values, without
+// blocking other dispatches of the kernel.  Every kernel created from hsail
+// text keeps a copy of that text for specialization and instrumentation.
+// OKRA_INVALID_ARGUMENT if the kernarg is a pointer or can't be substituted.
+okra_status_t OKRA_API okra_kernel_specialize_arg(okra_kernel_t* kernel, uint32_t index);
+
+// per-phase times of the kernel's creation
+okra_status_t OKRA_API okra_get_kernel_build_info(okra_kernel_t* kernel, okra_kernel_build_info_t *info);
+
+// build times summed over all kernels created by the context so far
+okra_status_t OKRA_API okra_get_context_build_info(okra_context_t* context, okra_context_build_info_t *info);
+
+// dispatch counters of the kernel.  OKRA_STATS=1 prints a summary of every
+// kernel dispatched when the process exits.
+okra_status_t OKRA_API okra_get_kernel_stats(okra_kernel_t* kernel, okra_kernel_stats_t *stats);
+
+// dispatch counters summed over all kernels the context has dispatched
+okra_status_t OKRA_API okra_get_context_stats(okra_context_t* context, okra_context_stats_t *stats);
+
+// run later dispatches of the kernel as a variant that counts what it
+// executes, at some cost in speed.  Only for kernels created from hsail text,
+// and specialized kernargs are not substituted while counters are on.
+okra_status_t OKRA_API okra_kernel_enable_counters(okra_kernel_t* kernel, uint32_t enable);
+
+// the counters of the kernel's last dispatch with counters enabled
+okra_status_t OKRA_API okra_get_dispatch_counters(okra_kernel_t* kernel, okra_dispatch_counters_t *counters);
+
+// write the kernel's hsail annotated with how often each line executed, over
+// every dispatch made with counters enabled, with the hottest lines listed
+// first.  OKRA_PROFILE=<dir> enables counters for every kernel created from
+// hsail and writes a profile of each dispatched kernel to <dir> at exit.
+okra_status_t OKRA_API okra_kernel_write_profile(okra_kernel_t* kernel, const char *path);
+
+// append the register writes of work-items first_item .. first_item+num_items-1
+// (absolute ids in dimension 0) in later dispatches of the kernel to path, as
+// compact binary records that okra-regtrace decodes.  Each work-item keeps
+// its last records_per_item writes (rounded up to a power of two); num_items
+// 0 stops tracing.  Only for kernels created from hsail, and counters are
+// not counted while registers are traced.  OKRA_REG_TRACE=<file> with
+// OKRA_REG_TRACE_KERNEL, OKRA_REG_TRACE_ITEMS=<first>[:<count>] and
+// OKRA_REG_TRACE_RECORDS does the same without code changes.
+okra_status_t OKRA_API okra_kernel_trace_registers(okra_kernel_t* kernel, uint32_t first_item, uint32_t num_items,
+                                                   uint32_t records_per_item, const char *path);
+
+// record the addresses of the global loads, stores and atomics made by
+// work-groups first_group .. first_group+num_groups-1 (in dimension 0) in
+// later dispatches of the kernel, the first records_per_item of each
+// work-item; num_groups 0 stops tracing.  Only for kernels created from
+// hsail, and counters are not counted while accesses are traced.
+okra_status_t OKRA_API okra_kernel_trace_memory(okra_kernel_t* kernel, uint32_t first_group, uint32_t num_groups,
+                                                uint32_t records_per_item);
+
+// write a locality report of the accesses traced so far: per access, how
+// its wavefronts coalesce and the strides between neighbouring lanes; the
+// reuse distance of cache lines within work-groups; and the bytes accessed
+// and touched through each pointer kernarg.  OKRA_MEM_TRACE=<dir> traces
+// every kernel created from hsail (OKRA_MEM_TRACE_GROUPS=<first>[:<count>]
+// and OKRA_MEM_TRACE_RECORDS choose the sample) and writes their reports to
+// <dir> at exit.
+okra_status_t OKRA_API okra_kernel_write_memory_report(okra_kernel_t* kernel, const char *path);
 //end of kernel arg related APIs
 
 //execute the kernel - takes kernel, execution range as input
@@ -134,7 +437,8 @@ okra_status_t OKRA_API okra_clear_args(okra_kernel_t* kernel);
 //will choose appropriate groupsize
 okra_status_t OKRA_API okra_execute_kernel(okra_context_t* context, okra_kernel_t* kernel, okra_range_t* range);
 
-//cleanup kernel
+//cleanup kernel, along with its specialized and instrumented variants; the
+//counters of a kernel that was dispatched are kept for the reports at exit
 okra_status_t OKRA_API okra_dispose_kernel(okra_kernel_t* kernel);
 
 //cleanup any resource allocated by okra context
@@ -0,0 +1,157 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// okra-aot: assemble hsail kernels ahead of time into one bundle file that
+// okra_open_bundle maps at run time.
+//
+//   okra-aot -o kernels.okb [-e defaultEntry] [-v] file.hsail[:&entry] ...
+//
+// Each kernel is stored under the file's base name (without extension) and its
+// entry, which defaults to &run.  Kernels can also be found by the hash of
+// the file's text, see okra_hash_hsail_source.
+
+#include "okra.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static void usage() {
+	fprintf(stderr, "usage: okra-aot -o bundle [-e defaultEntry] [-v] file.hsail[:&entry] ...\n");
+}
+
+static bool readText(const string &path, string &text) {
+	ifstream in(path.c_str(), ios::in | ios::binary);
+	if (!in) {
+		return false;
+	}
+	ostringstream contents;
+	contents << in.rdbuf();
+	text = contents.str();
+	return true;
+}
+
+static string kernelName(const string &path) {
+	size_t slash = path.rfind('/');
+	string base = (slash == string::npos ? path : path.substr(slash + 1));
+	size_t dot = base.rfind('.');
+	return (dot == string::npos || dot == 0 ? base : base.substr(0, dot));
+}
+
+int main(int argc, char **argv) {
+	const char *outPath = NULL;
+	string defaultEntry = "&run";
+	bool verbose = false;
+	vector<string> paths;
+	vector<string> entries;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			outPath = argv[++i];
+		} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			defaultEntry = argv[++i];
+		} else if (strcmp(argv[i], "-v") == 0) {
+			verbose = true;
+		} else if (argv[i][0] == '-') {
+			usage();
+			return 1;
+		} else {
+			// an entry is given after the last ':' and starts with '&'
+			string arg = argv[i];
+			size_t colon = arg.rfind(':');
+			if (colon != string::npos && colon + 1 < arg.size() && arg[colon + 1] == '&') {
+				paths.push_back(arg.substr(0, colon));
+				entries.push_back(arg.substr(colon + 1));
+			} else {
+				paths.push_back(arg);
+				entries.push_back("");
+			}
+		}
+	}
+	if (outPath == NULL || paths.empty()) {
+		usage();
+		return 1;
+	}
+
+	int numKernels = paths.size();
+	vector<string> sources(numKernels);
+	vector<string> names(numKernels);
+	for (int i = 0; i < numKernels; i++) {
+		if (!readText(paths[i], sources[i])) {
+			fprintf(stderr, "okra-aot: cannot read %s\n", paths[i].c_str());
+			return 1;
+		}
+		names[i] = kernelName(paths[i]);
+		if (entries[i].empty()) {
+			entries[i] = defaultEntry;
+		}
+	}
+
+	okra_context_t *context = NULL;
+	if (okra_get_context(&context) != OKRA_SUCCESS) {
+		fprintf(stderr, "okra-aot: cannot create okra context\n");
+		return 1;
+	}
+
+	vector<const char *> namePtrs(numKernels), sourcePtrs(numKernels), entryPtrs(numKernels);
+	for (int i = 0; i < numKernels; i++) {
+		namePtrs[i] = names[i].c_str();
+		sourcePtrs[i] = sources[i].c_str();
+		entryPtrs[i] = entries[i].c_str();
+	}
+	okra_status_t status = okra_write_bundle(context, outPath, numKernels, &namePtrs[0], &sourcePtrs[0], &entryPtrs[0]);
+	if (status != OKRA_SUCCESS) {
+		fprintf(stderr, "okra-aot: writing %s failed (status %d)\n", outPath, (int) status);
+		return 1;
+	}
+	if (verbose) {
+		for (int i = 0; i < numKernels; i++) {
+			printf("%s %s %016llx\n", names[i].c_str(), entries[i].c_str(),
+				   (unsigned long long) okra_hash_hsail_source(sources[i].c_str()));
+		}
+	}
+	return 0;
+}
@@ -47,12 +47,23 @@
 
 #include "okra.h"
 #include "cCommon.h"
+#include "okraLog.h"
 
 // Abstract interface to an Okra Implementation
 class OkraContext{
 public:
 	class Kernel {
 	public:
+		// how a kernel uses the memory behind a pointer argument
+		enum ArgAccess {
+			ARG_ACCESS_DEFAULT = 0,       // not specified, infer it from the kernel
+			ARG_ACCESS_READ_ONLY = 1,
+			ARG_ACCESS_WRITE_ONLY = 2,
+			ARG_ACCESS_READ_WRITE = 3
+		};
+
+		virtual ~Kernel() {}
+
 		// various methods for setting different types of args into the arg stack
 		virtual okra_status_t  pushFloatArg(jfloat) = 0;
 		virtual okra_status_t  pushIntArg(jint) = 0;
@@ -64,6 +75,51 @@ public:
 		virtual okra_status_t  clearArgs() = 0;
 		// allow a previously pushed arg to be changed
 		virtual bool setPointerArg(int idx, void *addr) = 0;
+		// access inferred from the kernel source for the arg at idx (ARG_ACCESS_READ_WRITE if unknown)
+		virtual int getArgAccess(int idx) = 0;
+
+		// treat the scalar kernarg at idx as a specialization constant: dispatches
+		// use a variant compiled with the pushed value substituted, made the first
+		// time that value is seen.  Only for kernels created from hsail text.
+		virtual okra_status_t specializeArg(int idx) = 0;
+
+		// per-phase times of this kernel's creation
+		virtual void getBuildInfo(okra_kernel_build_info_t *info) = 0;
+
+		// cumulative dispatch counters and the last dispatch
+		virtual void getStats(okra_kernel_stats_t *stats) = 0;
+
+		// host side times of the dispatch just completed, for callers (like
+		// the java interface) that marshal and pin args around the dispatch
+		virtual void addDispatchHostTimes(uint64_t marshalNanos, uint64_t pinNanos) = 0;
+
+		// dispatch an instrumented variant that counts instructions, memory
+		// bytes, atomics, barriers and branches.  Only for kernels created
+		// from hsail text.
+		virtual okra_status_t enableCounters(bool enable) = 0;
+
+		// the counters of the last dispatch made with counters enabled
+		virtual okra_status_t getDispatchCounters(okra_dispatch_counters_t *counters) = 0;
+
+		// write the hsail source annotated with the instructions each line
+		// executed over all dispatches made with counters enabled, hottest first
+		virtual okra_status_t writeProfile(const char *path) = 0;
+
+		// dispatch an instrumented variant that appends the register writes
+		// of work-items [firstItem, firstItem + numItems) to path, the last
+		// recordsPerItem of each.  numItems 0 stops tracing.  Only for
+		// kernels created from hsail text.
+		virtual okra_status_t traceRegisters(uint32_t firstItem, uint32_t numItems, uint32_t recordsPerItem, const char *path) = 0;
+
+		// dispatch an instrumented variant that records the global accesses
+		// of work-groups [firstGroup, firstGroup + numGroups), the first
+		// recordsPerItem of each work-item.  numGroups 0 stops tracing.
+		// Only for kernels created from hsail text.
+		virtual okra_status_t traceMemory(uint32_t firstGroup, uint32_t numGroups, uint32_t recordsPerItem) = 0;
+
+		// write the coalescing, strides, reuse distances and bytes per
+		// kernarg of the accesses traced so far
+		virtual okra_status_t writeMemoryReport(const char *path) = 0;
 
 		// setting number of dimensions and sizes of each
 		virtual okra_status_t setLaunchAttributes(int dims, uint32_t *globalDims, uint32_t *localDims) = 0;
@@ -75,16 +131,109 @@ public:
                 virtual okra_status_t dispose() = 0;
 	};
 
+	// called on the compile thread once an asynchronous kernel creation finishes
+	typedef void (*AsyncKernelCallback)(void *arg, okra_status_t status, Kernel *kernel);
+
+	// handle for a kernel being created in the background
+	class PendingKernel {
+	public:
+		virtual ~PendingKernel() {}
+
+		// whether creation has finished (successfully or not)
+		virtual bool isDone() = 0;
+
+		// block until creation has finished, then return its status and kernel
+		virtual okra_status_t wait(Kernel **kernel) = 0;
+
+		// the handle may be disposed before creation finishes, the kernel is still created
+		virtual okra_status_t dispose() = 0;
+	};
+
+	// queue creation of a kernel on a bounded pool of background threads.
+	// source and entryName are copied.  callback may be NULL.
+	virtual okra_status_t createKernelAsync(const char *source, const char *entryName, PendingKernel **pending,
+											AsyncKernelCallback callback, void *callbackArg) = 0;
+
+	// a set of kernels assembled and loaded together; each kernel is
+	// finalized the first time it is looked up and then returned again
+	// for later lookups of the same entry name
+	class Module {
+	public:
+		virtual okra_status_t getKernel(const char *entryName, Kernel **kernel) = 0;
+
+		virtual okra_status_t dispose() = 0;
+	};
+
+	// create a module from HSAIL text holding any number of kernels
+	virtual okra_status_t createModule(const char *source, Module **module) = 0;
+
+	// create a module from a Brig binary holding any number of kernels
+	virtual okra_status_t createModuleFromBinary(const char *binary, size_t size, Module **module) = 0;
+
+	// kernels assembled ahead of time into a bundle file (see okra-aot), the
+	// bundle is mapped and kernels are created from it with no assembly step.
+	// Like module kernels they are created once per entry and returned again.
+	class Bundle {
+	public:
+		virtual ~Bundle() {}
+
+		// entryName may be NULL for the first entry stored under name
+		virtual okra_status_t createKernel(const char *name, const char *entryName, Kernel **kernel) = 0;
+
+		// sourceHash is okra_hash_hsail_source of the text the kernel was assembled from
+		virtual okra_status_t createKernelBySourceHash(uint64_t sourceHash, const char *entryName, Kernel **kernel) = 0;
+
+		// the mapping is kept until the kernels created from it are disposed too
+		virtual okra_status_t dispose() = 0;
+	};
+
+	virtual okra_status_t openBundle(const char *path, Bundle **bundle) = 0;
+
+	// assemble numKernels kernels in parallel and write their brig to a bundle file
+	virtual okra_status_t writeBundle(const char *path, int numKernels, const char **names,
+									  const char **sources, const char **entryNames) = 0;
+
 	// create a kernel object from the specified HSAIL text source and entrypoint
 	virtual okra_status_t createKernel(const char *source, const char *entryName, Kernel ** kernel) = 0;
 
+	// as above with explicit compile options, NULL for the defaults
+	virtual okra_status_t createKernel(const char *source, const char *entryName, const okra_compile_options_t *options, Kernel ** kernel) = 0;
+
+	// from length bytes of HSAIL text that need not be nul terminated.  The text
+	// is only copied if it has to be rewritten, and it is not kept past the call
+	virtual okra_status_t createKernel(const char *source, size_t length, const char *entryName, const okra_compile_options_t *options, Kernel ** kernel) = 0;
+
+	// fill in a named profile, "default", "debug" or "throughput"
+	static okra_status_t getCompileProfile(const char *name, okra_compile_options_t *options);
+
+	// the options used when none are given, OKRA_COMPILE_PROFILE names the profile
+	virtual void getDefaultCompileOptions(okra_compile_options_t *options) = 0;
+
+	// build times summed over every kernel this context has created
+	virtual void getBuildInfo(okra_context_build_info_t *info) = 0;
+
+	// dispatch counters summed over every kernel this context has dispatched
+	virtual void getStats(okra_context_stats_t *stats) = 0;
+
+	// create numKernels kernels at once, assembling in parallel; kernels[i] is NULL
+	// for any that failed and the first failure is returned.  times may be NULL.
+	virtual okra_status_t createKernels(int numKernels, const char **sources, const char **entryNames, Kernel **kernels, okra_batch_times_t *times) = 0;
+
 	// create a kernel object from the specified Brig binary source and entrypoint
 	virtual okra_status_t createKernelFromBinary(const char *binary, size_t size, const char *entryName, Kernel** kernel) = 0;
 
+	// as above, but if callerOwnsBuffer the binary is used in place rather than copied,
+	// so it must stay alive (and unchanged) as long as the kernel is in use
+	virtual okra_status_t createKernelFromBinary(const char *binary, size_t size, const char *entryName, Kernel** kernel, bool callerOwnsBuffer) = 0;
+
+	// create a kernel object from a Brig file, which is mapped rather than read
+	virtual okra_status_t createKernelFromFile(const char *path, const char *entryName, Kernel** kernel) = 0;
+
         //dispose the context
         virtual okra_status_t dispose() = 0;
 
-	void setVerbose(bool b) {verbose = b;}
+	// verbose also raises the log levels OKRA_LOG doesn't set to debug, see okraLog.h
+	void setVerbose(bool b) {verbose = b; okraLogSetVerbose(b);}
 	bool isVerbose() {return verbose;}
 
 	static okra_status_t getContext(OkraContext** context);
@@ -44,12 +44,27 @@
 //for hsa
 #include "hsa.h"
 #include "fix_hsail.h"
+#include "kernargAccess.h"
+#include "kernelBundle.h"
+#include "hsailInline.h"
+#include "hsailSpecialize.h"
+#include "hsailCounters.h"
+#include "hsailRegTrace.h"
+#include "hsailMemTrace.h"
 #include "okraContext.h"
 #include "fileUtils.h"
+#include "timeUtils.h"
+#include "okraTrace.h"
+#include "okraPerfMap.h"
+#include "okraMetrics.h"
+#include "okraLog.h"
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <deque>
+#include <map>
+#include <algorithm>
 #include "stdio.h"
 #include "pthread.h"
 
@@ -97,19 +112,320 @@ class OkraContextSimulatorImpl : public OkraContext {
 	friend okra_status_t OkraContext::getContext(OkraContext**); 
 	
 private:
+	// memory holding brig that goes when the kernel or module using it does:
+	// a copy is freed and a mapping unmapped.  Neither is set for brig that
+	// belongs to the caller or to a bundle.
+	struct BrigStorage {
+		char *copy;
+		char *mapBase;
+		size_t mapSize;
+
+		BrigStorage() : copy(NULL), mapBase(NULL), mapSize(0) {}
+
+		void release() {
+			free(copy);
+			if (mapBase != NULL) {
+				munmap(mapBase, mapSize);
+			}
+			copy = mapBase = NULL;
+		}
+	};
+
+	class KernelImpl;
+
+	// a module or bundle, which its kernels keep alive: the handle holds one
+	// reference and every kernel created from it another
+	class KernelOwner {
+	public:
+		KernelOwner() : refs(1) {}
+		virtual ~KernelOwner() {}
+
+		void retain() {
+			__sync_fetch_and_add(&refs, 1);
+		}
+
+		void release() {
+			if (__sync_sub_and_fetch(&refs, 1) == 0) delete this;
+		}
+
+		// called when the kernel is disposed; false while it is still held
+		// from an earlier lookup, otherwise the owner drops it so the next
+		// lookup creates it afresh
+		virtual bool forget(KernelImpl *kernel) = 0;
+
+	private:
+		int refs;
+	};
+
 	class KernelImpl : public OkraContext::Kernel {
 	public:
 		hsa::Kernel* hsaKernel;
 		OkraContextSimulatorImpl* context;
+		// the program the kernel was compiled from, if the kernel is its only
+		// user (NULL for module kernels), and the brig it was created from
+		hsa::Program *hsaProgram;
+		BrigStorage brig;
+		// the module or bundle the kernel came from, NULL if none, and the lookups
+		// that returned it, each of which is disposed (under the owner's lock)
+		KernelOwner *owner;
+		int lookups;
 		//add hsaargs here
 		hsacommon::vector<hsa::KernelArg> hsaArgs;
 		
 		//Hsa launch attributes
 		hsa::LaunchAttributes hsaLaunchAttr;
+
+		// per-kernarg access inferred from the hsail source, empty if created from brig
+		vector<int> argAccess;
+
+		// what the kernel was created from, kept for specialization and for the
+		// instrumented variants (counters, profiles, register and memory traces),
+		// which can be asked for at any time.  This keeps the hsail text resident
+		// for the kernel's lifetime; source is empty if created from brig, and
+		// specialized variants drop theirs.
+		string source;
+		string entryName;
+		okra_compile_options_t options;
+
+		// specialized kernarg indices and the variants compiled so far, keyed by
+		// their values; a NULL variant is one that failed and uses this kernel.
+		// variantGeneration changes whenever the set of args does, so a variant
+		// compiled (outside the lock) for the old set is not kept.
+		vector<int> specializedArgs;
+		vector<HsailKernarg> kernargs;
+		map<vector<uint64_t>, KernelImpl *> variants;
+		uint32_t variantGeneration;
+		pthread_mutex_t variantsMutex;
+
+		okra_kernel_build_info_t buildInfo;
+
+		// dispatch counters, a specialized kernel counts its variants' dispatches
+		int launchDims;
+		okra_kernel_stats_t stats;
+		pthread_mutex_t statsMutex;
+
+		// the instrumented variant dispatched while counters are enabled, with
+		// what each of its blocks holds and the block counts it fills in
+		bool countersEnabled;
+		KernelImpl *countingKernel;
+		vector<HsailBlockCounts> counterBlocks;
+		vector<uint64_t> blockExecs;
+		okra_dispatch_counters_t lastCounters;
+		bool haveCounters;
+
+		// block counts summed over every counted dispatch, for profiles
+		vector<HsailInstructionLine> counterLines;
+		vector<uint64_t> profileExecs;
+		uint64_t profileDispatches;
+		uint64_t profileNanos;
+
+		// the instrumented variant dispatched while registers are traced, the
+		// rings its work-items write to and where they are appended
+		KernelImpl *regTraceKernel;
+		HsailRegTraceInfo regTraceInfo;
+		vector<uint64_t> regTraceBuffer;
+		uint32_t regTraceFirst;
+		uint32_t regTraceItems;
+		uint32_t regTraceRecords;
+		uint32_t regTraceDispatches;
+		string regTracePath;
+
+		// the instrumented variant dispatched while global accesses are
+		// traced, the buffer of the sampled work-items and the report so far
+		KernelImpl *memTraceKernel;
+		HsailMemReport memReport;
+		vector<uint64_t> memTraceBuffer;
+		uint32_t memTraceFirstGroup;
+		uint32_t memTraceGroups;
+		uint32_t memTraceRecords;
+		bool memTracing;
+
+		// OKRA_PROFILE, OKRA_REG_TRACE and OKRA_MEM_TRACE are applied at the first dispatch
+		bool envChecked;
 		
 		KernelImpl(hsa::Kernel* _hsaKernel, OkraContextSimulatorImpl* _context) {
 			hsaKernel = _hsaKernel;
 			context = _context;
+			hsaProgram = NULL;
+			owner = NULL;
+			lookups = 0;
+			pthread_mutex_init(&variantsMutex, NULL);
+			variantGeneration = 0;
+			memset(&buildInfo, 0, sizeof(buildInfo));
+			launchDims = 0;
+			memset(&stats, 0, sizeof(stats));
+			pthread_mutex_init(&statsMutex, NULL);
+			countersEnabled = false;
+			countingKernel = NULL;
+			haveCounters = false;
+			profileDispatches = 0;
+			profileNanos = 0;
+			regTraceKernel = NULL;
+			regTraceFirst = regTraceItems = regTraceRecords = 0;
+			regTraceDispatches = 0;
+			memTraceKernel = NULL;
+			memset(memReport.reuse, 0, sizeof(memReport.reuse));
+			memReport.dispatches = memReport.workItems = memReport.records = memReport.dropped = 0;
+			memTraceFirstGroup = memTraceGroups = memTraceRecords = 0;
+			memTracing = false;
+			envChecked = false;
+		}
+
+		~KernelImpl() {
+			pthread_mutex_destroy(&variantsMutex);
+			pthread_mutex_destroy(&statsMutex);
+		}
+
+		void getBuildInfo(okra_kernel_build_info_t *info) {
+			*info = buildInfo;
+		}
+
+		void getStats(okra_kernel_stats_t *_stats) {
+			pthread_mutex_lock(&statsMutex);
+			*_stats = stats;
+			pthread_mutex_unlock(&statsMutex);
+		}
+
+		okra_status_t enableCounters(bool enable) {
+			if (!enable) {
+				countersEnabled = false;
+				return OKRA_SUCCESS;
+			}
+			if (source.empty()) return OKRA_INVALID_ARGUMENT;
+			if (countingKernel == NULL) {
+				string instrumented = source;
+				vector<HsailBlockCounts> blocks;
+				vector<HsailInstructionLine> lines;
+				if (!instrumentHsailKernel(instrumented, entryName.c_str(), blocks, &lines)) {
+					OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "can't instrument " << entryName);
+					return OKRA_INVALID_ARGUMENT;
+				}
+				Kernel *kernel = NULL;
+				okra_status_t status = context->createKernel(instrumented.c_str(), entryName.c_str(), &options, &kernel);
+				if (status != OKRA_SUCCESS) return status;
+				countingKernel = (KernelImpl *) kernel;
+				counterBlocks.swap(blocks);
+				counterLines.swap(lines);
+				blockExecs.assign(counterBlocks.size(), 0);
+				profileExecs.assign(counterBlocks.size(), 0);
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "instrumented " << entryName << " with " << counterBlocks.size() << " block counters");
+			}
+			countersEnabled = true;
+			return OKRA_SUCCESS;
+		}
+
+		okra_status_t writeProfile(const char *path) {
+			pthread_mutex_lock(&statsMutex);
+			if (profileDispatches == 0) {
+				pthread_mutex_unlock(&statsMutex);
+				return OKRA_INVALID_ARGUMENT;
+			}
+			FILE *file = fopen(path, "w");
+			if (file != NULL) {
+				writeHsailProfile(file, source, entryName.c_str(), counterLines, profileExecs, profileDispatches, profileNanos);
+				fclose(file);
+			}
+			pthread_mutex_unlock(&statsMutex);
+			return (file == NULL ? OKRA_INVALID_ARGUMENT : OKRA_SUCCESS);
+		}
+
+		okra_status_t traceRegisters(uint32_t firstItem, uint32_t numItems, uint32_t recordsPerItem, const char *path) {
+			if (numItems == 0) {
+				regTracePath.clear();
+				return OKRA_SUCCESS;
+			}
+			if (source.empty() || path == NULL || *path == '\0' || recordsPerItem == 0) return OKRA_INVALID_ARGUMENT;
+			recordsPerItem = hsailRegTraceRecordsPerItem(recordsPerItem);
+			// a header and the records of each work-item, capped at 1GB
+			size_t words = (size_t) numItems * (2 + 2 * (size_t) recordsPerItem);
+			if (words > (1UL << 27)) return OKRA_INVALID_ARGUMENT;
+			if (regTraceKernel == NULL || firstItem != regTraceFirst || numItems != regTraceItems || recordsPerItem != regTraceRecords) {
+				// the range and ring size are compiled into the variant
+				string instrumented = source;
+				HsailRegTraceInfo info;
+				if (!instrumentHsailRegTrace(instrumented, entryName.c_str(), firstItem, numItems, recordsPerItem, info)) {
+					OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "can't instrument " << entryName << " for register tracing");
+					return OKRA_INVALID_ARGUMENT;
+				}
+				Kernel *kernel = NULL;
+				okra_status_t status = context->createKernel(instrumented.c_str(), entryName.c_str(), &options, &kernel);
+				if (status != OKRA_SUCCESS) return status;
+				regTraceKernel = (KernelImpl *) kernel;
+				regTraceInfo = info;
+				regTraceFirst = firstItem;
+				regTraceItems = numItems;
+				regTraceRecords = recordsPerItem;
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "tracing " << regTraceInfo.statements.size() << " register writes of " << entryName
+						 << ", work-items " << firstItem << "-" << firstItem + numItems - 1);
+			}
+			regTraceBuffer.assign(words, 0);
+			regTracePath = path;
+			return OKRA_SUCCESS;
+		}
+
+		okra_status_t traceMemory(uint32_t firstGroup, uint32_t numGroups, uint32_t recordsPerItem) {
+			if (numGroups == 0) {
+				memTracing = false;
+				return OKRA_SUCCESS;
+			}
+			if (source.empty() || recordsPerItem < 2) return OKRA_INVALID_ARGUMENT;
+			if (memTraceKernel == NULL || recordsPerItem != memTraceRecords) {
+				// the buffer size is compiled into the variant
+				string instrumented = source;
+				vector<HsailMemAccess> accesses;
+				if (!instrumentHsailMemTrace(instrumented, entryName.c_str(), recordsPerItem, accesses)) {
+					OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "can't instrument " << entryName << " for memory tracing");
+					return OKRA_INVALID_ARGUMENT;
+				}
+				Kernel *kernel = NULL;
+				okra_status_t status = context->createKernel(instrumented.c_str(), entryName.c_str(), &options, &kernel);
+				if (status != OKRA_SUCCESS) return status;
+				memTraceKernel = (KernelImpl *) kernel;
+				memTraceRecords = recordsPerItem;
+				pthread_mutex_lock(&statsMutex);
+				if (memReport.accesses.empty()) memReport.accesses.swap(accesses);
+				pthread_mutex_unlock(&statsMutex);
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "tracing " << memReport.accesses.size() << " global accesses of " << entryName);
+			}
+			if (kernargs.empty()) {
+				findHsailKernargs(stripHsailComments(source.c_str()), entryName.c_str(), kernargs);
+			}
+			memTraceFirstGroup = firstGroup;
+			memTraceGroups = numGroups;
+			memTracing = true;
+			return OKRA_SUCCESS;
+		}
+
+		okra_status_t writeMemoryReport(const char *path) {
+			pthread_mutex_lock(&statsMutex);
+			if (memReport.dispatches == 0) {
+				pthread_mutex_unlock(&statsMutex);
+				return OKRA_INVALID_ARGUMENT;
+			}
+			FILE *file = fopen(path, "w");
+			if (file != NULL) {
+				writeHsailMemReport(file, memReport, entryName.c_str(), kernargs);
+				fclose(file);
+			}
+			pthread_mutex_unlock(&statsMutex);
+			return (file == NULL ? OKRA_INVALID_ARGUMENT : OKRA_SUCCESS);
+		}
+
+		okra_status_t getDispatchCounters(okra_dispatch_counters_t *counters) {
+			pthread_mutex_lock(&statsMutex);
+			bool have = haveCounters;
+			if (have) *counters = lastCounters;
+			pthread_mutex_unlock(&statsMutex);
+			return (have ? OKRA_SUCCESS : OKRA_INVALID_ARGUMENT);
+		}
+
+		void addDispatchHostTimes(uint64_t marshalNanos, uint64_t pinNanos) {
+			pthread_mutex_lock(&statsMutex);
+			stats.last.marshal_ns += marshalNanos;
+			stats.last.pin_ns += pinNanos;
+			stats.marshal_ns += marshalNanos;
+			stats.pin_ns += pinNanos;
+			pthread_mutex_unlock(&statsMutex);
 		}
 	
 		okra_status_t argsPushBack(hsa::KernelArg *harg) {
@@ -158,7 +474,7 @@ private:
 			//add the kernelarg for hsa runtime into the vector
 			hsa::KernelArg harg;
 			harg.addr = addr;
-			if (context->isVerbose()) cerr<<"pushPointerArg, addr=" << addr <<endl;
+			OKRA_LOG(OKRA_LOG_ARGS, OKRA_LOG_TRACE, "pushPointerArg, addr=" << addr);
 			return argsPushBack(&harg);
 		}
 
@@ -166,22 +482,147 @@ private:
 		bool setPointerArg(int idx, void *addr) {
 			hsa::KernelArg harg;
 			harg.addr = addr;
-			if (context->isVerbose()) cerr<<"setPointerArg, addr=" << addr <<endl;
+			OKRA_LOG(OKRA_LOG_ARGS, OKRA_LOG_TRACE, "setPointerArg, addr=" << addr);
 			hsaArgs.at(idx) = harg;
 			return true;
 		}
 
+		int getArgAccess(int idx) {
+			if (idx < 0 || idx >= argAccess.size()) return ARG_ACCESS_READ_WRITE;
+			return argAccess[idx];
+		}
+
 		okra_status_t clearArgs() {
 			hsaArgs.clear();
 			return OKRA_SUCCESS;
 		}
 
+		okra_status_t specializeArg(int idx) {
+			if (source.empty()) return OKRA_INVALID_ARGUMENT;
+			if (kernargs.empty()) {
+				findHsailKernargs(stripHsailComments(source.c_str()), entryName.c_str(), kernargs);
+			}
+			if (idx < 0 || idx >= kernargs.size()) return OKRA_INVALID_ARGUMENT;
+			// check up front that every use of the kernarg can be substituted
+			string trial = source;
+			map<int, uint64_t> values;
+			values[idx] = 0;
+			if (!specializeHsailKernargs(trial, entryName.c_str(), values)) {
+				OKRA_LOG(OKRA_LOG_ARGS, OKRA_LOG_DEBUG, "kernarg " << idx << " can't be specialized");
+				return OKRA_INVALID_ARGUMENT;
+			}
+			pthread_mutex_lock(&variantsMutex);
+			if (std::find(specializedArgs.begin(), specializedArgs.end(), idx) == specializedArgs.end()) {
+				specializedArgs.push_back(idx);
+				std::sort(specializedArgs.begin(), specializedArgs.end());
+				// the variants are keyed by the old set of args
+				for (map<vector<uint64_t>, KernelImpl *>::iterator it = variants.begin(); it != variants.end(); it++) {
+					if (it->second != NULL) it->second->dispose();
+				}
+				variants.clear();
+				variantGeneration++;
+			}
+			pthread_mutex_unlock(&variantsMutex);
+			return OKRA_SUCCESS;
+		}
+
 		okra_status_t dispatchKernelWaitComplete(OkraContext* _context) {
+			uint64_t marshalStart = okraNanoTime();
+			okraMetricAdd(OKRA_METRIC_DISPATCHES_IN_FLIGHT, 1);
+			if (!envChecked) {
+				envChecked = true;
+				if (!context->profileDir.empty() && !source.empty()) enableCounters(true);
+				if (context->regTraceWanted(entryName) && !source.empty()) {
+					traceRegisters(context->regTraceFirstItem, context->regTraceNumItems,
+								   context->regTraceRecordsPerItem, context->regTraceFile.c_str());
+				}
+				if (!context->memTraceDir.empty() && !source.empty()) {
+					traceMemory(context->memTraceFirstGroup, context->memTraceNumGroups, context->memTraceRecordsPerItem);
+				}
+			}
 			hsacommon::vector<hsa::Event *> depEvent;
-			hsa::DispatchEvent* hsaDispEvent = context->hsaQueue->dispatch(hsaKernel, 
+			hsa::Kernel *dispatchKernel;
+			hsacommon::vector<hsa::KernelArg> instrumentedArgs;
+			bool tracing = !regTracePath.empty();
+			bool tracingMemory = memTracing && !tracing;
+			bool counting = countersEnabled && !tracing && !tracingMemory;
+			bool instrumented = tracing || tracingMemory || counting;
+			uint32_t memTraceItems = 0;
+			if (instrumented) {
+				// the instrumented variants take their buffer as an extra last arg
+				instrumentedArgs = hsaArgs;
+				hsa::KernelArg harg;
+				if (tracing) {
+					std::fill(regTraceBuffer.begin(), regTraceBuffer.end(), 0);
+					harg.addr = &regTraceBuffer[0];
+					dispatchKernel = regTraceKernel->hsaKernel;
+				} else if (tracingMemory) {
+					// the sampled work-groups of this launch, the buffer capped at 1GB
+					uint64_t groupSize = std::max(1U, hsaLaunchAttr.group[0]);
+					uint64_t gridItems = (uint64_t) hsaLaunchAttr.grid[0] * hsaLaunchAttr.group[0];
+					uint64_t firstItem = memTraceFirstGroup * groupSize;
+					size_t itemWords = 2 + 2 * (size_t) memTraceRecords;
+					if (firstItem < gridItems) {
+						uint64_t items = std::min(memTraceGroups * groupSize, gridItems - firstItem);
+						memTraceItems = (uint32_t) std::min(items, (uint64_t) ((1UL << 27) - 2) / itemWords);
+					}
+					memTraceBuffer.assign(2 + memTraceItems * itemWords, 0);
+					uint32_t *header = (uint32_t *) &memTraceBuffer[0];
+					header[0] = (uint32_t) firstItem;
+					header[1] = memTraceItems;
+					harg.addr = &memTraceBuffer[0];
+					dispatchKernel = memTraceKernel->hsaKernel;
+				} else {
+					std::fill(blockExecs.begin(), blockExecs.end(), 0);
+					harg.addr = &blockExecs[0];
+					dispatchKernel = countingKernel->hsaKernel;
+				}
+				instrumentedArgs.push_back(harg);
+			} else {
+				dispatchKernel = (specializedArgs.empty() ? hsaKernel : selectVariant()->hsaKernel);
+			}
+			uint64_t executeStart = okraNanoTime();
+			hsa::DispatchEvent* hsaDispEvent = context->hsaQueue->dispatch(dispatchKernel, 
 										   hsaLaunchAttr,
 										   depEvent,
-										   hsaArgs);
+										   (instrumented ? instrumentedArgs : hsaArgs));
+			uint64_t executeEnd = okraNanoTime();
+			recordDispatch(executeStart - marshalStart, executeEnd - executeStart);
+			okraMetricAdd(OKRA_METRIC_DISPATCHES_IN_FLIGHT, -1);
+			if (counting) {
+				pthread_mutex_lock(&statsMutex);
+				hsailBlockCounters(counterBlocks, &blockExecs[0], &lastCounters);
+				haveCounters = true;
+				for (int b = 0; b < blockExecs.size(); b++) {
+					profileExecs[b] += blockExecs[b];
+				}
+				profileDispatches++;
+				profileNanos += executeEnd - executeStart;
+				pthread_mutex_unlock(&statsMutex);
+			}
+			if (tracing && !writeHsailRegTrace(regTracePath.c_str(), entryName.c_str(), regTraceDispatches++, regTraceFirst,
+											   regTraceItems, regTraceRecords, regTraceInfo, &regTraceBuffer[0])) {
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_WARN, "can't write register trace " << regTracePath);
+			}
+			if (tracingMemory) {
+				// accesses are put down to the pointer kernarg nearest below them
+				vector<pair<uint64_t, int> > argBases;
+				for (int i = 0; i < kernargs.size() && i < hsaArgs.size(); i++) {
+					if (kernargs[i].type == "u64" && hsaArgs[i].s64value != 0) {
+						argBases.push_back(make_pair((uint64_t) hsaArgs[i].s64value, i));
+					}
+				}
+				pthread_mutex_lock(&statsMutex);
+				addHsailMemTrace(memReport, &memTraceBuffer[0], memTraceItems, memTraceRecords,
+								 std::max(1U, hsaLaunchAttr.group[0]), argBases);
+				pthread_mutex_unlock(&statsMutex);
+			}
+			if (okraTraceOn()) {
+				if (!specializedArgs.empty() && !instrumented) {
+					okraTraceRecord("dispatch", "selectVariant", marshalStart, executeStart, entryName.c_str());
+				}
+				okraTraceRecord("dispatch", "dispatch", executeStart, executeEnd, entryName.c_str(), "args", hsaArgs.size());
+			}
 	
 			// in the simulator the returned hsaDispEvent is always null
 			// so we just assume the kernel is finished
@@ -201,14 +642,157 @@ private:
 			for (int k=0; k<dims; k++) {
 				computeLaunchAttr(k, globalDims[k], localDims[k]);
 			}
+			launchDims = std::min(dims, 3);
 			return OKRA_SUCCESS;
 		}
 
-                okra_status_t dispose() {
-                        return OKRA_SUCCESS;
-                }
+		// a kernel that has been dispatched keeps its counters for the exit
+		// reports (see statsContexts), everything else is freed
+		okra_status_t dispose() {
+			if (owner != NULL && !owner->forget(this)) {
+				return OKRA_SUCCESS;
+			}
+			releaseCode();
+			pthread_mutex_lock(&statsMutex);
+			bool dispatched = (stats.dispatches != 0);
+			pthread_mutex_unlock(&statsMutex);
+			if (!dispatched) {
+				delete this;
+			}
+			return OKRA_SUCCESS;
+		}
 
 	private:
+		// dispose the variants and instrumented kernels, then the program and
+		// brig if this kernel owns them and the reference to its module or bundle;
+		// the hsa kernel goes with its program
+		void releaseCode() {
+			pthread_mutex_lock(&variantsMutex);
+			for (map<vector<uint64_t>, KernelImpl *>::iterator it = variants.begin(); it != variants.end(); it++) {
+				if (it->second != NULL) it->second->dispose();
+			}
+			variants.clear();
+			specializedArgs.clear();
+			variantGeneration++;
+			pthread_mutex_unlock(&variantsMutex);
+			if (countingKernel != NULL) countingKernel->dispose();
+			if (regTraceKernel != NULL) regTraceKernel->dispose();
+			if (memTraceKernel != NULL) memTraceKernel->dispose();
+			countingKernel = regTraceKernel = memTraceKernel = NULL;
+			countersEnabled = memTracing = false;
+			regTracePath.clear();
+			if (hsaProgram != NULL) {
+				context->destroyProgram(hsaProgram);
+			}
+			hsaProgram = NULL;
+			hsaKernel = NULL;
+			brig.release();
+			if (owner != NULL) {
+				owner->release();
+			}
+			owner = NULL;
+		}
+
+		void recordDispatch(uint64_t marshalNanos, uint64_t executeNanos) {
+			okra_dispatch_info_t info;
+			memset(&info, 0, sizeof(info));
+			info.marshal_ns = marshalNanos;
+			info.execute_ns = executeNanos;
+			info.dims = launchDims;
+			info.work_items = (launchDims > 0 ? 1 : 0);
+			for (int k = 0; k < launchDims; k++) {
+				info.group_size[k] = hsaLaunchAttr.group[k];
+				info.global_size[k] = hsaLaunchAttr.grid[k] * hsaLaunchAttr.group[k];
+				info.work_items *= info.global_size[k];
+			}
+			info.work_items_per_sec = (executeNanos == 0 ? 0.0 : info.work_items * 1e9 / executeNanos);
+
+			uint64_t micros = executeNanos / 1000;
+			int bucket = 0;
+			while (micros != 0 && bucket < OKRA_STATS_HISTOGRAM_BUCKETS - 1) {
+				micros >>= 1;
+				bucket++;
+			}
+
+			pthread_mutex_lock(&statsMutex);
+			if (stats.dispatches == 0) {
+				context->registerDispatchedKernel(this);
+				stats.min_execute_ns = executeNanos;
+			}
+			stats.dispatches++;
+			stats.work_items += info.work_items;
+			stats.marshal_ns += marshalNanos;
+			stats.execute_ns += executeNanos;
+			stats.min_execute_ns = std::min(stats.min_execute_ns, executeNanos);
+			stats.max_execute_ns = std::max(stats.max_execute_ns, executeNanos);
+			stats.execute_histogram[bucket]++;
+			stats.last = info;
+			pthread_mutex_unlock(&statsMutex);
+			if (okraMetricsOn()) {
+				okraMetricAdd(OKRA_METRIC_DISPATCHES, 1);
+				okraMetricAdd(OKRA_METRIC_WORK_ITEMS, info.work_items);
+				okraMetricObserve(OKRA_HISTOGRAM_DISPATCH, marshalNanos + executeNanos);
+			}
+		}
+
+		// the variant for the values now pushed, compiled on first use
+		KernelImpl *selectVariant() {
+			pthread_mutex_lock(&variantsMutex);
+			if (specializedArgs.empty() || hsaArgs.size() <= specializedArgs.back()) {
+				pthread_mutex_unlock(&variantsMutex);
+				return this;
+			}
+			vector<uint64_t> key;
+			map<int, uint64_t> values;
+			for (int i = 0; i < specializedArgs.size(); i++) {
+				int idx = specializedArgs[i];
+				uint64_t raw = 0;
+				memcpy(&raw, &hsaArgs[idx], std::min(sizeof(raw), sizeof(hsa::KernelArg)));
+				uint64_t bits = hsailKernargBits(kernargs[idx].type, raw);
+				key.push_back(bits);
+				values[idx] = bits;
+			}
+			map<vector<uint64_t>, KernelImpl *>::iterator it = variants.find(key);
+			if (it != variants.end() || variants.size() >= context->maxSpecializations) {
+				KernelImpl *variant = (it != variants.end() ? it->second : NULL);
+				pthread_mutex_unlock(&variantsMutex);
+				return (variant == NULL ? this : variant);
+			}
+			uint32_t generation = variantGeneration;
+			pthread_mutex_unlock(&variantsMutex);
+
+			// compile without the lock so other dispatches of this kernel go on
+			KernelImpl *variant = NULL;
+			string specialized = source;
+			Kernel *kernel = NULL;
+			if (specializeHsailKernargs(specialized, entryName.c_str(), values)
+					&& context->createKernel(specialized.c_str(), entryName.c_str(), &options, &kernel) == OKRA_SUCCESS) {
+				variant = (KernelImpl *) kernel;
+				variant->argAccess = argAccess;
+				string().swap(variant->source);   // variants are never instrumented or specialized again
+			}
+
+			pthread_mutex_lock(&variantsMutex);
+			it = variants.find(key);
+			if (generation != variantGeneration) {
+				// the set of args changed meanwhile, this kernel handles the values too
+				if (variant != NULL) variant->dispose();
+				variant = NULL;
+			} else if (it != variants.end()) {
+				// another dispatch compiled the same values first
+				if (variant != NULL) variant->dispose();
+				variant = it->second;
+			} else if (variants.size() >= context->maxSpecializations) {
+				if (variant != NULL) variant->dispose();
+				variant = NULL;
+			} else {
+				variants[key] = variant;
+				OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, (variant == NULL ? "failed to compile" : "compiled") << " variant " << variants.size() << " of " << entryName);
+			}
+			pthread_mutex_unlock(&variantsMutex);
+			return (variant == NULL ? this : variant);
+		}
+
 		void computeLaunchAttr(int level, int globalSize, int localSize) {
 			// localSize of 0 means pick best
 			// on the simulator, we might as well pick a group size of 1
@@ -222,16 +806,13 @@ private:
 			int legalGroupSize = findLargestFactor(globalSize, localSize);
 
 			if (legalGroupSize != localSize) {
-				cerr << "WARNING: groupSize[" << level << "] reduced to " << legalGroupSize << endl;
+				OKRA_LOG(OKRA_LOG_DISPATCH, OKRA_LOG_WARN, "groupSize[" << level << "] reduced to " << legalGroupSize);
 			}
 
 			hsaLaunchAttr.groupOffsets[level] = 0;
 			hsaLaunchAttr.grid[level] = globalSize / legalGroupSize;
 			hsaLaunchAttr.group[level] = legalGroupSize;
-			//debugging
-			if (context->isVerbose()) {
-				cerr << "level " << level << ", grid=" << hsaLaunchAttr.grid[level] << ", group=" << hsaLaunchAttr.group[level] << endl;
-			}
+			OKRA_LOG(OKRA_LOG_DISPATCH, OKRA_LOG_TRACE, "level " << level << ", grid=" << hsaLaunchAttr.grid[level] << ", group=" << hsaLaunchAttr.group[level]);
 		}
 
 		// find largest factor less than or equal to start
@@ -248,30 +829,401 @@ private:
 
 	}; //end of kernelImpl
 
+	// one hsa::Program holding several kernels, each compiled the first time
+	// it is asked for.  The program and brig go when the module and all of
+	// its kernels have been disposed.
+	class ModuleImpl : public OkraContext::Module, public KernelOwner {
+	public:
+		OkraContextSimulatorImpl* context;
+		hsa::Program *hsaProgram;
+		BrigStorage brig;          // shared by every kernel of the module
+		string fixedHsail;         // empty if the module was created from brig
+		map<string, KernelImpl *> kernels;
+		pthread_mutex_t kernelsMutex;
+
+		ModuleImpl(hsa::Program *_hsaProgram, BrigStorage _brig, OkraContextSimulatorImpl* _context) {
+			hsaProgram = _hsaProgram;
+			brig = _brig;
+			context = _context;
+			pthread_mutex_init(&kernelsMutex, NULL);
+		}
+
+		~ModuleImpl() {
+			context->destroyProgram(hsaProgram);
+			brig.release();
+			pthread_mutex_destroy(&kernelsMutex);
+		}
+
+		okra_status_t getKernel(const char *entryName, Kernel **kernel) {
+			okra_status_t status = OKRA_SUCCESS;
+			pthread_mutex_lock(&kernelsMutex);
+			map<string, KernelImpl *>::iterator it = kernels.find(entryName);
+			if (it != kernels.end()) {
+				it->second->lookups++;
+				*kernel = it->second;
+			} else {
+				KernelImpl *kernelImpl = context->compileEntry(hsaProgram, entryName);
+				if (kernelImpl == NULL) {
+					status = OKRA_KERNEL_FINALIZE_FAILED;
+				} else {
+					if (!fixedHsail.empty()) {
+						inferKernargAccess(fixedHsail.c_str(), entryName, kernelImpl->argAccess);
+					}
+					kernelImpl->owner = this;
+					kernelImpl->lookups = 1;
+					retain();
+					kernels[entryName] = kernelImpl;
+				}
+				*kernel = kernelImpl;
+			}
+			pthread_mutex_unlock(&kernelsMutex);
+			return status;
+		}
+
+		bool forget(KernelImpl *kernel) {
+			pthread_mutex_lock(&kernelsMutex);
+			bool last = (--kernel->lookups == 0);
+			if (last) {
+				kernels.erase(kernel->entryName);
+			}
+			pthread_mutex_unlock(&kernelsMutex);
+			return last;
+		}
+
+		okra_status_t dispose() {
+			release();
+			return OKRA_SUCCESS;
+		}
+	}; //end of ModuleImpl
+
+	// the mapping goes when the bundle and all of its kernels have been disposed
+	class BundleImpl : public OkraContext::Bundle, public KernelOwner {
+	public:
+		OkraContextSimulatorImpl* context;
+		KernelBundleReader reader;
+		map<uint32_t, KernelImpl *> kernels;   // by entry index
+		pthread_mutex_t kernelsMutex;
+
+		BundleImpl(OkraContextSimulatorImpl* _context) {
+			context = _context;
+			pthread_mutex_init(&kernelsMutex, NULL);
+		}
+
+		~BundleImpl() {
+			reader.detach();
+			pthread_mutex_destroy(&kernelsMutex);
+		}
+
+		okra_status_t createKernel(const char *name, const char *entryName, Kernel **kernel) {
+			return createKernelFromEntry(reader.findByName(name, entryName), kernel);
+		}
+
+		okra_status_t createKernelBySourceHash(uint64_t sourceHash, const char *entryName, Kernel **kernel) {
+			return createKernelFromEntry(reader.findBySourceHash(sourceHash, entryName), kernel);
+		}
+
+		bool forget(KernelImpl *kernel) {
+			pthread_mutex_lock(&kernelsMutex);
+			bool last = (--kernel->lookups == 0);
+			if (last) {
+				for (map<uint32_t, KernelImpl *>::iterator it = kernels.begin(); it != kernels.end(); it++) {
+					if (it->second == kernel) {
+						kernels.erase(it);
+						break;
+					}
+				}
+			}
+			pthread_mutex_unlock(&kernelsMutex);
+			return last;
+		}
+
+		okra_status_t dispose() {
+			release();
+			return OKRA_SUCCESS;
+		}
+
+	private:
+		okra_status_t createKernelFromEntry(const KernelBundleEntry *entry, Kernel **kernel) {
+			*kernel = NULL;
+			if (entry == NULL) {
+				return OKRA_INVALID_ARGUMENT;
+			}
+			uint32_t index = entry - reader.getEntry(0);
+			okra_status_t status = OKRA_SUCCESS;
+			pthread_mutex_lock(&kernelsMutex);
+			map<uint32_t, KernelImpl *>::iterator it = kernels.find(index);
+			if (it != kernels.end()) {
+				it->second->lookups++;
+				*kernel = it->second;
+			} else {
+				// the brig is used in place in the mapping
+				KernelImpl *kernelImpl = (KernelImpl *) context->createKernelCommon(reader.getBrig(entry), entry->brigSize, BrigStorage(), reader.getEntryName(entry));
+				if (kernelImpl == NULL) {
+					status = OKRA_KERNEL_CREATE_FROM_BINARY_FAILED;
+				} else {
+					reader.getArgAccess(entry, kernelImpl->argAccess);
+					kernelImpl->owner = this;
+					kernelImpl->lookups = 1;
+					retain();
+					kernels[index] = kernelImpl;
+				}
+				*kernel = kernelImpl;
+			}
+			pthread_mutex_unlock(&kernelsMutex);
+			return status;
+		}
+	}; //end of BundleImpl
+
+	class PendingKernelImpl : public OkraContext::PendingKernel {
+	public:
+		string source;
+		string entryName;
+		AsyncKernelCallback callback;
+		void *callbackArg;
+		okra_status_t status;
+		Kernel *kernel;
+		bool done;
+		bool abandoned;            // disposed before done, the compile thread deletes it
+		pthread_mutex_t mutex;
+		pthread_cond_t doneCond;
+
+		PendingKernelImpl(const char *_source, const char *_entryName, AsyncKernelCallback _callback, void *_callbackArg) :
+			source(_source), entryName(_entryName), callback(_callback), callbackArg(_callbackArg),
+			status(OKRA_SUCCESS), kernel(NULL), done(false), abandoned(false) {
+			pthread_mutex_init(&mutex, NULL);
+			pthread_cond_init(&doneCond, NULL);
+		}
+
+		~PendingKernelImpl() {
+			pthread_mutex_destroy(&mutex);
+			pthread_cond_destroy(&doneCond);
+		}
+
+		bool isDone() {
+			pthread_mutex_lock(&mutex);
+			bool isDone = done;
+			pthread_mutex_unlock(&mutex);
+			return isDone;
+		}
+
+		okra_status_t wait(Kernel **_kernel) {
+			pthread_mutex_lock(&mutex);
+			while (!done) {
+				pthread_cond_wait(&doneCond, &mutex);
+			}
+			*_kernel = kernel;
+			okra_status_t result = status;
+			pthread_mutex_unlock(&mutex);
+			return result;
+		}
+
+		okra_status_t dispose() {
+			pthread_mutex_lock(&mutex);
+			bool deleteNow = done;
+			abandoned = true;
+			pthread_mutex_unlock(&mutex);
+			if (deleteNow) delete this;
+			return OKRA_SUCCESS;
+		}
+
+		// called on the compile thread
+		void complete(okra_status_t _status, Kernel *_kernel) {
+			if (callback != NULL) {
+				callback(callbackArg, _status, _kernel);
+			}
+			pthread_mutex_lock(&mutex);
+			status = _status;
+			kernel = _kernel;
+			done = true;
+			pthread_cond_broadcast(&doneCond);
+			bool deleteNow = abandoned;
+			pthread_mutex_unlock(&mutex);
+			if (deleteNow) delete this;
+		}
+	}; //end of PendingKernelImpl
+
 private:
 	hsa::RuntimeApi *hsaRT;
 	uint32_t numDevices;
 	hsacommon::vector<hsa::Device *> devices;
 	hsa::Queue *hsaQueue;
 	int maxSimThreads;
+	int maxCompileThreads;
+	int maxAsyncThreads;
+	int numAsyncThreads;
+	int inlineThreshold;          // largest function (in instructions) the inlining pass takes
+	int maxSpecializations;       // variants compiled per kernel for specialized kernargs
+	deque<PendingKernelImpl *> asyncQueue;
+	pthread_mutex_t asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_cond_t asyncCond = PTHREAD_COND_INITIALIZER;
 	bool saveHsailSource;
+	okra_compile_options_t defaultOptions;   // from OKRA_COMPILE_PROFILE
+	string cacheDir;              // OKRA_CACHE_DIR, empty if the brig cache is off
+	string assemblerIdentity;     // the hsailasm on the PATH, part of the brig cache key
+	string profileDir;            // OKRA_PROFILE, empty if kernels are not profiled
+	bool dumpStatsOnExit;         // OKRA_STATS
+	bool perfMap;                 // OKRA_PERF_MAP
+	string regTraceFile;          // OKRA_REG_TRACE, empty if no kernel's registers are traced
+	string regTraceEntry;         // OKRA_REG_TRACE_KERNEL, empty for every kernel
+	uint32_t regTraceFirstItem;   // OKRA_REG_TRACE_ITEMS=<first>[:<count>]
+	uint32_t regTraceNumItems;
+	uint32_t regTraceRecordsPerItem;   // OKRA_REG_TRACE_RECORDS
+	string memTraceDir;           // OKRA_MEM_TRACE, empty if global accesses are not traced
+	uint32_t memTraceFirstGroup;  // OKRA_MEM_TRACE_GROUPS=<first>[:<count>]
+	uint32_t memTraceNumGroups;
+	uint32_t memTraceRecordsPerItem;   // OKRA_MEM_TRACE_RECORDS
+	okra_context_build_info_t buildTotals;
+	pthread_mutex_t buildTotalsMutex = PTHREAD_MUTEX_INITIALIZER;
+	vector<KernelImpl *> dispatchedKernels;   // in order of their first dispatch
+	pthread_mutex_t dispatchedKernelsMutex = PTHREAD_MUTEX_INITIALIZER;
   pthread_mutex_t kernelCreateMutex = PTHREAD_MUTEX_INITIALIZER;
 
+	// one kernel's trip from hsail text to hsa::Kernel; the stages fill in
+	// the results and their times, status is the first failure if any
+	struct KernelBuild {
+		const char *source;       // not owned and not necessarily nul terminated
+		size_t sourceLength;
+		const char *entryName;
+		okra_compile_options_t options;
+		vector<int> argAccess;
+		string fixedHsail;        // hsail as given to hsailasm, only kept for modules
+		char *brigBuffer;
+		size_t brigSize;
+		char *mapBase;            // the mapping holding brigBuffer, a cached brig sits inside a bundle
+		size_t mapSize;
+		bool cached;              // brig came from the cache, nothing was assembled
+		okra_status_t status;
+		Kernel *kernel;
+		okra_kernel_build_info_t info;
+		// when the build went through each stage, 0 for a stage it skipped
+		uint64_t fixStart, fixEnd;
+		uint64_t assembleStart, assembleEnd;
+		uint64_t finalizeStart, finalizeEnd;
+
+		KernelBuild(const char *_source, size_t _sourceLength, const char *_entryName, const okra_compile_options_t &_options) :
+			source(_source), sourceLength(_sourceLength), entryName(_entryName), options(_options), brigBuffer(NULL), brigSize(0),
+			mapBase(NULL), mapSize(0), cached(false), status(OKRA_SUCCESS), kernel(NULL) {
+			memset(&info, 0, sizeof(info));
+			fixStart = fixEnd = assembleStart = assembleEnd = finalizeStart = finalizeEnd = 0;
+		}
+
+		KernelBuild(const char *_source, const char *_entryName, const okra_compile_options_t &_options) :
+			source(_source), sourceLength(strlen(_source)), entryName(_entryName), options(_options), brigBuffer(NULL), brigSize(0),
+			mapBase(NULL), mapSize(0), cached(false), status(OKRA_SUCCESS), kernel(NULL) {
+			memset(&info, 0, sizeof(info));
+			fixStart = fixEnd = assembleStart = assembleEnd = finalizeStart = finalizeEnd = 0;
+		}
+	};
+
+	// widen a stage's [start, end) over the batch to take in one build's
+	static void widenStage(uint64_t &start, uint64_t &end, uint64_t buildStart, uint64_t buildEnd) {
+		if (buildStart == 0) return;
+		if (start == 0 || buildStart < start) start = buildStart;
+		end = std::max(end, buildEnd);
+	}
+
+	// shared between createKernels and its assembler threads
+	struct BatchState {
+		OkraContextSimulatorImpl *context;
+		vector<KernelBuild> *builds;
+		int next;                 // next build to assemble, taken with an atomic increment
+		deque<int> ready;         // assembled builds waiting to be finalized
+		pthread_mutex_t lock;
+		pthread_cond_t readyCond;
+
+		BatchState(OkraContextSimulatorImpl *_context, vector<KernelBuild> *_builds) :
+			context(_context), builds(_builds), next(0) {
+			pthread_mutex_init(&lock, NULL);
+			pthread_cond_init(&readyCond, NULL);
+		}
+
+		~BatchState() {
+			pthread_mutex_destroy(&lock);
+			pthread_cond_destroy(&readyCond);
+		}
+	};
+
+	// background compile threads live as long as the process
+	static void *asyncWorker(void *arg) {
+		OkraContextSimulatorImpl *context = (OkraContextSimulatorImpl *) arg;
+		while (true) {
+			pthread_mutex_lock(&context->asyncMutex);
+			while (context->asyncQueue.empty()) {
+				pthread_cond_wait(&context->asyncCond, &context->asyncMutex);
+			}
+			PendingKernelImpl *pending = context->asyncQueue.front();
+			context->asyncQueue.pop_front();
+			okraMetricAdd(OKRA_METRIC_COMPILE_QUEUE, -1);
+			pthread_mutex_unlock(&context->asyncMutex);
+
+			Kernel *kernel = NULL;
+			OkraTraceScope trace("compile", "createKernelAsync", pending->entryName.c_str());
+			okra_status_t status = context->createKernel(pending->source.c_str(), pending->entryName.c_str(), &kernel);
+			pending->complete(status, kernel);
+		}
+		return NULL;
+	}
+
+	// start up to numThreads batch workers and return how many started.  If
+	// none could be, the calling thread assembles every build itself.
+	static int startBatchWorkers(BatchState &batch, vector<pthread_t> &threads, int numThreads) {
+		threads.resize(numThreads);
+		int started = 0;
+		while (started < numThreads && pthread_create(&threads[started], NULL, batchWorker, &batch) == 0) {
+			started++;
+		}
+		threads.resize(started);
+		if (started == 0) {
+			OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_WARN, "no assembler thread could be started, assembling on the calling thread");
+			batchWorker(&batch);
+		}
+		return started;
+	}
+
+	static void *batchWorker(void *arg) {
+		BatchState *batch = (BatchState *) arg;
+		int numBuilds = batch->builds->size();
+		for (int i = __sync_fetch_and_add(&batch->next, 1); i < numBuilds; i = __sync_fetch_and_add(&batch->next, 1)) {
+			batch->context->assembleKernel(batch->builds->at(i));
+			pthread_mutex_lock(&batch->lock);
+			batch->ready.push_back(i);
+			pthread_cond_signal(&batch->readyCond);
+			pthread_mutex_unlock(&batch->lock);
+		}
+		return NULL;
+	}
+
 	// constructor
 	OkraContextSimulatorImpl() {
 		setVerbose(false);   // can be set true by higher levels later
+		memset(&buildTotals, 0, sizeof(buildTotals));
 		char * saveHsailSourceEnvVar = getenv("OKRA_SAVEHSAILSOURCE");
 		saveHsailSource =  (saveHsailSourceEnvVar == NULL ? false : strcmp(saveHsailSourceEnvVar, "1")==0);
+		// OKRA_COMPILE_PROFILE picks the options used when none are given
+		getCompileProfile("default", &defaultOptions);
+		char *profileEnv = getenv("OKRA_COMPILE_PROFILE");
+		if (profileEnv != NULL && getCompileProfile(profileEnv, &defaultOptions) != OKRA_SUCCESS) {
+			OKRA_LOG(OKRA_LOG_RUNTIME, OKRA_LOG_WARN, "unknown OKRA_COMPILE_PROFILE " << profileEnv << ", using default");
+			getCompileProfile("default", &defaultOptions);
+		}
+
+		// OKRA_CACHE_DIR turns on the on-disk cache of assembled brig
+		char *cacheDirEnv = getenv("OKRA_CACHE_DIR");
+		if (cacheDirEnv != NULL && *cacheDirEnv != '\0') {
+			cacheDir = cacheDirEnv;
+			mkdir(cacheDir.c_str(), 0755);
+			assemblerIdentity = programIdentity("hsailasm");
+		}
 
 		hsaRT = hsa::getRuntime();
 		if(!hsaRT) {
-			cerr<<"Fatal: Cannot get HSA Runtime"<<endl;
+			OKRA_LOG(OKRA_LOG_RUNTIME, OKRA_LOG_ERROR, "Fatal: Cannot get HSA Runtime");
 			exit(1);
 		}
 
 		numDevices = hsaRT->getDeviceCount();
 		if(!numDevices) {
-			cerr<<"Fatal: No HSA device exists"<<endl;
+			OKRA_LOG(OKRA_LOG_RUNTIME, OKRA_LOG_ERROR, "Fatal: No HSA device exists");
 			exit(-1);
 		}
 
@@ -280,7 +1232,7 @@ private:
 		hsa::Device *device = devices[0];
 		hsaQueue = device->createQueue(1);
 		if(!hsaQueue) {
-			cerr<<"Fatal: could not create hsaQueue"<<endl;
+			OKRA_LOG(OKRA_LOG_RUNTIME, OKRA_LOG_ERROR, "Fatal: could not create hsaQueue");
 			exit(-1);
 		}
 
@@ -292,14 +1244,455 @@ private:
 			maxSimThreads = 0;
 		}
 		
-		if (isVerbose()) cerr<<"HSA Runtime successfully initialized"<<endl;
+		// OKRA_COMPILE_THREADS limits the assembler threads used by createKernels
+		char *compileThreadsEnv = getenv("OKRA_COMPILE_THREADS");
+		if ((compileThreadsEnv != NULL) && (atoi(compileThreadsEnv) > 0)) {
+			maxCompileThreads = atoi(compileThreadsEnv);
+		}
+		else {
+			maxCompileThreads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+		}
+
+		// OKRA_ASYNC_COMPILE_THREADS bounds the background pool used by createKernelAsync
+		char *asyncThreadsEnv = getenv("OKRA_ASYNC_COMPILE_THREADS");
+		maxAsyncThreads = ((asyncThreadsEnv != NULL) && (atoi(asyncThreadsEnv) > 0) ? atoi(asyncThreadsEnv) : 2);
+		numAsyncThreads = 0;
+
+		// OKRA_INLINE_THRESHOLD bounds the functions inlined when inline_functions is set
+		char *inlineThresholdEnv = getenv("OKRA_INLINE_THRESHOLD");
+		inlineThreshold = ((inlineThresholdEnv != NULL) && (atoi(inlineThresholdEnv) >= 0) ? atoi(inlineThresholdEnv) : 32);
+
+		// OKRA_SPECIALIZE_LIMIT caps the variants compiled for each kernel with specialized kernargs
+		char *specializeLimitEnv = getenv("OKRA_SPECIALIZE_LIMIT");
+		maxSpecializations = ((specializeLimitEnv != NULL) && (atoi(specializeLimitEnv) >= 0) ? atoi(specializeLimitEnv) : 16);
+
+		// OKRA_TRACE=<file> writes a timeline of compiles and dispatches at exit
+		okraTraceInit();
+
+		// OKRA_METRICS=<file> or unix:<path> exports counters for prometheus
+		okraMetricsInit();
+
+		// OKRA_PERF_MAP=1 names each kernel's code in /tmp/perf-<pid>.map for perf
+		char *perfMapEnv = getenv("OKRA_PERF_MAP");
+		perfMap = (perfMapEnv != NULL && strcmp(perfMapEnv, "1") == 0);
+
+		// OKRA_STATS=1 prints the build and dispatch counters at exit
+		char *statsEnv = getenv("OKRA_STATS");
+		dumpStatsOnExit = (statsEnv != NULL && strcmp(statsEnv, "1") == 0);
+
+		// OKRA_PROFILE=<dir> counts every kernel created from hsail and writes
+		// an annotated listing of each to the directory at exit
+		char *profileDirEnv = getenv("OKRA_PROFILE");
+		if (profileDirEnv != NULL && *profileDirEnv != '\0') {
+			profileDir = profileDirEnv;
+			mkdir(profileDir.c_str(), 0755);
+		}
+
+		// OKRA_MEM_TRACE=<dir> traces the global accesses of work-groups
+		// OKRA_MEM_TRACE_GROUPS (default 0) of every kernel created from hsail,
+		// the first OKRA_MEM_TRACE_RECORDS (default 1024) of each work-item,
+		// and writes a locality report of each kernel to the directory at exit
+		char *memTraceEnv = getenv("OKRA_MEM_TRACE");
+		if (memTraceEnv != NULL && *memTraceEnv != '\0') {
+			memTraceDir = memTraceEnv;
+			mkdir(memTraceDir.c_str(), 0755);
+		}
+		memTraceFirstGroup = 0;
+		memTraceNumGroups = 1;
+		char *memTraceGroupsEnv = getenv("OKRA_MEM_TRACE_GROUPS");
+		if (memTraceGroupsEnv != NULL) {
+			char *end;
+			memTraceFirstGroup = strtoul(memTraceGroupsEnv, &end, 0);
+			if (*end == ':') memTraceNumGroups = strtoul(end + 1, NULL, 0);
+		}
+		char *memTraceRecordsEnv = getenv("OKRA_MEM_TRACE_RECORDS");
+		memTraceRecordsPerItem = ((memTraceRecordsEnv != NULL) && (atoi(memTraceRecordsEnv) > 1) ? atoi(memTraceRecordsEnv) : 1024);
+
+		if (dumpStatsOnExit || !profileDir.empty() || !memTraceDir.empty()) {
+			reportAtExit(this);
+		}
+
+		// OKRA_REG_TRACE=<file> traces the register writes of work-items
+		// OKRA_REG_TRACE_ITEMS (default 0) of the kernel OKRA_REG_TRACE_KERNEL
+		// (default all), keeping the last OKRA_REG_TRACE_RECORDS (default 4096)
+		// writes of each.  okra-regtrace decodes the file.
+		char *regTraceEnv = getenv("OKRA_REG_TRACE");
+		if (regTraceEnv != NULL && *regTraceEnv != '\0') {
+			regTraceFile = regTraceEnv;
+			remove(regTraceFile.c_str());
+		}
+		char *regTraceKernelEnv = getenv("OKRA_REG_TRACE_KERNEL");
+		if (regTraceKernelEnv != NULL) regTraceEntry = regTraceKernelEnv;
+		regTraceFirstItem = 0;
+		regTraceNumItems = 1;
+		char *regTraceItemsEnv = getenv("OKRA_REG_TRACE_ITEMS");
+		if (regTraceItemsEnv != NULL) {
+			char *end;
+			regTraceFirstItem = strtoul(regTraceItemsEnv, &end, 0);
+			if (*end == ':') regTraceNumItems = strtoul(end + 1, NULL, 0);
+		}
+		char *regTraceRecordsEnv = getenv("OKRA_REG_TRACE_RECORDS");
+		regTraceRecordsPerItem = ((regTraceRecordsEnv != NULL) && (atoi(regTraceRecordsEnv) > 0) ? atoi(regTraceRecordsEnv) : 4096);
+
+		OKRA_LOG(OKRA_LOG_RUNTIME, OKRA_LOG_DEBUG, "HSA Runtime successfully initialized");
 		
 	}
 
 public:
 	okra_status_t createKernel(const char *hsailBuffer, const char *entryName, Kernel **kernel) {
-		string *fixedHsailStr = fixHsail(hsailBuffer);
-	ConvertHsail(*fixedHsailStr);		
+		return createKernel(hsailBuffer, entryName, NULL, kernel);
+	}
+
+	okra_status_t createKernel(const char *hsailBuffer, const char *entryName, const okra_compile_options_t *options, Kernel **kernel) {
+		return createKernel(hsailBuffer, strlen(hsailBuffer), entryName, options, kernel);
+	}
+
+	okra_status_t createKernel(const char *hsailBuffer, size_t length, const char *entryName, const okra_compile_options_t *options, Kernel **kernel) {
+		KernelBuild build(hsailBuffer, length, entryName, (options == NULL ? defaultOptions : *options));
+		if (assembleKernel(build) == OKRA_SUCCESS) {
+			finalizeKernel(build);
+		}
+		*kernel = build.kernel;
+		return build.status;
+	}
+
+	// assemble on a pool of threads and finalize (which has to be serialized
+	// anyway) on the calling thread as each brig becomes ready
+	okra_status_t createKernels(int numKernels, const char **sources, const char **entryNames, Kernel **kernels, okra_batch_times_t *times) {
+		OkraTraceScope trace("compile", "createKernels", NULL, "kernels", numKernels);
+		uint64_t batchStart = okraNanoTime();
+		vector<KernelBuild> builds;
+		builds.reserve(numKernels);
+		for (int i = 0; i < numKernels; i++) {
+			builds.push_back(KernelBuild(sources[i], entryNames[i], defaultOptions));
+		}
+
+		BatchState batch(this, &builds);
+		vector<pthread_t> threads;
+		// the calling thread counts as the one assembler if no worker started
+		int numThreads = std::max(1, startBatchWorkers(batch, threads, std::max(1, std::min(numKernels, maxCompileThreads))));
+
+		okra_status_t status = OKRA_SUCCESS;
+		for (int done = 0; done < numKernels; done++) {
+			pthread_mutex_lock(&batch.lock);
+			while (batch.ready.empty()) {
+				pthread_cond_wait(&batch.readyCond, &batch.lock);
+			}
+			int i = batch.ready.front();
+			batch.ready.pop_front();
+			pthread_mutex_unlock(&batch.lock);
+
+			KernelBuild &build = builds[i];
+			if (build.status == OKRA_SUCCESS) {
+				build.finalizeStart = okraNanoTime();
+				finalizeKernel(build);
+				build.finalizeEnd = okraNanoTime();
+			}
+			kernels[i] = build.kernel;
+			if (build.status != OKRA_SUCCESS && status == OKRA_SUCCESS) {
+				status = build.status;
+			}
+		}
+		for (int t = 0; t < threads.size(); t++) {
+			pthread_join(threads[t], NULL);
+		}
+
+		if (times != NULL) {
+			// each stage runs from the first build entering it to the last leaving it
+			uint64_t fixStart = 0, fixEnd = 0, assembleStart = 0, assembleEnd = 0, finalizeStart = 0, finalizeEnd = 0;
+			for (int i = 0; i < numKernels; i++) {
+				const KernelBuild &build = builds[i];
+				widenStage(fixStart, fixEnd, build.fixStart, build.fixEnd);
+				widenStage(assembleStart, assembleEnd, build.assembleStart, build.assembleEnd);
+				widenStage(finalizeStart, finalizeEnd, build.finalizeStart, build.finalizeEnd);
+			}
+			memset(times, 0, sizeof(*times));
+			times->fix_ns = fixEnd - fixStart;
+			times->assemble_ns = assembleEnd - assembleStart;
+			times->finalize_ns = finalizeEnd - finalizeStart;
+			times->wall_ns = okraNanoTime() - batchStart;
+			times->threads = numThreads;
+		}
+		OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "created " << numKernels << " kernels on " << numThreads << " threads in " << (okraNanoTime() - batchStart) << " ns");
+		return status;
+	}
+
+	okra_status_t createKernelAsync(const char *hsailBuffer, const char *entryName, PendingKernel **pending,
+									AsyncKernelCallback callback, void *callbackArg) {
+		PendingKernelImpl *pendingImpl = new PendingKernelImpl(hsailBuffer, entryName, callback, callbackArg);
+		*pending = pendingImpl;
+		pthread_mutex_lock(&asyncMutex);
+		asyncQueue.push_back(pendingImpl);
+		okraMetricAdd(OKRA_METRIC_COMPILE_QUEUE, 1);
+		// threads are started as requests come in, up to the limit
+		if (numAsyncThreads < maxAsyncThreads) {
+			pthread_t thread;
+			if (pthread_create(&thread, NULL, asyncWorker, this) == 0) {
+				pthread_detach(thread);
+				numAsyncThreads++;
+			}
+		}
+		if (numAsyncThreads == 0) {
+			// no thread could be started, nothing will ever pick this up
+			asyncQueue.pop_back();
+			okraMetricAdd(OKRA_METRIC_COMPILE_QUEUE, -1);
+			pthread_mutex_unlock(&asyncMutex);
+			delete pendingImpl;
+			*pending = NULL;
+			return OKRA_KERNEL_CREATE_FAILED;
+		}
+		pthread_cond_signal(&asyncCond);
+		pthread_mutex_unlock(&asyncMutex);
+		return OKRA_SUCCESS;
+	}
+
+	okra_status_t createKernelFromBinary(const char *brigBuffer, size_t brigSize, const char *entryName, Kernel **kernel) {
+		return createKernelFromBinary(brigBuffer, brigSize, entryName, kernel, false);
+	}
+
+	okra_status_t createKernelFromBinary(const char *brigBuffer, size_t brigSize, const char *entryName, Kernel **kernel, bool callerOwnsBuffer) {
+		if (callerOwnsBuffer) {
+			*kernel = createKernelCommon(const_cast<char*>(brigBuffer), brigSize, BrigStorage(), entryName);
+			return (*kernel == NULL ? OKRA_KERNEL_CREATE_FROM_BINARY_FAILED : OKRA_SUCCESS);
+		}
+		char *ptr = reinterpret_cast<char*>(malloc(brigSize));
+		if (!ptr) {
+                        *kernel = NULL;
+			return OKRA_KERNEL_CREATE_FAILED;
+		}
+
+		memcpy(ptr, brigBuffer, brigSize);
+		BrigStorage storage;
+		storage.copy = ptr;
+		*kernel = createKernelCommon(ptr, brigSize, storage, entryName);
+		return (*kernel == NULL ? OKRA_KERNEL_CREATE_FROM_BINARY_FAILED : OKRA_SUCCESS);
+	}
+
+	void getDefaultCompileOptions(okra_compile_options_t *options) {
+		*options = defaultOptions;
+	}
+
+	void getBuildInfo(okra_context_build_info_t *info) {
+		pthread_mutex_lock(&buildTotalsMutex);
+		*info = buildTotals;
+		pthread_mutex_unlock(&buildTotalsMutex);
+	}
+
+	void getStats(okra_context_stats_t *contextStats) {
+		memset(contextStats, 0, sizeof(*contextStats));
+		okra_kernel_stats_t &totals = contextStats->totals;
+		pthread_mutex_lock(&dispatchedKernelsMutex);
+		for (int i = 0; i < dispatchedKernels.size(); i++) {
+			okra_kernel_stats_t stats;
+			dispatchedKernels[i]->getStats(&stats);
+			totals.min_execute_ns = (i == 0 ? stats.min_execute_ns : std::min(totals.min_execute_ns, stats.min_execute_ns));
+			totals.max_execute_ns = std::max(totals.max_execute_ns, stats.max_execute_ns);
+			totals.dispatches += stats.dispatches;
+			totals.work_items += stats.work_items;
+			totals.marshal_ns += stats.marshal_ns;
+			totals.pin_ns += stats.pin_ns;
+			totals.execute_ns += stats.execute_ns;
+			for (int b = 0; b < OKRA_STATS_HISTOGRAM_BUCKETS; b++) {
+				totals.execute_histogram[b] += stats.execute_histogram[b];
+			}
+		}
+		contextStats->kernels = dispatchedKernels.size();
+		pthread_mutex_unlock(&dispatchedKernelsMutex);
+	}
+
+	void registerDispatchedKernel(KernelImpl *kernel) {
+		pthread_mutex_lock(&dispatchedKernelsMutex);
+		dispatchedKernels.push_back(kernel);
+		pthread_mutex_unlock(&dispatchedKernelsMutex);
+	}
+
+	// whether OKRA_REG_TRACE covers the kernel, its entry can be named with or without the &
+	bool regTraceWanted(const string &entry) {
+		if (regTraceFile.empty()) return false;
+		return regTraceEntry.empty() || regTraceEntry == entry || ("&" + regTraceEntry) == entry;
+	}
+
+	okra_status_t createKernelFromFile(const char *path, const char *entryName, Kernel **kernel) {
+		size_t brigSize = 0;
+		char *brigBuffer = mapFile(path, brigSize);
+		if (brigBuffer == NULL) {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_ERROR, "cannot map " << path);
+			*kernel = NULL;
+			return OKRA_LOAD_BRIG_FAILED;
+		}
+		// the mapping is kept for the life of the kernel
+		BrigStorage storage;
+		storage.mapBase = brigBuffer;
+		storage.mapSize = brigSize;
+		*kernel = createKernelCommon(brigBuffer, brigSize, storage, entryName);
+		return (*kernel == NULL ? OKRA_KERNEL_CREATE_FROM_BINARY_FAILED : OKRA_SUCCESS);
+	}
+
+	okra_status_t createModule(const char *hsailBuffer, Module **module) {
+		KernelBuild build(hsailBuffer, NULL, defaultOptions);
+		*module = NULL;
+		if (assembleKernel(build) != OKRA_SUCCESS) {
+			return build.status;
+		}
+		BrigStorage storage;
+		storage.mapBase = build.mapBase;
+		storage.mapSize = build.mapSize;
+		hsa::Program *hsaProgram = createProgram(build.brigBuffer, build.brigSize);
+		if (!hsaProgram) {
+			storage.release();
+			return OKRA_KERNEL_CREATE_FAILED;
+		}
+		ModuleImpl *moduleImpl = new ModuleImpl(hsaProgram, storage, this);
+		moduleImpl->fixedHsail.swap(build.fixedHsail);
+		*module = moduleImpl;
+		return OKRA_SUCCESS;
+	}
+
+	okra_status_t createModuleFromBinary(const char *brigBuffer, size_t brigSize, Module **module) {
+		*module = NULL;
+		char *ptr = reinterpret_cast<char*>(malloc(brigSize));
+		if (!ptr) {
+			return OKRA_KERNEL_CREATE_FAILED;
+		}
+
+		memcpy(ptr, brigBuffer, brigSize);
+		hsa::Program *hsaProgram = createProgram(ptr, brigSize);
+		if (!hsaProgram) {
+			free(ptr);
+			return OKRA_KERNEL_CREATE_FAILED;
+		}
+		BrigStorage storage;
+		storage.copy = ptr;
+		*module = new ModuleImpl(hsaProgram, storage, this);
+		return OKRA_SUCCESS;
+	}
+
+	okra_status_t openBundle(const char *path, Bundle **bundle) {
+		OkraTraceScope trace("compile", "openBundle");
+		*bundle = NULL;
+		size_t size = 0;
+		char *base = mapFile(path, size);
+		if (base == NULL) {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_ERROR, "cannot map " << path);
+			return OKRA_LOAD_BRIG_FAILED;
+		}
+		BundleImpl *bundleImpl = new BundleImpl(this);
+		if (!bundleImpl->reader.attach(base, size)) {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_ERROR, path << " is not a kernel bundle");
+			munmap(base, size);
+			delete bundleImpl;
+			return OKRA_LOAD_BRIG_FAILED;
+		}
+		OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_DEBUG, "opened bundle " << path << " with " << bundleImpl->reader.getNumEntries() << " kernels");
+		*bundle = bundleImpl;
+		return OKRA_SUCCESS;
+	}
+
+	// the same assembler threads as createKernels, with nothing finalized
+	okra_status_t writeBundle(const char *path, int numKernels, const char **names,
+							  const char **sources, const char **entryNames) {
+		OkraTraceScope trace("compile", "writeBundle", NULL, "kernels", numKernels);
+		vector<KernelBuild> builds;
+		builds.reserve(numKernels);
+		for (int i = 0; i < numKernels; i++) {
+			builds.push_back(KernelBuild(sources[i], entryNames[i], defaultOptions));
+		}
+		BatchState batch(this, &builds);
+		vector<pthread_t> threads;
+		startBatchWorkers(batch, threads, std::max(1, std::min(numKernels, maxCompileThreads)));
+		for (int t = 0; t < threads.size(); t++) {
+			pthread_join(threads[t], NULL);
+		}
+
+		okra_status_t status = OKRA_SUCCESS;
+		KernelBundleWriter writer;
+		for (int i = 0; i < numKernels; i++) {
+			if (builds[i].status != OKRA_SUCCESS) {
+				OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_ERROR, "assembling " << names[i] << " failed");
+				status = builds[i].status;
+				break;
+			}
+			writer.add(names[i], entryNames[i], okraHashString(sources[i]), builds[i].argAccess,
+					   builds[i].brigBuffer, builds[i].brigSize);
+		}
+		if (status == OKRA_SUCCESS && !writer.write(path)) {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_ERROR, "cannot write " << path);
+			status = OKRA_KERNEL_CREATE_FAILED;
+		}
+		for (int i = 0; i < numKernels; i++) {
+			if (builds[i].mapBase != NULL) {
+				munmap(builds[i].mapBase, builds[i].mapSize);
+			}
+		}
+		return status;
+	}
+
+	okra_status_t dispose(){
+#if 0
+		if (hsaProgram) {
+			hsaRuntime->destroyProgram(hsaProgram);
+		}
+#endif
+		return OKRA_SUCCESS;
+	}
+
+private:
+	// fix up the hsail text and run it through hsailasm, leaving the brig in
+	// the build.  Nothing here touches the hsa runtime so it can run on any thread.
+	okra_status_t assembleKernel(KernelBuild &build) {
+		OkraTraceScope trace("compile", "assemble", build.entryName);
+		build.assembleStart = okraNanoTime();
+		if (!loadCachedBrig(build)) {
+			assembleHsail(build);
+		}
+		build.assembleEnd = okraNanoTime();
+		okra_kernel_build_info_t &info = build.info;
+		info.total_ns = info.convert_ns + info.scan_ns + info.cache_ns + info.write_ns + info.assemble_ns + info.read_ns;
+		pthread_mutex_lock(&buildTotalsMutex);
+		buildTotals.assembled++;
+		buildTotals.cache_hits += (build.cached ? 1 : 0);
+		buildTotals.failures += (build.status != OKRA_SUCCESS ? 1 : 0);
+		buildTotals.totals.convert_ns += info.convert_ns;
+		buildTotals.totals.scan_ns += info.scan_ns;
+		buildTotals.totals.cache_ns += info.cache_ns;
+		buildTotals.totals.write_ns += info.write_ns;
+		buildTotals.totals.assemble_ns += info.assemble_ns;
+		buildTotals.totals.read_ns += info.read_ns;
+		buildTotals.totals.total_ns += info.total_ns;
+		pthread_mutex_unlock(&buildTotalsMutex);
+		if (build.cached) okraMetricAdd(OKRA_METRIC_CACHE_HITS, 1);
+		if (build.status != OKRA_SUCCESS) okraMetricAdd(OKRA_METRIC_KERNEL_FAILURES, 1);
+		return build.status;
+	}
+
+	okra_status_t assembleHsail(KernelBuild &build) {
+		uint64_t convertStart = okraNanoTime();
+		// the caller's text goes to hsailasm as it is unless it has to be
+		// rewritten, and then all the rewriting works on a single copy
+		const char *hsail = build.source;
+		size_t hsailLength = build.sourceLength;
+		string rewritten;
+		if (HsailNeedsConvert(hsail, hsailLength) || build.options.inline_functions) {
+			rewritten.assign(hsail, hsailLength);
+			ConvertHsail(rewritten);
+			if (build.options.inline_functions) {
+				int inlined = inlineHsailFunctions(rewritten, inlineThreshold);
+				OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "inlined " << inlined << " function calls");
+			}
+			hsail = rewritten.data();
+			hsailLength = rewritten.size();
+		}
+		uint64_t scanStart = okraNanoTime();
+		build.info.convert_ns = scanStart - convertStart;
+        // a module has no single entry to scan, its kernels are scanned on lookup
+        if (build.entryName != NULL) {
+            inferKernargAccess(hsail, hsailLength, build.entryName, build.argAccess);
+        }
+        uint64_t writeStart = okraNanoTime();
+        build.info.scan_ns = writeStart - scanStart;
+        build.fixStart = convertStart;
+        build.fixEnd = writeStart;
+
         char tmpHsailFileName[TMP_MAX];
         char tmpBrigFileName[TMP_MAX];
         pid_t pid = getpid();
@@ -309,123 +1702,419 @@ public:
         int tmpFd = mkstemp(tmpHsailFileName);
         FILE* tmpFile = fdopen(tmpFd, "w");
         int brigFile = mkstemp(tmpBrigFileName);
+        close(brigFile);
 
-        if (isVerbose()) cerr << "Fixed Hsail is\n==============\n" << *fixedHsailStr << endl;
-        fprintf(tmpFile, "%s", fixedHsailStr->c_str());
+        // the whole text is only logged at trace, it is too big for every createKernel
+        OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_TRACE, "Fixed Hsail is\n" << string(hsail, hsailLength));
+        fwrite(hsail, 1, hsailLength, tmpFile);
         fclose(tmpFile);
-        delete(fixedHsailStr);
+        if (build.entryName == NULL) {
+            if (rewritten.empty()) {
+                build.fixedHsail.assign(hsail, hsailLength);
+            } else {
+                build.fixedHsail.swap(rewritten);
+            }
+        }
+        uint64_t assembleStart = okraNanoTime();
+        build.info.write_ns = assembleStart - writeStart;
 
 		// use the -build hsailasm to translate source
 		// use debug flag
-        int bufLen = strlen(tmpHsailFileName) + strlen(tmpBrigFileName) + 128;
+        string asmFlags = assemblerFlags(build.options);
+        int bufLen = strlen(tmpHsailFileName) + strlen(tmpBrigFileName) + asmFlags.size() + 128;
         char* cmdBuf = (char *) malloc(bufLen);
-        sprintf(cmdBuf, "hsailasm %s -g -o %s", tmpHsailFileName, tmpBrigFileName);
+        sprintf(cmdBuf, "hsailasm %s %s -o %s", tmpHsailFileName, asmFlags.c_str(), tmpBrigFileName);
         int ret = spawnProgram(cmdBuf);
+        free(cmdBuf);
+        uint64_t readStart = okraNanoTime();
+        build.info.assemble_ns = readStart - assembleStart;
+        if (okraTraceOn()) {
+            if (hsail != build.source) {
+                okraTraceRecord("compile", "convert", convertStart, scanStart, build.entryName);
+            }
+            okraTraceRecord("compile", "hsailasm", assembleStart, readStart, build.entryName);
+        }
 
         if (ret != 0) {
-                       *kernel = NULL;
-                       return OKRA_KERNEL_CREATE_FAILED;
+                       remove(tmpBrigFileName);
+                       build.status = OKRA_KERNEL_HSAIL_ASSEMBLING_FAILED;
+                       return build.status;
                 }
-		if (isVerbose()) cerr << "hsailasm succeeded\n";
+		OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "hsailasm succeeded");
 
-		size_t brigSize = 0;
-		char *brigBuffer = readFile(tmpBrigFileName, brigSize);
-		if (brigBuffer == NULL) {
+		// mapped rather than read, removing the file below leaves the mapping intact
+		build.brigBuffer = mapFile(tmpBrigFileName, build.brigSize);
+		if (build.brigBuffer == NULL) {
 			printf("cannot read from the %s\n", tmpBrigFileName);
-			*kernel = NULL;
-			return OKRA_KERNEL_CREATE_FAILED;
+			build.status = OKRA_KERNEL_CREATE_FAILED;
+		} else {
+			build.mapBase = build.brigBuffer;
+			build.mapSize = build.brigSize;
 		}
 		// delete temporary files
     remove(tmpBrigFileName);
     if (!saveHsailSource) {
         remove(tmpHsailFileName);
     }
+		build.info.read_ns = okraNanoTime() - readStart;
+		if (build.status == OKRA_SUCCESS) {
+			storeCachedBrig(build);
+		}
+		return build.status;
+	}
+
+	// The brig cache holds one single-entry bundle per kernel, named by a hash
+	// of the source, entry and assembler options, BRIG_CACHE_VERSION and the
+	// hsailasm binary (path, size and mtime).  A hit skips ConvertHsail and
+	// hsailasm (the process spawn and temp files) and nothing else: native
+	// code is not cached, since the MCJIT engine compileKernel uses is private
+	// to libhsa and hsa::Program takes no object cache, so finalize still runs.
+	// Modules are not cached since their kernels are scanned from the fixed hsail.
+	// bump whenever the hsail rewrites (ConvertHsail, inlining) change what
+	// reaches hsailasm, so cached brig from older builds is not used
+	static const char *BRIG_CACHE_VERSION;
 
-		*kernel = createKernelCommon(brigBuffer, brigSize, entryName);
-                return OKRA_SUCCESS;
+	string brigCachePath(KernelBuild &build, uint64_t &sourceHash) {
+		sourceHash = okraHashBytes(build.source, build.sourceLength);
+		// the rest of the key continues the source hash rather than copying the source
+		string suffix;
+		suffix.append(1, '\0').append(build.entryName).append(1, '\0').append(assemblerFlags(build.options));
+		suffix.append(1, '\0').append(BRIG_CACHE_VERSION).append(1, '\0').append(assemblerIdentity);
+		if (build.options.inline_functions) {
+			// brig inlined at another OKRA_INLINE_THRESHOLD is a different brig
+			char threshold[32];
+			sprintf(threshold, "inline=%d", inlineThreshold);
+			suffix.append(1, '\0').append(threshold);
+		}
+		char name[64];
+		sprintf(name, "/%016llx.okb", (unsigned long long) okraHashBytes(suffix.data(), suffix.size(), sourceHash));
+		return cacheDir + name;
 	}
 
-	okra_status_t createKernelFromBinary(const char *brigBuffer, size_t brigSize, const char *entryName, Kernel **kernel) {
-		char *ptr = reinterpret_cast<char*>(malloc(brigSize));
-		if (!ptr) {
-                        *kernel = NULL;
-			return OKRA_KERNEL_CREATE_FAILED;
+	bool loadCachedBrig(KernelBuild &build) {
+		if (cacheDir.empty() || build.entryName == NULL) {
+			return false;
+		}
+		uint64_t start = okraNanoTime();
+		uint64_t sourceHash;
+		string path = brigCachePath(build, sourceHash);
+		size_t size = 0;
+		char *base = mapFile(path, size);
+		if (base == NULL) {
+			build.info.cache_ns = okraNanoTime() - start;
+			return false;
+		}
+		KernelBundleReader reader;
+		const KernelBundleEntry *entry = NULL;
+		if (reader.attach(base, size)) {
+			entry = reader.findBySourceHash(sourceHash, build.entryName);
 		}
+		if (entry == NULL) {
+			munmap(base, size);
+			build.info.cache_ns = okraNanoTime() - start;
+			return false;
+		}
+		build.brigBuffer = reader.getBrig(entry);
+		build.brigSize = entry->brigSize;
+		build.mapBase = base;
+		build.mapSize = size;
+		reader.getArgAccess(entry, build.argAccess);
+		build.cached = true;
+		build.info.cached = 1;
+		build.info.cache_ns = okraNanoTime() - start;
+		if (okraTraceOn()) okraTraceRecord("compile", "brigCacheHit", start, start + build.info.cache_ns, build.entryName);
+		OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_DEBUG, "brig cache hit " << path);
+		return true;
+	}
 
-		memcpy(ptr, brigBuffer, brigSize);
-		*kernel = createKernelCommon(ptr, brigSize, entryName);
-                return OKRA_SUCCESS;
+	void storeCachedBrig(KernelBuild &build) {
+		if (cacheDir.empty() || build.entryName == NULL) {
+			return;
+		}
+		uint64_t start = okraNanoTime();
+		uint64_t sourceHash;
+		string path = brigCachePath(build, sourceHash);
+		KernelBundleWriter writer;
+		writer.add(build.entryName, build.entryName, sourceHash, build.argAccess, build.brigBuffer, build.brigSize);
+		if (!writer.write(path.c_str())) {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_DEBUG, "cannot write brig cache " << path);
+		} else {
+			OKRA_LOG(OKRA_LOG_CACHE, OKRA_LOG_DEBUG, "brig cache stored " << path);
+		}
+		build.info.cache_ns += okraNanoTime() - start;
 	}
 
-	okra_status_t dispose(){
-#if 0
-		if (hsaProgram) {
-			hsaRuntime->destroyProgram(hsaProgram);
+	okra_status_t finalizeKernel(KernelBuild &build) {
+		// the kernel takes over the mapping holding the brig
+		BrigStorage storage;
+		storage.mapBase = build.mapBase;
+		storage.mapSize = build.mapSize;
+		build.mapBase = NULL;
+		build.kernel = createKernelCommon(build.brigBuffer, build.brigSize, storage, build.entryName, &build.info);
+		if (build.kernel == NULL) {
+			build.status = OKRA_KERNEL_FINALIZE_FAILED;
+			return build.status;
+		}
+		KernelImpl *kernelImpl = (KernelImpl *) build.kernel;
+		kernelImpl->argAccess = build.argAccess;
+		// the original text is kept so the kernel can be specialized or instrumented later
+		kernelImpl->source.assign(build.source, build.sourceLength);
+		kernelImpl->entryName = build.entryName;
+		kernelImpl->options = build.options;
+		if (okraLogEnabled(OKRA_LOG_ARGS, OKRA_LOG_DEBUG)) {
+			for (int i = 0; i < build.argAccess.size(); i++) {
+				if (build.argAccess[i] == Kernel::ARG_ACCESS_READ_ONLY) OKRA_LOG(OKRA_LOG_ARGS, OKRA_LOG_DEBUG, "kernarg " << i << " is read-only");
+			}
 		}
-#endif
 		return OKRA_SUCCESS;
 	}
 
-private:
-	Kernel * createKernelCommon(char *brigBuffer, size_t brigSize, const char *entryName) {
-    // Synchronize calls to hsa
+	// options given to hsailasm, only debug info is controlled here
+	string assemblerFlags(const okra_compile_options_t &options) {
+		return (options.debug_info ? "-g" : "");
+	}
+
+	// info carries the times of any earlier phases in and this kernel's
+	// complete build times out, it may be NULL.  The kernel takes over
+	// storage, which is released at once if the kernel can't be created.
+	Kernel * createKernelCommon(char *brigBuffer, size_t brigSize, BrigStorage storage, const char *entryName,
+								okra_kernel_build_info_t *info = NULL) {
+		okra_kernel_build_info_t localInfo;
+		if (info == NULL) {
+			memset(&localInfo, 0, sizeof(localInfo));
+			info = &localInfo;
+		}
+		uint64_t start = okraNanoTime();
+		hsa::Program *hsaProgram = createProgram(brigBuffer, brigSize);
+		info->create_program_ns = okraNanoTime() - start;
+		if (okraTraceOn()) okraTraceRecord("finalize", "createProgram", start, start + info->create_program_ns, entryName);
+		if(!hsaProgram) {
+			recordFinalize(*info, false);
+			storage.release();
+			return NULL;
+		}
+		KernelImpl *kernelImpl = compileEntry(hsaProgram, entryName, info);
+		if (kernelImpl == NULL) {
+			destroyProgram(hsaProgram);
+			storage.release();
+			return NULL;
+		}
+		kernelImpl->hsaProgram = hsaProgram;
+		kernelImpl->brig = storage;
+		return kernelImpl;
+	}
+
+	// add the finalize phases of one kernel to the context totals, the
+	// assembly phases are added by assembleKernel
+	void recordFinalize(const okra_kernel_build_info_t &info, bool succeeded) {
+		uint64_t finalizeNanos = info.create_program_ns + info.lock_wait_ns + info.compile_kernel_ns;
+		pthread_mutex_lock(&buildTotalsMutex);
+		buildTotals.kernels += (succeeded ? 1 : 0);
+		buildTotals.failures += (succeeded ? 0 : 1);
+		buildTotals.totals.create_program_ns += info.create_program_ns;
+		buildTotals.totals.lock_wait_ns += info.lock_wait_ns;
+		buildTotals.totals.compile_kernel_ns += info.compile_kernel_ns;
+		buildTotals.totals.total_ns += finalizeNanos;
+		pthread_mutex_unlock(&buildTotalsMutex);
+		if (okraMetricsOn()) {
+			okraMetricAdd(succeeded ? OKRA_METRIC_KERNELS_CREATED : OKRA_METRIC_KERNEL_FAILURES, 1);
+			if (succeeded) okraMetricObserve(OKRA_HISTOGRAM_COMPILE, info.total_ns);
+		}
+	}
+
+	// Synchronize calls to hsa, the lock covers only the runtime calls themselves
+	hsa::Program * createProgram(char *brigBuffer, size_t brigSize) {
     pthread_mutex_lock(&kernelCreateMutex);
 		hsa::Program *hsaProgram =	hsaRT->createProgram(brigBuffer, brigSize, &devices);
+    pthread_mutex_unlock(&kernelCreateMutex);
 		if(!hsaProgram) {
-			cerr<<"HSA create program failed"<<endl;
+			OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_ERROR, "HSA create program failed");
 			return NULL;
 		}
-		if (isVerbose()) cerr << "createProgram succeeded\n";
+		OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "createProgram succeeded");
+		return hsaProgram;
+	}
+
+	// also frees the kernels compiled from the program
+	void destroyProgram(hsa::Program *hsaProgram) {
+    pthread_mutex_lock(&kernelCreateMutex);
+		hsaRT->destroyProgram(hsaProgram);
+    pthread_mutex_unlock(&kernelCreateMutex);
+	}
 
+	KernelImpl * compileEntry(hsa::Program *hsaProgram, const char *entryName, okra_kernel_build_info_t *info = NULL) {
+		okra_kernel_build_info_t localInfo;
+		if (info == NULL) {
+			memset(&localInfo, 0, sizeof(localInfo));
+			info = &localInfo;
+		}
+		uint64_t lockStart = okraNanoTime();
+		vector<OkraCodeRange> code;
+    pthread_mutex_lock(&kernelCreateMutex);
+		const jit_code_entry *newestObject = okraJitNewestObject();
+		uint64_t compileStart = okraNanoTime();
+		// the simulator's finalizer takes no options
 		hsa::Kernel *hsaKernel = hsaProgram->compileKernel(entryName, "");
+		uint64_t compileEnd = okraNanoTime();
+		if (perfMap) okraJitNewCode(newestObject, code);
+    pthread_mutex_unlock(&kernelCreateMutex);
+		info->lock_wait_ns = compileStart - lockStart;
+		info->compile_kernel_ns = compileEnd - compileStart;
+		if (okraTraceOn()) {
+			okraTraceRecord("finalize", "compileLockWait", lockStart, compileStart, entryName);
+			okraTraceRecord("finalize", "compileKernel", compileStart, compileStart + info->compile_kernel_ns, entryName);
+		}
+		info->total_ns = info->convert_ns + info->scan_ns + info->cache_ns + info->write_ns + info->assemble_ns
+			+ info->read_ns + info->create_program_ns + info->lock_wait_ns + info->compile_kernel_ns;
+		recordFinalize(*info, hsaKernel != NULL);
 		if(!hsaKernel) {
-			cerr<<"HSA create kernel failed"<<endl;
+			OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_ERROR, "HSA create kernel failed");
 			return NULL;
 		}
-		if (isVerbose()) cerr << "createKernel succeeded\n";
-    pthread_mutex_unlock(&kernelCreateMutex);
+		OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "createKernel succeeded in " << info->total_ns << " ns (compileKernel " << info->compile_kernel_ns
+				 << " ns, hsailasm " << info->assemble_ns << " ns)");
+
+		if (perfMap) {
+			string symbol = string("okra:") + entryName;
+			if (!code.empty()) {
+				okraPerfMapWrite(code, symbol.c_str());
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "perf map: " << code.size() << " functions for " << entryName);
+			} else {
+				OKRA_LOG(OKRA_LOG_TOOLS, OKRA_LOG_DEBUG, "perf map: the JIT registered no code for " << entryName);
+			}
+		}
 
 		// if we got this far, success
-		return new KernelImpl(hsaKernel, this);
+		KernelImpl *kernelImpl = new KernelImpl(hsaKernel, this);
+		kernelImpl->buildInfo = *info;
+		kernelImpl->entryName = entryName;
+		return kernelImpl;
+	}
+
+	// contexts, and kernels that have been dispatched, are never freed so
+	// they can still be read at exit
+	static vector<OkraContextSimulatorImpl *> statsContexts;
+
+	static void reportAtExit(OkraContextSimulatorImpl *context) {
+		if (statsContexts.empty()) {
+			atexit(reportAll);
+		}
+		statsContexts.push_back(context);
+	}
+
+	static void reportAll() {
+		for (int i = 0; i < statsContexts.size(); i++) {
+			if (statsContexts[i]->dumpStatsOnExit) statsContexts[i]->dumpStats();
+			if (!statsContexts[i]->profileDir.empty()) statsContexts[i]->writeProfiles();
+			if (!statsContexts[i]->memTraceDir.empty()) statsContexts[i]->writeMemoryReports();
+		}
+	}
+
+	// one file per kernel, numbered in order of first dispatch since many
+	// kernels share an entry name
+	static string kernelReportPath(const string &dir, int index, const string &entryName, const char *suffix) {
+		string name = entryName;
+		for (size_t c = 0; c < name.size(); c++) {
+			if (!isalnum(name[c]) && name[c] != '_') name[c] = '_';
+		}
+		char path[64];
+		sprintf(path, "/%03d", index);
+		return dir + path + name + suffix;
+	}
+
+	void writeProfiles() {
+		pthread_mutex_lock(&dispatchedKernelsMutex);
+		for (int i = 0; i < dispatchedKernels.size(); i++) {
+			KernelImpl *kernel = dispatchedKernels[i];
+			string file = kernelReportPath(profileDir, i, kernel->entryName, ".prof");
+			if (kernel->writeProfile(file.c_str()) == OKRA_SUCCESS) {
+				cerr << "okra profile of " << kernel->entryName << " written to " << file << endl;
+			}
+		}
+		pthread_mutex_unlock(&dispatchedKernelsMutex);
+	}
+
+	void writeMemoryReports() {
+		pthread_mutex_lock(&dispatchedKernelsMutex);
+		for (int i = 0; i < dispatchedKernels.size(); i++) {
+			KernelImpl *kernel = dispatchedKernels[i];
+			string file = kernelReportPath(memTraceDir, i, kernel->entryName, ".mem");
+			if (kernel->writeMemoryReport(file.c_str()) == OKRA_SUCCESS) {
+				cerr << "okra memory report of " << kernel->entryName << " written to " << file << endl;
+			}
+		}
+		pthread_mutex_unlock(&dispatchedKernelsMutex);
+	}
+
+	// upper bound in us of the histogram bucket holding the given fraction of dispatches
+	static uint64_t histogramPercentile(const okra_kernel_stats_t &stats, double fraction) {
+		uint64_t target = (uint64_t) (stats.dispatches * fraction + 0.5);
+		uint64_t seen = 0;
+		for (int b = 0; b < OKRA_STATS_HISTOGRAM_BUCKETS; b++) {
+			seen += stats.execute_histogram[b];
+			if (seen >= target && seen != 0) return (1ULL << b);
+		}
+		return (1ULL << (OKRA_STATS_HISTOGRAM_BUCKETS - 1));
+	}
+
+	void dumpStats() {
+		okra_context_build_info_t build;
+		getBuildInfo(&build);
+		cerr << "okra build: " << build.kernels << " kernels, " << build.assembled << " assembled, "
+			 << build.cache_hits << " cache hits, " << build.failures << " failures, "
+			 << build.totals.total_ns / 1000000 << " ms (hsailasm " << build.totals.assemble_ns / 1000000
+			 << " ms, compileKernel " << build.totals.compile_kernel_ns / 1000000 << " ms)" << endl;
+
+		cerr << "okra dispatch:" << endl;
+		cerr << setw(32) << left << "kernel" << right << setw(10) << "count" << setw(12) << "total ms"
+			 << setw(10) << "mean us" << setw(10) << "min us" << setw(10) << "p50 us" << setw(10) << "p99 us"
+			 << setw(10) << "max us" << setw(12) << "marshal us" << setw(10) << "pin us" << setw(14) << "items/s" << endl;
+		pthread_mutex_lock(&dispatchedKernelsMutex);
+		for (int i = 0; i < dispatchedKernels.size(); i++) {
+			KernelImpl *kernel = dispatchedKernels[i];
+			okra_kernel_stats_t stats;
+			kernel->getStats(&stats);
+			string name = (kernel->entryName.empty() ? "(brig)" : kernel->entryName);
+			cerr << setw(32) << left << name << right << setw(10) << stats.dispatches
+				 << setw(12) << stats.execute_ns / 1000000
+				 << setw(10) << stats.execute_ns / stats.dispatches / 1000
+				 << setw(10) << stats.min_execute_ns / 1000
+				 << setw(10) << histogramPercentile(stats, 0.5)
+				 << setw(10) << histogramPercentile(stats, 0.99)
+				 << setw(10) << stats.max_execute_ns / 1000
+				 << setw(12) << stats.marshal_ns / stats.dispatches / 1000
+				 << setw(10) << stats.pin_ns / stats.dispatches / 1000
+				 << setw(14) << (uint64_t) (stats.execute_ns == 0 ? 0 : stats.work_items * 1e9 / stats.execute_ns) << endl;
+		}
+		pthread_mutex_unlock(&dispatchedKernelsMutex);
 	}
 
 	int spawnProgram (const char *cmd) {
-		if (isVerbose()) cerr << "spawning Program: " << cmd << endl;
+		OKRA_LOG(OKRA_LOG_COMPILE, OKRA_LOG_DEBUG, "spawning Program: " << cmd);
 		// not sure if we really have to do anything different for windows or linux here
 		// assuming the utility is in the path
 		return system(cmd);
 	}
 
-	string * fixHsail(const char *hsailStr) {
-		string *s = new string(hsailStr);
-
-		// the following conversions should no longer be needed because newer hsailasm is being used
-		if (false) {
-			// conversions are from 0.95 Spec format to MCW assembler format
-			// version string, we don't really handle the non-$full models here 
-			// also this should be made more regex based so we don't depend on whitespace
-			replaceAll (*s, "0:95: $full : $large", "1:0");
-			replaceAll (*s, "0:95: $full : $small", "1:0:$small");
-			// workitemabsid mnemonic
-			replaceAll (*s, "workitemabsid_u32", "workitemabsid");
-			// mul_hi mnemonic
-			replaceAll (*s, "mulhi", "mul_hi");
-			
-			// MCW assembler is pick about DOS line endings
-			replaceAll (*s, "\r", "");
-		}
-		if (false) {
-			// the following were the conversions from June 2012 format into MCW assembler format
-			replaceAll (*s, "1:0:large", "1:0");
-			replaceAll (*s, "1:0:small", "1:0:$small");
-			replaceAll (*s, "workitemaid", "workitemabsid");
-			replaceAll (*s, "cvt_near_f64_f32", "cvt_f64_f32");
-		}
-		return s;
-	}
-	
 }; // end of OkraContextSimulatorImpl
 
+okra_status_t OkraContext::getCompileProfile(const char *name, okra_compile_options_t *options) {
+	// debug_info, inline_functions
+	static const okra_compile_options_t defaultProfile = {1, 0};
+	static const okra_compile_options_t debugProfile = {1, 0};
+	static const okra_compile_options_t throughputProfile = {0, 1};
+	if (strcmp(name, "default") == 0) {
+		*options = defaultProfile;
+	} else if (strcmp(name, "debug") == 0) {
+		*options = debugProfile;
+	} else if (strcmp(name, "throughput") == 0) {
+		*options = throughputProfile;
+	} else {
+		return OKRA_INVALID_ARGUMENT;
+	}
+	return OKRA_SUCCESS;
+}
+
 bool OkraContext::isSimulator() {
 	return true;
 }
@@ -439,35 +2128,11 @@ bool  OkraContext::getCoherence() {
 	return true; 
 }
 
+vector<OkraContextSimulatorImpl *> OkraContextSimulatorImpl::statsContexts;
+const char *OkraContextSimulatorImpl::BRIG_CACHE_VERSION = "okra-brig-1";
+
 // Create an instance thru the OkraContext interface
 okra_status_t OkraContext::getContext(OkraContext** context) {		
 	*context = new OkraContextSimulatorImpl();
         return OKRA_SUCCESS;
 }
-
-
-#include "brig_runtime.h"
-// for debugging
-hsa::brig::BrigRegState prevRegState;
-using namespace std;
-
-static void showRegChanges(hsa::brig::BrigRegState *regs) {
-  for (int i=0; i<8; i++) {
-	if (regs->c[i] != prevRegState.c[i]) {
-	  cout << "$c" << i << "=" << regs->c[i] << endl;
-	}
-  }
-  for (int i=0; i<128; i++) {
-	if (regs->s[i] != prevRegState.s[i]) {
-		cout << dec << "$s" << i << "=" << regs->s[i] << ",  (0x" << setfill('0') << setw(8) << hex << regs->s[i] << "),  FP: " << *(float *)&(regs->s[i]) << endl;
-	}
-  }
-  for (int i=0; i<64; i++) {
-	if (regs->d[i] != prevRegState.d[i]) {
-		cout << dec << "$d" << i << "=" << regs->d[i] << ",  (0x" << setfill('0') << setw(16) << hex << regs->d[i] << "),  FP: " << *(double *)&(regs->d[i]) << endl;
-	}
-  }
-  cout << "\n";
-  prevRegState = *regs;
-}
-
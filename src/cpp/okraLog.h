@@ -0,0 +1,357 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef OKRALOG_H
+#define OKRALOG_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include "timeUtils.h"
+
+// Logging that stays off the hot paths.  A message is formatted on the
+// thread that logs it only if its subsystem's level lets it through, then
+// put on a bounded lock-free queue that a background thread writes out, so
+// the logging thread never waits on the output.  If the queue is full the
+// message is dropped and the writer reports how many were.  Errors are
+// written before okraLogPost returns, so they aren't lost in a crash.
+//
+//   OKRA_LOG=<level>[,<subsystem>=<level>...]   e.g. OKRA_LOG=info,args=trace
+//   OKRA_LOG_FILE=<path>                        default stderr
+//   OKRA_LOG_RATE=<n>                           messages per second from one log
+//                                               statement (default 10, 0 for no limit)
+//
+// Levels are error, warn, info, debug and trace; the default is warn.
+// OKRA_VERBOSE (or setVerbose) raises every subsystem OKRA_LOG doesn't name
+// to debug.  Per-arg and per-dimension messages are at trace.  Lines are
+// logfmt: okra t=<seconds> level=<level> sub=<subsystem> tid=<tid> msg="...".
+//
+// As with okraTrace.h the state lives in a local static of an inline
+// function so the translation units of libokra all share it.
+
+enum OkraLogLevel {
+	OKRA_LOG_ERROR,
+	OKRA_LOG_WARN,
+	OKRA_LOG_INFO,
+	OKRA_LOG_DEBUG,
+	OKRA_LOG_TRACE,
+	OKRA_LOG_LEVELS
+};
+
+enum OkraLogSubsystem {
+	OKRA_LOG_RUNTIME,    // context and hsa runtime setup
+	OKRA_LOG_COMPILE,    // hsail fixing, assembly, finalization
+	OKRA_LOG_CACHE,      // brig cache and bundles
+	OKRA_LOG_DISPATCH,   // launch attributes and dispatches
+	OKRA_LOG_ARGS,       // kernel args
+	OKRA_LOG_JNI,        // pinning and the java interface
+	OKRA_LOG_TOOLS,      // counters, profiles and traces
+	OKRA_LOG_SUBSYSTEMS
+};
+
+static const char *okraLogLevelNames[OKRA_LOG_LEVELS] = {"error", "warn", "info", "debug", "trace"};
+static const char *okraLogSubsystemNames[OKRA_LOG_SUBSYSTEMS] = {"runtime", "compile", "cache", "dispatch", "args", "jni", "tools"};
+
+#define OKRA_LOG_QUEUE_SIZE 4096        // a power of two
+
+struct OkraLogMessage {
+	uint64_t nanos;
+	int subsystem;
+	int level;
+	int tid;
+	uint64_t suppressed;         // messages from the same statement left out before this one
+	char *text;                  // malloced by the poster, freed by the writer
+};
+
+struct OkraLogCell {
+	volatile uint64_t sequence;
+	OkraLogMessage message;
+};
+
+// what one log statement has let through in the current second
+struct OkraLogSite {
+	volatile uint64_t windowStart;
+	volatile uint32_t inWindow;
+	volatile uint64_t suppressed;
+};
+
+struct OkraLogState {
+	int levels[OKRA_LOG_SUBSYSTEMS];
+	bool configured[OKRA_LOG_SUBSYSTEMS];   // named in OKRA_LOG
+	int defaultLevel;
+	uint32_t rateLimit;
+	uint64_t startNanos;
+	FILE *out;
+	// bounded queue, many posters and one writer at a time
+	OkraLogCell cells[OKRA_LOG_QUEUE_SIZE];
+	volatile uint64_t enqueuePos;
+	uint64_t dequeuePos;
+	volatile uint64_t dropped;
+	pthread_mutex_t drainMutex;
+	volatile bool writerStarted;
+
+	OkraLogState() {
+		defaultLevel = OKRA_LOG_WARN;
+		rateLimit = 10;
+		startNanos = okraNanoTime();
+		out = stderr;
+		for (int s = 0; s < OKRA_LOG_SUBSYSTEMS; s++) configured[s] = false;
+		for (uint64_t c = 0; c < OKRA_LOG_QUEUE_SIZE; c++) {
+			cells[c].sequence = c;
+		}
+		enqueuePos = dequeuePos = 0;
+		dropped = 0;
+		pthread_mutex_init(&drainMutex, NULL);
+		writerStarted = false;
+
+		char *logEnv = getenv("OKRA_LOG");
+		if (logEnv != NULL) {
+			std::string spec = logEnv;
+			size_t start = 0;
+			for (size_t comma = spec.find(','); ; start = comma + 1, comma = spec.find(',', start)) {
+				std::string item = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+				size_t eq = item.find('=');
+				int level = parseLevel(eq == std::string::npos ? item : item.substr(eq + 1));
+				if (level >= 0 && eq == std::string::npos) {
+					defaultLevel = level;
+				} else if (level >= 0) {
+					for (int s = 0; s < OKRA_LOG_SUBSYSTEMS; s++) {
+						if (item.compare(0, eq, okraLogSubsystemNames[s]) == 0 && strlen(okraLogSubsystemNames[s]) == eq) {
+							levels[s] = level;
+							configured[s] = true;
+						}
+					}
+				}
+				if (comma == std::string::npos) break;
+			}
+		}
+		for (int s = 0; s < OKRA_LOG_SUBSYSTEMS; s++) {
+			if (!configured[s]) levels[s] = defaultLevel;
+		}
+		char *rateEnv = getenv("OKRA_LOG_RATE");
+		if (rateEnv != NULL && atoi(rateEnv) >= 0) rateLimit = atoi(rateEnv);
+		char *fileEnv = getenv("OKRA_LOG_FILE");
+		if (fileEnv != NULL && *fileEnv != '\0') {
+			FILE *file = fopen(fileEnv, "a");
+			if (file != NULL) out = file;
+		}
+	}
+
+	static int parseLevel(const std::string &name) {
+		for (int l = 0; l < OKRA_LOG_LEVELS; l++) {
+			if (name == okraLogLevelNames[l]) return l;
+		}
+		return -1;
+	}
+};
+
+	inline OkraLogState &okraLogState() {
+		static OkraLogState state;
+		return state;
+	}
+
+	static inline bool okraLogEnabled(int subsystem, int level) {
+		return level <= okraLogState().levels[subsystem];
+	}
+
+	// verbose raises what OKRA_LOG leaves at the default to debug
+	inline void okraLogSetVerbose(bool verbose) {
+		OkraLogState &state = okraLogState();
+		for (int s = 0; s < OKRA_LOG_SUBSYSTEMS; s++) {
+			if (!state.configured[s]) {
+				state.levels[s] = (verbose ? std::max(state.defaultLevel, (int) OKRA_LOG_DEBUG) : state.defaultLevel);
+			}
+		}
+	}
+
+	// false if the statement is over its rate, else how many were left out since it last logged
+	inline bool okraLogAdmit(OkraLogSite &site, uint64_t &suppressed) {
+		OkraLogState &state = okraLogState();
+		suppressed = 0;
+		if (state.rateLimit == 0) return true;
+		uint64_t now = okraNanoTime();
+		if (now - site.windowStart >= 1000000000ULL) {
+			// racing threads may both reset, that only lets a few more through
+			site.windowStart = now;
+			site.inWindow = 0;
+		}
+		if (__sync_add_and_fetch(&site.inWindow, 1) > state.rateLimit) {
+			__sync_fetch_and_add(&site.suppressed, 1);
+			return false;
+		}
+		suppressed = __sync_lock_test_and_set(&site.suppressed, 0);
+		return true;
+	}
+
+	static inline void okraLogWriteString(FILE *out, const char *str) {
+		fputc('"', out);
+		for (const char *p = str; *p != '\0'; p++) {
+			if (*p == '"' || *p == '\\') {
+				fputc('\\', out);
+				fputc(*p, out);
+			} else if (*p == '\n') {
+				fputs("\\n", out);
+			} else if (*p == '\t') {
+				fputs("\\t", out);
+			} else if (*p != '\r') {
+				fputc(*p, out);
+			}
+		}
+		fputc('"', out);
+	}
+
+	// write out what is queued, one drainer at a time
+	inline void okraLogDrain() {
+		OkraLogState &state = okraLogState();
+		pthread_mutex_lock(&state.drainMutex);
+		bool wrote = false;
+		while (true) {
+			OkraLogCell &cell = state.cells[state.dequeuePos & (OKRA_LOG_QUEUE_SIZE - 1)];
+			if (cell.sequence != state.dequeuePos + 1) break;
+			__sync_synchronize();
+			OkraLogMessage message = cell.message;
+			__sync_synchronize();
+			cell.sequence = state.dequeuePos + OKRA_LOG_QUEUE_SIZE;
+			state.dequeuePos++;
+
+			fprintf(state.out, "okra t=%.6f level=%s sub=%s tid=%d msg=", (message.nanos - state.startNanos) / 1e9,
+					okraLogLevelNames[message.level], okraLogSubsystemNames[message.subsystem], message.tid);
+			okraLogWriteString(state.out, message.text);
+			if (message.suppressed != 0) fprintf(state.out, " suppressed=%llu", (unsigned long long) message.suppressed);
+			fputc('\n', state.out);
+			free(message.text);
+			wrote = true;
+		}
+		uint64_t dropped = __sync_lock_test_and_set(&state.dropped, 0);
+		if (dropped != 0) {
+			fprintf(state.out, "okra t=%.6f level=warn sub=runtime tid=%d msg=\"log queue full\" dropped=%llu\n",
+					(okraNanoTime() - state.startNanos) / 1e9, (int) syscall(SYS_gettid), (unsigned long long) dropped);
+			wrote = true;
+		}
+		if (wrote) fflush(state.out);
+		pthread_mutex_unlock(&state.drainMutex);
+	}
+
+	static void *okraLogWriter(void *arg) {
+		while (true) {
+			okraLogDrain();
+			usleep(2000);
+		}
+		return NULL;
+	}
+
+	static inline void okraLogAtExit() {
+		okraLogDrain();
+	}
+
+	inline void okraLogStartWriter() {
+		static pthread_mutex_t startMutex = PTHREAD_MUTEX_INITIALIZER;
+		OkraLogState &state = okraLogState();
+		pthread_mutex_lock(&startMutex);
+		if (!state.writerStarted) {
+			pthread_t thread;
+			if (pthread_create(&thread, NULL, okraLogWriter, NULL) == 0) {
+				pthread_detach(thread);
+			}
+			atexit(okraLogAtExit);
+			state.writerStarted = true;
+		}
+		pthread_mutex_unlock(&startMutex);
+	}
+
+	inline void okraLogPost(int subsystem, int level, const std::string &text, uint64_t suppressed) {
+		OkraLogState &state = okraLogState();
+		if (!state.writerStarted) okraLogStartWriter();
+		OkraLogMessage message;
+		message.nanos = okraNanoTime();
+		message.subsystem = subsystem;
+		message.level = level;
+		message.tid = (int) syscall(SYS_gettid);
+		message.suppressed = suppressed;
+		message.text = strdup(text.c_str());
+
+		// claim a cell whose sequence says it is free for this position
+		uint64_t pos = state.enqueuePos;
+		OkraLogCell *cell;
+		while (true) {
+			cell = &state.cells[pos & (OKRA_LOG_QUEUE_SIZE - 1)];
+			int64_t diff = (int64_t) cell->sequence - (int64_t) pos;
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&state.enqueuePos, pos, pos + 1)) break;
+				pos = state.enqueuePos;
+			} else if (diff < 0) {
+				free(message.text);
+				__sync_fetch_and_add(&state.dropped, 1);
+				return;
+			} else {
+				pos = state.enqueuePos;
+			}
+		}
+		cell->message = message;
+		__sync_synchronize();
+		cell->sequence = pos + 1;
+
+		if (level == OKRA_LOG_ERROR) okraLogDrain();
+	}
+
+// log message (anything that can be written to an ostream) if the
+// subsystem's level lets it through and the statement is under its rate
+#define OKRA_LOG(subsystem, level, message) \
+	do { \
+		if (okraLogEnabled(subsystem, level)) { \
+			static OkraLogSite okraLogSite; \
+			uint64_t okraLogSuppressed; \
+			if (okraLogAdmit(okraLogSite, okraLogSuppressed)) { \
+				std::ostringstream okraLogStream; \
+				okraLogStream << message; \
+				okraLogPost(subsystem, level, okraLogStream.str(), okraLogSuppressed); \
+			} \
+		} \
+	} while (0)
+
+#endif //OKRALOG_H
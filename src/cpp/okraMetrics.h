@@ -0,0 +1,339 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef OKRAMETRICS_H
+#define OKRAMETRICS_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include "timeUtils.h"
+
+// OKRA_METRICS publishes context-wide counters and histograms in the
+// Prometheus text format, for fleet monitoring to scrape:
+//
+//   OKRA_METRICS=<file>         rewritten every OKRA_METRICS_INTERVAL seconds (default 10)
+//   OKRA_METRICS=unix:<path>    served on a unix domain socket, as plain text or,
+//                               to a client that sends a GET, as an http response
+//
+// Each thread adds to a slot of its own that no other thread writes, so
+// recording takes no lock and no atomic read-modify-write; the exporter
+// thread sums the slots when it renders.  Gauges are kept as counts of ups
+// and downs, which sum correctly whichever threads made them.  When the
+// exporter is off every metric point is a single branch on okraMetricsOn().
+//
+// As with okraTrace.h the state lives in a local static of an inline
+// function so the translation units of libokra all share it.
+
+enum OkraMetric {
+	OKRA_METRIC_KERNELS_CREATED,
+	OKRA_METRIC_KERNEL_FAILURES,
+	OKRA_METRIC_CACHE_HITS,
+	OKRA_METRIC_DISPATCHES,
+	OKRA_METRIC_WORK_ITEMS,
+	OKRA_METRIC_PINNED_BYTES,
+	OKRA_METRIC_STAGED_BYTES,
+	OKRA_METRIC_DISPATCHES_IN_FLIGHT,   // gauge
+	OKRA_METRIC_COMPILE_QUEUE,          // gauge
+	OKRA_METRICS
+};
+
+enum OkraMetricHistogram {
+	OKRA_HISTOGRAM_COMPILE,
+	OKRA_HISTOGRAM_DISPATCH,
+	OKRA_METRIC_HISTOGRAMS
+};
+
+// bucket b counts times up to 2^b us, the last bucket is +Inf
+#define OKRA_METRICS_BUCKETS 26
+
+struct OkraMetricsSlot {
+	volatile int64_t values[OKRA_METRICS];
+	volatile uint64_t buckets[OKRA_METRIC_HISTOGRAMS][OKRA_METRICS_BUCKETS];
+	volatile uint64_t sumNanos[OKRA_METRIC_HISTOGRAMS];
+	OkraMetricsSlot *next;
+};
+
+struct OkraMetricsState {
+	bool enabled;
+	bool started;
+	int intervalSeconds;
+	std::string path;             // the file, or the socket after unix:
+	bool socket;
+	OkraMetricsSlot *volatile slots;
+	// for okra_work_items_per_second, the exporter's last render
+	uint64_t lastRenderNanos;
+	int64_t lastWorkItems;
+};
+
+static const char *okraMetricNames[OKRA_METRICS][3] = {
+	{"okra_kernels_created_total", "counter", "Kernels created."},
+	{"okra_kernel_failures_total", "counter", "Kernels that failed to assemble or finalize."},
+	{"okra_kernel_cache_hits_total", "counter", "Kernels whose brig came from the OKRA_CACHE_DIR cache."},
+	{"okra_dispatches_total", "counter", "Kernel dispatches completed."},
+	{"okra_work_items_total", "counter", "Work-items dispatched."},
+	{"okra_pinned_bytes_total", "counter", "Bytes of java arrays pinned for dispatches."},
+	{"okra_staged_bytes_total", "counter", "Bytes of java arrays copied to native buffers for dispatches."},
+	{"okra_dispatch_queue_depth", "gauge", "Dispatches in progress."},
+	{"okra_compile_queue_depth", "gauge", "Kernels waiting for a background compile thread."},
+};
+
+static const char *okraMetricHistogramNames[OKRA_METRIC_HISTOGRAMS][2] = {
+	{"okra_compile_seconds", "Time to create a kernel, assembly and finalization."},
+	{"okra_dispatch_seconds", "Time to dispatch a kernel, marshalling and execution."},
+};
+
+	inline OkraMetricsState &okraMetricsState() {
+		static OkraMetricsState state;
+		return state;
+	}
+
+	static inline bool okraMetricsOn() {
+		return okraMetricsState().enabled;
+	}
+
+	inline OkraMetricsSlot *okraMetricsSlot() {
+		static __thread OkraMetricsSlot *slot = NULL;
+		if (slot == NULL) {
+			OkraMetricsState &state = okraMetricsState();
+			slot = new OkraMetricsSlot();
+			memset((void *) slot, 0, sizeof(*slot));
+			// slots are never freed, a thread's counts outlive it
+			do {
+				slot->next = state.slots;
+			} while (!__sync_bool_compare_and_swap(&state.slots, slot->next, slot));
+		}
+		return slot;
+	}
+
+	// only the owning thread writes its slot, so a plain aligned store is enough
+	inline void okraMetricAdd(OkraMetric metric, int64_t delta) {
+		if (!okraMetricsOn()) return;
+		OkraMetricsSlot *slot = okraMetricsSlot();
+		slot->values[metric] = slot->values[metric] + delta;
+	}
+
+	inline void okraMetricObserve(OkraMetricHistogram histogram, uint64_t nanos) {
+		if (!okraMetricsOn()) return;
+		OkraMetricsSlot *slot = okraMetricsSlot();
+		uint64_t micros = (nanos + 999) / 1000;
+		int bucket = 0;
+		while (bucket < OKRA_METRICS_BUCKETS - 1 && (1ULL << bucket) < micros) bucket++;
+		slot->buckets[histogram][bucket] = slot->buckets[histogram][bucket] + 1;
+		slot->sumNanos[histogram] = slot->sumNanos[histogram] + nanos;
+	}
+
+	inline std::string okraMetricsRender() {
+		OkraMetricsState &state = okraMetricsState();
+		int64_t values[OKRA_METRICS];
+		uint64_t buckets[OKRA_METRIC_HISTOGRAMS][OKRA_METRICS_BUCKETS];
+		uint64_t sumNanos[OKRA_METRIC_HISTOGRAMS];
+		memset(values, 0, sizeof(values));
+		memset(buckets, 0, sizeof(buckets));
+		memset(sumNanos, 0, sizeof(sumNanos));
+		for (OkraMetricsSlot *slot = state.slots; slot != NULL; slot = slot->next) {
+			for (int m = 0; m < OKRA_METRICS; m++) values[m] += slot->values[m];
+			for (int h = 0; h < OKRA_METRIC_HISTOGRAMS; h++) {
+				for (int b = 0; b < OKRA_METRICS_BUCKETS; b++) buckets[h][b] += slot->buckets[h][b];
+				sumNanos[h] += slot->sumNanos[h];
+			}
+		}
+
+		std::string text;
+		char line[256];
+		for (int m = 0; m < OKRA_METRICS; m++) {
+			sprintf(line, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", okraMetricNames[m][0], okraMetricNames[m][2],
+					okraMetricNames[m][0], okraMetricNames[m][1], okraMetricNames[m][0], (long long) values[m]);
+			text += line;
+		}
+
+		// over the time since the last render, so over the scrape interval
+		uint64_t now = okraNanoTime();
+		double rate = 0;
+		if (state.lastRenderNanos != 0 && now > state.lastRenderNanos) {
+			rate = (values[OKRA_METRIC_WORK_ITEMS] - state.lastWorkItems) * 1e9 / (now - state.lastRenderNanos);
+		}
+		state.lastRenderNanos = now;
+		state.lastWorkItems = values[OKRA_METRIC_WORK_ITEMS];
+		sprintf(line, "# HELP okra_work_items_per_second Work-items dispatched per second since the last scrape.\n"
+				"# TYPE okra_work_items_per_second gauge\nokra_work_items_per_second %.1f\n", rate);
+		text += line;
+
+		for (int h = 0; h < OKRA_METRIC_HISTOGRAMS; h++) {
+			const char *name = okraMetricHistogramNames[h][0];
+			sprintf(line, "# HELP %s %s\n# TYPE %s histogram\n", name, okraMetricHistogramNames[h][1], name);
+			text += line;
+			uint64_t count = 0;
+			for (int b = 0; b < OKRA_METRICS_BUCKETS; b++) {
+				count += buckets[h][b];
+				if (b == OKRA_METRICS_BUCKETS - 1) {
+					sprintf(line, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) count);
+				} else {
+					sprintf(line, "%s_bucket{le=\"%g\"} %llu\n", name, (1ULL << b) / 1e6, (unsigned long long) count);
+				}
+				text += line;
+			}
+			sprintf(line, "%s_sum %.9f\n%s_count %llu\n", name, sumNanos[h] / 1e9, name, (unsigned long long) count);
+			text += line;
+		}
+		return text;
+	}
+
+	// rewrite the file whole so a reader never sees half of it, the lock is
+	// for the last write at exit racing the exporter thread
+	inline bool okraMetricsWriteFile(const std::string &path) {
+		static pthread_mutex_t writeMutex = PTHREAD_MUTEX_INITIALIZER;
+		pthread_mutex_lock(&writeMutex);
+		std::string text = okraMetricsRender();
+		std::string tmp = path + ".tmp";
+		FILE *file = fopen(tmp.c_str(), "w");
+		bool ok = (file != NULL);
+		if (ok) {
+			fwrite(text.data(), 1, text.size(), file);
+			ok = (fclose(file) == 0) && rename(tmp.c_str(), path.c_str()) == 0;
+		}
+		pthread_mutex_unlock(&writeMutex);
+		return ok;
+	}
+
+	inline void okraMetricsServe(int server) {
+		while (true) {
+			int client = accept(server, NULL, NULL);
+			if (client < 0) {
+				if (errno == EINTR) continue;
+				return;
+			}
+			// a scraper speaking http sends its request first, a plain reader sends nothing
+			char request[1024];
+			ssize_t got = 0;
+			struct pollfd pfd;
+			pfd.fd = client;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, 100) > 0) got = recv(client, request, sizeof(request), 0);
+			std::string text = okraMetricsRender();
+			std::string reply;
+			if (got >= 4 && strncmp(request, "GET ", 4) == 0) {
+				char header[160];
+				sprintf(header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n",
+						(unsigned long) text.size());
+				reply = header;
+			}
+			reply += text;
+			for (size_t sent = 0; sent < reply.size(); ) {
+				ssize_t n = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) break;
+				sent += n;
+			}
+			close(client);
+		}
+	}
+
+	static void *okraMetricsExporter(void *arg) {
+		OkraMetricsState &state = okraMetricsState();
+		if (!state.socket) {
+			while (true) {
+				if (!okraMetricsWriteFile(state.path)) {
+					fprintf(stderr, "cannot write OKRA_METRICS file %s\n", state.path.c_str());
+				}
+				sleep(state.intervalSeconds);
+			}
+		}
+		int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, state.path.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(state.path.c_str());
+		if (server < 0 || bind(server, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(server, 8) != 0) {
+			fprintf(stderr, "cannot serve OKRA_METRICS on %s: %s\n", state.path.c_str(), strerror(errno));
+			if (server >= 0) close(server);
+			return NULL;
+		}
+		okraMetricsServe(server);
+		close(server);
+		return NULL;
+	}
+
+	static inline void okraMetricsAtExit() {
+		OkraMetricsState &state = okraMetricsState();
+		if (state.socket) {
+			unlink(state.path.c_str());
+		} else {
+			okraMetricsWriteFile(state.path);
+		}
+	}
+
+	// reads OKRA_METRICS and OKRA_METRICS_INTERVAL and starts the exporter
+	// thread, called as each context is created
+	inline void okraMetricsInit() {
+		static pthread_mutex_t initMutex = PTHREAD_MUTEX_INITIALIZER;
+		OkraMetricsState &state = okraMetricsState();
+		pthread_mutex_lock(&initMutex);
+		if (!state.started) {
+			state.started = true;
+			char *metricsEnv = getenv("OKRA_METRICS");
+			if (metricsEnv != NULL && *metricsEnv != '\0') {
+				state.socket = (strncmp(metricsEnv, "unix:", 5) == 0);
+				state.path = (state.socket ? metricsEnv + 5 : metricsEnv);
+				char *intervalEnv = getenv("OKRA_METRICS_INTERVAL");
+				state.intervalSeconds = ((intervalEnv != NULL) && (atoi(intervalEnv) > 0) ? atoi(intervalEnv) : 10);
+				state.enabled = true;
+				pthread_t thread;
+				if (pthread_create(&thread, NULL, okraMetricsExporter, NULL) == 0) {
+					pthread_detach(thread);
+					atexit(okraMetricsAtExit);
+				} else {
+					state.enabled = false;
+				}
+			}
+		}
+		pthread_mutex_unlock(&initMutex);
+	}
+
+#endif //OKRAMETRICS_H
@@ -0,0 +1,161 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef OKRAPERFMAP_H
+#define OKRAPERFMAP_H
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <elf.h>
+#include <string>
+#include <vector>
+
+// OKRA_PERF_MAP=1 names the code of each kernel in /tmp/perf-<pid>.map, the
+// file perf reads for code it finds no symbols for, so samples in kernels
+// show up under their hsail entry names instead of as anonymous addresses.
+//
+// hsa::Kernel doesn't say where the engine's MCJIT put a kernel's code, but
+// MCJIT's RuntimeDyld hands every object it loads to debuggers through the
+// GDB JIT interface: a list of in-memory ELF objects hanging off
+// __jit_debug_descriptor, new ones at the head, with the section addresses
+// patched to where the sections were loaded.  The functions of the objects
+// added while compileKernel runs, with their load addresses and sizes from
+// the symbol tables, are the kernel's code.  The list is only changed by the
+// runtime calls, which all run under the kernel create lock.  If the JIT
+// registers nothing (the descriptor is weak and may be missing) no entries
+// are written.
+
+extern "C" {
+	struct jit_code_entry {
+		struct jit_code_entry *next_entry;
+		struct jit_code_entry *prev_entry;
+		const char *symfile_addr;
+		uint64_t symfile_size;
+	};
+
+	struct jit_descriptor {
+		uint32_t version;
+		uint32_t action_flag;
+		struct jit_code_entry *relevant_entry;
+		struct jit_code_entry *first_entry;
+	};
+
+	extern struct jit_descriptor __jit_debug_descriptor __attribute__((weak));
+}
+
+struct OkraCodeRange {
+	uint64_t start;
+	uint64_t end;
+	std::string function;
+};
+
+// the newest object the JIT has registered, NULL if none
+static const jit_code_entry *okraJitNewestObject() {
+	if (&__jit_debug_descriptor == NULL) return NULL;
+	return __jit_debug_descriptor.first_entry;
+}
+
+// the defined functions of one loaded ELF64 object
+static void okraJitObjectCode(const char *image, uint64_t size, std::vector<OkraCodeRange> &ranges) {
+	const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) image;
+	if (size < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64
+			|| ehdr->e_shentsize != sizeof(Elf64_Shdr) || ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size) {
+		return;
+	}
+	const Elf64_Shdr *shdrs = (const Elf64_Shdr *) (image + ehdr->e_shoff);
+	for (int s = 0; s < ehdr->e_shnum; s++) {
+		if (shdrs[s].sh_type != SHT_SYMTAB || shdrs[s].sh_link >= ehdr->e_shnum) continue;
+		const Elf64_Shdr &strtab = shdrs[shdrs[s].sh_link];
+		if (shdrs[s].sh_offset + shdrs[s].sh_size > size || strtab.sh_offset + strtab.sh_size > size) continue;
+		const Elf64_Sym *syms = (const Elf64_Sym *) (image + shdrs[s].sh_offset);
+		size_t numSyms = shdrs[s].sh_size / sizeof(Elf64_Sym);
+		for (size_t i = 0; i < numSyms; i++) {
+			const Elf64_Sym &sym = syms[i];
+			if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_size == 0
+					|| sym.st_shndx == SHN_UNDEF || sym.st_shndx >= ehdr->e_shnum || sym.st_name >= strtab.sh_size) {
+				continue;
+			}
+			// older RuntimeDyld patches symbol values to load addresses as
+			// well as section addresses, newer ones only the sections
+			const Elf64_Shdr &section = shdrs[sym.st_shndx];
+			bool absolute = (sym.st_value >= section.sh_addr && sym.st_value < section.sh_addr + section.sh_size);
+			OkraCodeRange range;
+			range.start = (absolute ? sym.st_value : section.sh_addr + sym.st_value);
+			range.end = range.start + sym.st_size;
+			range.function.assign(image + strtab.sh_offset + sym.st_name,
+								  strnlen(image + strtab.sh_offset + sym.st_name, strtab.sh_size - sym.st_name));
+			ranges.push_back(range);
+		}
+	}
+}
+
+// the functions of the objects registered since newestBefore was read
+static void okraJitNewCode(const jit_code_entry *newestBefore, std::vector<OkraCodeRange> &ranges) {
+	ranges.clear();
+	for (const jit_code_entry *entry = okraJitNewestObject(); entry != NULL && entry != newestBefore; entry = entry->next_entry) {
+		okraJitObjectCode(entry->symfile_addr, entry->symfile_size, ranges);
+	}
+}
+
+// append "start size name" lines to /tmp/perf-<pid>.map, a kernel with more
+// than one function gets name:function for each
+static bool okraPerfMapWrite(const std::vector<OkraCodeRange> &ranges, const char *name) {
+	static pthread_mutex_t mapMutex = PTHREAD_MUTEX_INITIALIZER;
+	char path[64];
+	sprintf(path, "/tmp/perf-%d.map", (int) getpid());
+	pthread_mutex_lock(&mapMutex);
+	FILE *map = fopen(path, "a");
+	if (map != NULL) {
+		for (size_t r = 0; r < ranges.size(); r++) {
+			fprintf(map, "%llx %llx %s%s%s\n", (unsigned long long) ranges[r].start,
+					(unsigned long long) (ranges[r].end - ranges[r].start), name,
+					(ranges.size() > 1 ? ":" : ""), (ranges.size() > 1 ? ranges[r].function.c_str() : ""));
+		}
+		fclose(map);
+	}
+	pthread_mutex_unlock(&mapMutex);
+	return map != NULL;
+}
+
+#endif // OKRAPERFMAP_H
@@ -0,0 +1,190 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// okra-regtrace: print the register writes recorded by
+// okra_kernel_trace_registers or OKRA_REG_TRACE.
+//
+//   okra-regtrace [-k &entry] [-w first[:count]] [-a] trace.bin
+//
+// For each traced dispatch and work-item the writes are listed in order, with
+// the hsail line that made them.  Like the old register dump, a write that
+// leaves a register's value unchanged is left out unless -a is given.
+
+#include "hsailRegTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+static void usage() {
+	fprintf(stderr, "usage: okra-regtrace [-k &entry] [-w first[:count]] [-a] trace.bin\n");
+}
+
+static bool readBytes(FILE *file, void *dest, size_t bytes) {
+	return bytes == 0 || fread(dest, bytes, 1, file) == 1;
+}
+
+static void printValue(const OkraRegTraceRecord &record) {
+	uint32_t word = (uint32_t) record.value;
+	float f;
+	double d;
+	switch (record.regClass) {
+	case 'c':
+		printf("$c%u=%llu", record.regNumber, (unsigned long long) record.value);
+		break;
+	case 's':
+		memcpy(&f, &word, sizeof(f));
+		printf("$s%u=%u,  (0x%08x),  FP: %g", record.regNumber, word, word, f);
+		break;
+	default:
+		memcpy(&d, &record.value, sizeof(d));
+		printf("$d%u=%llu,  (0x%016llx),  FP: %g", record.regNumber, (unsigned long long) record.value,
+			   (unsigned long long) record.value, d);
+		break;
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	const char *kernel = NULL;
+	uint64_t firstItem = 0;
+	uint64_t numItems = ~0ULL;
+	bool allWrites = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+			kernel = argv[++i];
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			char *end;
+			firstItem = strtoull(argv[++i], &end, 0);
+			numItems = (*end == ':' ? strtoull(end + 1, NULL, 0) : 1);
+		} else if (strcmp(argv[i], "-a") == 0) {
+			allWrites = true;
+		} else if (argv[i][0] == '-' || path != NULL) {
+			usage();
+			return 1;
+		} else {
+			path = argv[i];
+		}
+	}
+	if (path == NULL) {
+		usage();
+		return 1;
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "okra-regtrace: cannot read %s\n", path);
+		return 1;
+	}
+	OkraRegTraceFileHeader fileHeader;
+	if (!readBytes(file, &fileHeader, sizeof(fileHeader)) || memcmp(fileHeader.magic, OKRA_REGTRACE_MAGIC, 8) != 0
+			|| fileHeader.version != OKRA_REGTRACE_VERSION || fileHeader.recordBytes != sizeof(OkraRegTraceRecord)) {
+		fprintf(stderr, "okra-regtrace: %s is not a register trace\n", path);
+		fclose(file);
+		return 1;
+	}
+
+	OkraRegTraceDispatchHeader header;
+	while (readBytes(file, &header, sizeof(header))) {
+		if (header.magic != OKRA_REGTRACE_DISPATCH) {
+			fprintf(stderr, "okra-regtrace: %s is corrupt\n", path);
+			fclose(file);
+			return 1;
+		}
+		vector<char> name(header.nameBytes + 1, '\0');
+		vector<uint32_t> lines(header.numStatements);
+		vector<char> text(header.textBytes + 1, '\0');
+		if (!readBytes(file, &name[0], header.nameBytes)
+				|| !readBytes(file, lines.empty() ? NULL : &lines[0], lines.size() * sizeof(uint32_t))
+				|| !readBytes(file, &text[0], header.textBytes)) {
+			break;
+		}
+		vector<const char *> statements;
+		for (size_t off = 0; off < header.textBytes && statements.size() < header.numStatements; off += strlen(&text[off]) + 1) {
+			statements.push_back(&text[off]);
+		}
+		bool showKernel = (kernel == NULL || strcmp(kernel, &name[0]) == 0
+						   || (kernel[0] != '&' && name[0] == '&' && strcmp(kernel, &name[1]) == 0));
+		if (showKernel) {
+			printf("%s dispatch %u: work-items %u-%u, %u with writes\n", &name[0], header.dispatch, header.firstItem,
+				   header.firstItem + header.numItems - 1, header.tracedItems);
+		}
+
+		for (uint32_t n = 0; n < header.tracedItems; n++) {
+			OkraRegTraceItemHeader item;
+			if (!readBytes(file, &item, sizeof(item))) break;
+			vector<OkraRegTraceRecord> records(item.numRecords);
+			if (!readBytes(file, records.empty() ? NULL : &records[0], records.size() * sizeof(OkraRegTraceRecord))) break;
+			if (!showKernel || item.workItem < firstItem || item.workItem - firstItem >= numItems) continue;
+
+			printf("\nwork-item %u: %llu writes", item.workItem, (unsigned long long) item.written);
+			if (item.written > item.numRecords) {
+				printf(", the first %llu dropped", (unsigned long long) (item.written - item.numRecords));
+			}
+			printf("\n");
+			map<uint32_t, uint64_t> last;
+			for (uint32_t r = 0; r < records.size(); r++) {
+				const OkraRegTraceRecord &record = records[r];
+				uint32_t reg = (record.regClass << 16) | record.regNumber;
+				map<uint32_t, uint64_t>::iterator prev = last.find(reg);
+				bool changed = (prev == last.end() || prev->second != record.value);
+				last[reg] = record.value;
+				if (!changed && !allWrites) continue;
+				if (record.statement < statements.size()) {
+					printf("%6u  %-40s  ", lines[record.statement], statements[record.statement]);
+				} else {
+					printf("%6s  %-40s  ", "?", "?");
+				}
+				printValue(record);
+				printf("\n");
+			}
+		}
+		if (showKernel) printf("\n");
+	}
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,240 @@
+// University of Illinois/NCSA
+// Open Source License
+// 
+// Copyright (c) 2013, Advanced Micro Devices, Inc.
+// All rights reserved.
+// 
+// Developed by:
+// 
+//     Runtimes Team
+// 
+//     Advanced Micro Devices, Inc
+// 
+//     www.amd.com
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal with
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+// 
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimers.
+// 
+//     * Redistributions in binary form must reproduce the above copyright notice,
+//       this list of conditions and the following disclaimers in the
+//       documentation and/or other materials provided with the distribution.
+// 
+//     * Neither the names of the LLVM Team, University of Illinois at
+//       Urbana-Champaign, nor the names of its contributors may be used to
+//       endorse or promote products derived from this Software without specific
+//       prior written permission.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE
+// SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#ifndef OKRATRACE_H
+#define OKRATRACE_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <vector>
+#include "timeUtils.h"
+
+// OKRA_TRACE=<file> records compile, pinning and dispatch steps and writes
+// them at exit as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+// Each thread records into its own ring buffer of OKRA_TRACE_EVENTS events
+// (default 65536), so recording takes no lock and a long run keeps the most
+// recent events.  When tracing is off every trace point is a single branch
+// on okraTraceOn().
+//
+// The state lives in a local static of an inline function so that the
+// translation units of libokra all share it.
+
+struct OkraTraceEvent {
+	uint64_t start;              // okraNanoTime
+	uint64_t duration;
+	const char *category;        // string literals, never copied
+	const char *name;
+	const char *argName;         // NULL if the event has no count
+	int64_t argValue;
+	char kernel[56];             // kernel or entry name, truncated
+};
+
+struct OkraTraceRing {
+	pid_t tid;
+	uint32_t capacity;
+	uint64_t count;              // events ever recorded, the ring holds the last capacity
+	OkraTraceEvent *events;
+};
+
+struct OkraTraceState {
+	bool enabled;
+	uint32_t ringCapacity;
+	uint64_t startNanos;
+	char path[1024];
+	pthread_mutex_t ringsMutex;
+	std::vector<OkraTraceRing *> *rings;
+};
+
+	inline OkraTraceState &okraTraceState() {
+		static OkraTraceState state;
+		return state;
+	}
+
+	static inline bool okraTraceOn() {
+		return okraTraceState().enabled;
+	}
+
+	inline OkraTraceRing *okraTraceRing() {
+		static __thread OkraTraceRing *ring = NULL;
+		if (ring == NULL) {
+			OkraTraceState &state = okraTraceState();
+			ring = new OkraTraceRing();
+			ring->tid = (pid_t) syscall(SYS_gettid);
+			ring->capacity = state.ringCapacity;
+			ring->count = 0;
+			ring->events = new OkraTraceEvent[ring->capacity];
+			pthread_mutex_lock(&state.ringsMutex);
+			state.rings->push_back(ring);
+			pthread_mutex_unlock(&state.ringsMutex);
+		}
+		return ring;
+	}
+
+	// record a complete event, call only when okraTraceOn()
+	inline void okraTraceRecord(const char *category, const char *name, uint64_t start, uint64_t end,
+								const char *kernel = NULL, const char *argName = NULL, int64_t argValue = 0) {
+		OkraTraceRing *ring = okraTraceRing();
+		OkraTraceEvent &event = ring->events[ring->count % ring->capacity];
+		event.start = start;
+		event.duration = end - start;
+		event.category = category;
+		event.name = name;
+		event.argName = argName;
+		event.argValue = argValue;
+		event.kernel[0] = '\0';
+		if (kernel != NULL) {
+			strncpy(event.kernel, kernel, sizeof(event.kernel) - 1);
+			event.kernel[sizeof(event.kernel) - 1] = '\0';
+		}
+		ring->count++;
+	}
+
+	// entry names can hold anything hsail allows, quote what json needs quoted
+	static inline void okraTraceWriteString(FILE *file, const char *str) {
+		fputc('"', file);
+		for (const char *p = str; *p != '\0'; p++) {
+			if (*p == '"' || *p == '\\') {
+				fputc('\\', file);
+				fputc(*p, file);
+			} else if ((unsigned char) *p < 0x20) {
+				fprintf(file, "\\u%04x", *p);
+			} else {
+				fputc(*p, file);
+			}
+		}
+		fputc('"', file);
+	}
+
+	inline void okraTraceWrite() {
+		OkraTraceState &state = okraTraceState();
+		if (!state.enabled) return;
+		state.enabled = false;
+		FILE *file = fopen(state.path, "w");
+		if (file == NULL) {
+			fprintf(stderr, "cannot write OKRA_TRACE file %s\n", state.path);
+			return;
+		}
+		int pid = getpid();
+		fprintf(file, "{\"traceEvents\":[\n");
+		bool first = true;
+		pthread_mutex_lock(&state.ringsMutex);
+		for (size_t r = 0; r < state.rings->size(); r++) {
+			OkraTraceRing *ring = state.rings->at(r);
+			uint64_t oldest = (ring->count > ring->capacity ? ring->count - ring->capacity : 0);
+			for (uint64_t i = oldest; i < ring->count; i++) {
+				OkraTraceEvent &event = ring->events[i % ring->capacity];
+				fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+						(first ? "" : ",\n"), event.name, event.category, pid, (int) ring->tid,
+						(event.start - state.startNanos) / 1000.0, event.duration / 1000.0);
+				first = false;
+				const char *separator = "";
+				if (event.kernel[0] != '\0') {
+					fprintf(file, "\"kernel\":");
+					okraTraceWriteString(file, event.kernel);
+					separator = ",";
+				}
+				if (event.argName != NULL) {
+					fprintf(file, "%s\"%s\":%lld", separator, event.argName, (long long) event.argValue);
+				}
+				fprintf(file, "}}");
+			}
+		}
+		pthread_mutex_unlock(&state.ringsMutex);
+		fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+		fclose(file);
+	}
+
+	static inline void okraTraceAtExit() {
+		okraTraceWrite();
+	}
+
+	// reads OKRA_TRACE and OKRA_TRACE_EVENTS, called as each context is created
+	inline void okraTraceInit() {
+		OkraTraceState &state = okraTraceState();
+		if (state.rings != NULL) return;
+		char *traceEnv = getenv("OKRA_TRACE");
+		if (traceEnv == NULL || *traceEnv == '\0') return;
+		char *eventsEnv = getenv("OKRA_TRACE_EVENTS");
+		state.ringCapacity = ((eventsEnv != NULL) && (atoi(eventsEnv) > 0) ? atoi(eventsEnv) : 65536);
+		strncpy(state.path, traceEnv, sizeof(state.path) - 1);
+		state.startNanos = okraNanoTime();
+		pthread_mutex_init(&state.ringsMutex, NULL);
+		state.rings = new std::vector<OkraTraceRing *>();
+		atexit(okraTraceAtExit);
+		state.enabled = true;
+	}
+
+// times the enclosing scope, the kernel name is copied when the scope ends
+class OkraTraceScope {
+public:
+	OkraTraceScope(const char *_category, const char *_name, const char *_kernel = NULL,
+				   const char *_argName = NULL, int64_t _argValue = 0) : start(0) {
+		if (okraTraceOn()) {
+			category = _category;
+			name = _name;
+			kernel = _kernel;
+			argName = _argName;
+			argValue = _argValue;
+			start = okraNanoTime();
+		}
+	}
+
+	~OkraTraceScope() {
+		if (start != 0) {
+			okraTraceRecord(category, name, start, okraNanoTime(), kernel, argName, argValue);
+		}
+	}
+
+private:
+	uint64_t start;
+	const char *category;
+	const char *name;
+	const char *kernel;
+	const char *argName;
+	int64_t argValue;
+};
+
+#endif //OKRATRACE_H
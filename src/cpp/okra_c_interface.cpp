@@ -41,6 +41,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "okraContext.h"
+#include "kernelBundle.h"
 #include <stdio.h>
 
 okra_status_t OKRA_API okra_get_context(okra_context_t** context) {
@@ -58,6 +59,59 @@ okra_status_t OKRA_API okra_create_kernel(okra_context_t* context,
     return status;
 }
 
+okra_status_t OKRA_API okra_create_kernel_async(okra_context_t* context, 
+                        const char *hsail_source, const char *entryName, 
+                        okra_pending_kernel_t **pending) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !pending) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernelAsync(hsail_source, entryName, 
+                                                    (OkraContext::PendingKernel**)pending, NULL, NULL);
+    return status;
+}
+
+okra_status_t OKRA_API okra_pending_kernel_poll(okra_pending_kernel_t* pending, int *done) {
+    OkraContext::PendingKernel* realPending = (OkraContext::PendingKernel*) pending;
+    if(!realPending || !done) return OKRA_INVALID_ARGUMENT;
+    *done = realPending->isDone() ? 1 : 0;
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_pending_kernel_wait(okra_pending_kernel_t* pending, 
+                        okra_kernel_t **kernel) {
+    OkraContext::PendingKernel* realPending = (OkraContext::PendingKernel*) pending;
+    if(!realPending || !kernel) return OKRA_INVALID_ARGUMENT;
+    okra_status_t status = realPending->wait((OkraContext::Kernel**)kernel);
+    return status;
+}
+
+okra_status_t OKRA_API okra_dispose_pending_kernel(okra_pending_kernel_t* pending) {
+
+    if(!pending) return OKRA_INVALID_ARGUMENT;
+    OkraContext::PendingKernel* realPending = (OkraContext::PendingKernel*) pending;
+    
+    realPending->dispose();
+    pending = NULL;
+   
+    return OKRA_SUCCESS;
+
+}
+
+okra_status_t OKRA_API okra_create_kernels(okra_context_t* context, uint32_t count,
+                        const char **hsail_sources, const char **entryNames,
+                        okra_kernel_t **kernels) {
+    return okra_create_kernels_timed(context, count, hsail_sources, entryNames, kernels, NULL);
+}
+
+okra_status_t OKRA_API okra_create_kernels_timed(okra_context_t* context, uint32_t count,
+                        const char **hsail_sources, const char **entryNames,
+                        okra_kernel_t **kernels, okra_batch_times_t *times) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !hsail_sources || !entryNames || !kernels) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernels(count, hsail_sources, entryNames, 
+                                                    (OkraContext::Kernel**)kernels, times);
+    return status;
+}
+
 okra_status_t OKRA_API okra_create_kernel_from_binary(okra_context_t *context, 
                         const char *binary, size_t size, const char *entryName,
                         okra_kernel_t **kernel) {
@@ -68,6 +122,135 @@ okra_status_t OKRA_API okra_create_kernel_from_binary(okra_context_t *context,
     return status;
 }
 
+okra_status_t OKRA_API okra_create_module(okra_context_t* context,
+                        const char *hsail_source, okra_module_t **module) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createModule(hsail_source, (OkraContext::Module**)module);
+    return status;
+}
+
+okra_status_t OKRA_API okra_create_module_from_binary(okra_context_t* context,
+                        const char *binary, size_t size, okra_module_t **module) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createModuleFromBinary(binary, size, (OkraContext::Module**)module);
+    return status;
+}
+
+okra_status_t OKRA_API okra_module_get_kernel(okra_module_t* module,
+                        const char *entryName, okra_kernel_t **kernel) {
+    OkraContext::Module* realModule = (OkraContext::Module*) module;
+    if(!realModule) return OKRA_INVALID_ARGUMENT;
+    okra_status_t status = realModule->getKernel(entryName, (OkraContext::Kernel**)kernel);
+    return status;
+}
+
+okra_status_t OKRA_API okra_dispose_module(okra_module_t* module) {
+
+    if(!module) return OKRA_INVALID_ARGUMENT;
+    OkraContext::Module* realModule = (OkraContext::Module*) module;
+    
+    realModule->dispose();
+    module = NULL;
+   
+    return OKRA_SUCCESS;
+
+}
+
+okra_status_t OKRA_API okra_get_compile_profile(const char *name, okra_compile_options_t *options) {
+    if(!name || !options) return OKRA_INVALID_ARGUMENT;
+    return OkraContext::getCompileProfile(name, options);
+}
+
+okra_status_t OKRA_API okra_get_default_compile_options(okra_context_t *context,
+                        okra_compile_options_t *options) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !options) return OKRA_INVALID_ARGUMENT;
+    ctx->getDefaultCompileOptions(options);
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_create_kernel_with_options(okra_context_t* context, 
+                        const char *hsail_source, const char *entryName, 
+                        const okra_compile_options_t *options, okra_kernel_t **kernel) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernel(hsail_source, entryName, options,
+                                                    (OkraContext::Kernel**)kernel);
+    return status;
+}
+
+okra_status_t OKRA_API okra_create_kernel_from_buffer(okra_context_t* context, 
+                        const char *hsail_source, size_t length, const char *entryName, 
+                        const okra_compile_options_t *options, okra_kernel_t **kernel) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !hsail_source) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernel(hsail_source, length, entryName, options,
+                                                    (OkraContext::Kernel**)kernel);
+    return status;
+}
+
+okra_status_t OKRA_API okra_create_kernel_from_binary_ex(okra_context_t *context, 
+                        const char *binary, size_t size, const char *entryName,
+                        uint32_t flags, okra_kernel_t **kernel) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernelFromBinary(binary, size, entryName, 
+                                                      (OkraContext::Kernel**)kernel,
+                                                      (flags & OKRA_BINARY_CALLER_OWNED) != 0);
+    return status;
+}
+
+okra_status_t OKRA_API okra_create_kernel_from_file(okra_context_t *context, 
+                        const char *path, const char *entryName,
+                        okra_kernel_t **kernel) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !path) return OKRA_INVALID_ARGUMENT; 
+    okra_status_t status = ctx->createKernelFromFile(path, entryName, 
+                                                    (OkraContext::Kernel**)kernel);
+    return status;
+}
+
+okra_status_t OKRA_API okra_write_bundle(okra_context_t *context, const char *path,
+                        int numKernels, const char **names, const char **hsail_sources,
+                        const char **entryNames) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !path || numKernels < 0 || !names || !hsail_sources || !entryNames) return OKRA_INVALID_ARGUMENT;
+    return ctx->writeBundle(path, numKernels, names, hsail_sources, entryNames);
+}
+
+okra_status_t OKRA_API okra_open_bundle(okra_context_t *context, const char *path,
+                        okra_bundle_t **bundle) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !path || !bundle) return OKRA_INVALID_ARGUMENT;
+    return ctx->openBundle(path, (OkraContext::Bundle**)bundle);
+}
+
+okra_status_t OKRA_API okra_bundle_create_kernel(okra_bundle_t *bundle,
+                        const char *name, const char *entryName, okra_kernel_t **kernel) {
+    OkraContext::Bundle* realBundle = (OkraContext::Bundle*) bundle;
+    if(!realBundle || !name || !kernel) return OKRA_INVALID_ARGUMENT;
+    return realBundle->createKernel(name, entryName, (OkraContext::Kernel**)kernel);
+}
+
+okra_status_t OKRA_API okra_bundle_create_kernel_by_hash(okra_bundle_t *bundle,
+                        uint64_t sourceHash, const char *entryName, okra_kernel_t **kernel) {
+    OkraContext::Bundle* realBundle = (OkraContext::Bundle*) bundle;
+    if(!realBundle || !kernel) return OKRA_INVALID_ARGUMENT;
+    return realBundle->createKernelBySourceHash(sourceHash, entryName, (OkraContext::Kernel**)kernel);
+}
+
+uint64_t OKRA_API okra_hash_hsail_source(const char *hsail_source) {
+    return okraHashString(hsail_source);
+}
+
+okra_status_t OKRA_API okra_dispose_bundle(okra_bundle_t *bundle) {
+    OkraContext::Bundle* realBundle = (OkraContext::Bundle*) bundle;
+    if(!realBundle) return OKRA_INVALID_ARGUMENT;
+    return realBundle->dispose();
+}
+
 okra_status_t OKRA_API okra_push_pointer(okra_kernel_t* kernel, 
                         void* address) {
     OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
@@ -126,6 +309,78 @@ okra_status_t OKRA_API okra_clear_args(okra_kernel_t* kernel) {
     return status;
 }
 
+okra_status_t OKRA_API okra_kernel_specialize_arg(okra_kernel_t* kernel, uint32_t index) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel) return OKRA_INVALID_ARGUMENT;
+    return realKernel->specializeArg(index);
+}
+
+okra_status_t OKRA_API okra_get_kernel_build_info(okra_kernel_t* kernel, okra_kernel_build_info_t *info) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel || !info) return OKRA_INVALID_ARGUMENT;
+    realKernel->getBuildInfo(info);
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_get_context_build_info(okra_context_t* context, okra_context_build_info_t *info) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !info) return OKRA_INVALID_ARGUMENT;
+    ctx->getBuildInfo(info);
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_get_kernel_stats(okra_kernel_t* kernel, okra_kernel_stats_t *stats) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel || !stats) return OKRA_INVALID_ARGUMENT;
+    realKernel->getStats(stats);
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_get_context_stats(okra_context_t* context, okra_context_stats_t *stats) {
+    OkraContext* ctx = (OkraContext*) context;
+    if(!ctx || !stats) return OKRA_INVALID_ARGUMENT;
+    ctx->getStats(stats);
+    return OKRA_SUCCESS;
+}
+
+okra_status_t OKRA_API okra_kernel_enable_counters(okra_kernel_t* kernel, uint32_t enable) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel) return OKRA_INVALID_ARGUMENT;
+    return realKernel->enableCounters(enable != 0);
+}
+
+okra_status_t OKRA_API okra_get_dispatch_counters(okra_kernel_t* kernel, okra_dispatch_counters_t *counters) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel || !counters) return OKRA_INVALID_ARGUMENT;
+    return realKernel->getDispatchCounters(counters);
+}
+
+okra_status_t OKRA_API okra_kernel_write_profile(okra_kernel_t* kernel, const char *path) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel || !path) return OKRA_INVALID_ARGUMENT;
+    return realKernel->writeProfile(path);
+}
+
+okra_status_t OKRA_API okra_kernel_trace_registers(okra_kernel_t* kernel, uint32_t first_item, uint32_t num_items,
+                                                   uint32_t records_per_item, const char *path) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel) return OKRA_INVALID_ARGUMENT;
+    return realKernel->traceRegisters(first_item, num_items, records_per_item, path);
+}
+
+okra_status_t OKRA_API okra_kernel_trace_memory(okra_kernel_t* kernel, uint32_t first_group, uint32_t num_groups,
+                                                uint32_t records_per_item) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel) return OKRA_INVALID_ARGUMENT;
+    return realKernel->traceMemory(first_group, num_groups, records_per_item);
+}
+
+okra_status_t OKRA_API okra_kernel_write_memory_report(okra_kernel_t* kernel, const char *path) {
+    OkraContext::Kernel* realKernel = (OkraContext::Kernel*) kernel;
+    if(!realKernel || !path) return OKRA_INVALID_ARGUMENT;
+    return realKernel->writeMemoryReport(path);
+}
+
 okra_status_t OKRA_API okra_execute_kernel(okra_context_t* context, okra_kernel_t* kernel,  
                                                                       okra_range_t* range) {
 